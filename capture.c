@@ -0,0 +1,237 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "demux.h"
+#include "utils.h"
+
+int capture_open(struct capture *c, unsigned int adapter, unsigned int demux, char *pids) {
+
+	memset(c, 0, sizeof(struct capture));
+	c->adapter = adapter;
+	c->demux = demux;
+	c->dvr_fd = -1;
+
+	if (capture_set_pids(c, pids) < 0)
+		goto err;
+
+	c->dvr_fd = demux_open_dvr(adapter, demux);
+	if (c->dvr_fd == -1)
+		goto err;
+
+	return 0;
+
+err:
+	capture_close(c);
+	return -1;
+}
+
+int capture_set_pids(struct capture *c, char *pids) {
+
+	// Parse the whole list first so that a typo doesn't change anything
+	unsigned char wanted[CAPTURE_PID_ALL / 8 + 1] = { 0 };
+	unsigned int count = 0;
+
+	char *my_pids = strdup(pids);
+	if (!my_pids) {
+		perror("Not enough memory");
+		return -1;
+	}
+
+	char *str, *token, *saveptr = NULL;
+	for (str = my_pids; (token = strtok_r(str, ", \t\r\n", &saveptr)); str = NULL) {
+		uint16_t pid;
+		if (sscanf(token, "%hu", &pid) != 1 || pid > CAPTURE_PID_ALL) {
+			printf("Unparseable PID : \"%s\"\n", token);
+			free(my_pids);
+			return -1;
+		}
+		wanted[pid / 8] |= 1 << (pid % 8);
+		count++;
+	}
+
+	free(my_pids);
+
+	if (!count) {
+		printf("No PID to capture\n");
+		return -1;
+	}
+
+	// A failure below leaves the filters partly changed, the caller has
+	// to look at c->pids to know what is captured
+	int changes = 0;
+
+	// Drop the filters not wanted anymore and keep the others running
+	unsigned int i;
+	for (i = c->pid_count; i-- > 0;) {
+		uint16_t pid = c->pids[i];
+		if (wanted[pid / 8] & (1 << (pid % 8))) {
+			wanted[pid / 8] &= ~(1 << (pid % 8));
+			continue;
+		}
+		if (capture_remove_pid(c, pid))
+			return -1;
+		changes++;
+	}
+
+	uint16_t pid;
+	for (pid = 0; pid <= CAPTURE_PID_ALL; pid++) {
+		if (!(wanted[pid / 8] & (1 << (pid % 8))))
+			continue;
+		if (capture_add_pid(c, pid))
+			return -1;
+		changes++;
+	}
+
+	return changes;
+}
+
+int capture_add_pid(struct capture *c, uint16_t pid) {
+
+	int *demux_fds = realloc(c->demux_fds, sizeof(int) * (c->pid_count + 1));
+	if (!demux_fds) {
+		perror("Not enough memory");
+		return -1;
+	}
+	c->demux_fds = demux_fds;
+
+	uint16_t *pids = realloc(c->pids, sizeof(uint16_t) * (c->pid_count + 1));
+	if (!pids) {
+		perror("Not enough memory");
+		return -1;
+	}
+	c->pids = pids;
+
+	int fd = demux_open_filter(c->adapter, c->demux, pid);
+	if (fd == -1)
+		return -1;
+
+	c->demux_fds[c->pid_count] = fd;
+	c->pids[c->pid_count] = pid;
+	c->pid_count++;
+
+	dvb_debug("Capturing PID %hu\n", pid);
+
+	return 0;
+}
+
+int capture_remove_pid(struct capture *c, uint16_t pid) {
+
+	unsigned int i;
+	for (i = 0; i < c->pid_count && c->pids[i] != pid; i++);
+	if (i >= c->pid_count)
+		return -1;
+
+	// Stopping the filter doesn't disturb the DVR, the other PIDs keep flowing
+	demux_close(c->demux_fds[i]);
+
+	c->pid_count--;
+	memmove(&c->demux_fds[i], &c->demux_fds[i + 1], sizeof(int) * (c->pid_count - i));
+	memmove(&c->pids[i], &c->pids[i + 1], sizeof(uint16_t) * (c->pid_count - i));
+
+	dvb_debug("Not capturing PID %hu anymore\n", pid);
+
+	return 0;
+}
+
+size_t capture_pid_list(struct capture *c, char *str, size_t size) {
+
+	// Comma separated, in the order the filters were added
+	size_t len = 0;
+	unsigned int i;
+	for (i = 0; i < c->pid_count && len < size; i++)
+		len += snprintf(str + len, size - len, (i ? ",%hu" : "%hu"), c->pids[i]);
+
+	if (!c->pid_count && size)
+		str[0] = 0;
+
+	return (len < size ? len : size - 1);
+}
+
+size_t capture_text_packet(unsigned char *pkt, uint16_t pid, unsigned char cc, char *text, size_t len) {
+
+	// Payload only, the rest of the packet is stuffed with 0xff
+	memset(pkt, 0xff, CAPTURE_TS_LEN);
+	pkt[0] = 0x47;
+	pkt[1] = (pid >> 8) & 0x1f;
+	pkt[2] = pid & 0xff;
+	pkt[3] = 0x10 | (cc & 0xf);
+
+	size_t chunk = (len > CAPTURE_TS_LEN - 4 ? CAPTURE_TS_LEN - 4 : len);
+	memcpy(pkt + 4, text, chunk);
+
+	return chunk;
+}
+
+ssize_t capture_read(struct capture *c, unsigned char *buff, size_t size) {
+
+	// Only hand out whole packets, keep the rest for the next read
+	size -= size % CAPTURE_TS_LEN;
+	if (size < CAPTURE_TS_LEN)
+		return -1;
+
+	memcpy(buff, c->partial, c->partial_len);
+	ssize_t len = c->partial_len;
+
+	ssize_t r = read(c->dvr_fd, buff + len, size - len);
+	if (r < 0) {
+		if (errno == EOVERFLOW) {
+			// The stream skipped, the partial packet won't be completed
+			printf("Buffer overflow, your computer is too slow !!!\n");
+			c->overflows++;
+			c->partial_len = 0;
+			return 0;
+		}
+		// Interrupted before anything arrived, the partial packet is still good
+		if (errno == EINTR)
+			return 0;
+		perror("Error while reading from the dvr device");
+		return -1;
+	}
+
+	len += r;
+	c->partial_len = len % CAPTURE_TS_LEN;
+	len -= c->partial_len;
+	memcpy(c->partial, buff + len, c->partial_len);
+
+	return len;
+}
+
+void capture_close(struct capture *c) {
+
+	if (c->dvr_fd != -1)
+		demux_close(c->dvr_fd);
+
+	unsigned int i;
+	for (i = 0; i < c->pid_count; i++)
+		demux_close(c->demux_fds[i]);
+
+	free(c->demux_fds);
+	free(c->pids);
+	memset(c, 0, sizeof(struct capture));
+	c->dvr_fd = -1;
+}
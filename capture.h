@@ -0,0 +1,58 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CAPTURE_TS_LEN		188	// Size of an MPEG TS packet
+#define CAPTURE_PID_ALL		0x2000	// Special PID to get the full TS
+
+struct capture {
+	unsigned int adapter, demux;
+
+	// One demux filter per PID
+	int *demux_fds;
+	uint16_t *pids;
+	unsigned int pid_count;
+
+	int dvr_fd;
+
+	// Start of a packet the last read cut in half
+	unsigned char partial[CAPTURE_TS_LEN];
+	unsigned int partial_len;
+
+	unsigned long overflows;
+};
+
+int capture_open(struct capture *c, unsigned int adapter, unsigned int demux, char *pids);
+int capture_set_pids(struct capture *c, char *pids);
+int capture_add_pid(struct capture *c, uint16_t pid);
+int capture_remove_pid(struct capture *c, uint16_t pid);
+size_t capture_pid_list(struct capture *c, char *str, size_t size);
+size_t capture_text_packet(unsigned char *pkt, uint16_t pid, unsigned char cc, char *text, size_t len);
+ssize_t capture_read(struct capture *c, unsigned char *buff, size_t size);
+void capture_close(struct capture *c);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/dvb/dmx.h>
+
+#include "demux.h"
+
+int demux_open_filter(unsigned int adapter, unsigned int demux, uint16_t pid) {
+
+	char demux_str[NAME_MAX];
+	snprintf(demux_str, NAME_MAX - 1, "/dev/dvb/adapter%u/demux%u", adapter, demux);
+
+	int fd = open(demux_str, O_RDWR);
+	if (fd == -1) {
+		perror("Error while opening the demux");
+		return -1;
+	}
+
+	struct dmx_pes_filter_params filter = {0};
+	filter.pid = pid;
+	filter.input = DMX_IN_FRONTEND;
+	filter.output = DMX_OUT_TS_TAP;
+	filter.pes_type = DMX_PES_OTHER;
+	filter.flags = DMX_IMMEDIATE_START;
+
+	if (ioctl(fd, DMX_SET_PES_FILTER, &filter) != 0) {
+		perror("Error while setting demux filter");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int demux_open_dvr(unsigned int adapter, unsigned int demux) {
+
+	char dvr_str[NAME_MAX];
+	snprintf(dvr_str, NAME_MAX - 1, "/dev/dvb/adapter%u/dvr%u", adapter, demux);
+
+	int fd = open(dvr_str, O_RDONLY);
+	if (fd == -1)
+		perror("Error while opening the dvr device");
+
+	return fd;
+}
+
+int demux_close(int fd) {
+
+	return close(fd);
+}
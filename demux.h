@@ -0,0 +1,34 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __DEMUX_H__
+#define __DEMUX_H__
+
+#include <stdint.h>
+
+// Demux and DVR devices, replaced by a simulation in the tests
+
+int demux_open_filter(unsigned int adapter, unsigned int demux, uint16_t pid);
+int demux_open_dvr(unsigned int adapter, unsigned int demux);
+int demux_close(int fd);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "diseqc.h"
+#include "frontend.h"
+
+static uint64_t diseqc_now() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void diseqc_wait(unsigned int ms) {
+
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+	while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+static void diseqc_settle(uint64_t last, unsigned int ms) {
+
+	// Only wait for what is left of the quiet time
+	uint64_t elapsed = diseqc_now() - last;
+	if (elapsed >= ms * 1000)
+		return;
+
+	uint64_t left = ms * 1000 - elapsed;
+	struct timespec ts = { left / 1000000, (left % 1000000) * 1000 };
+	while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+void diseqc_seq_init(struct diseqc_seq *seq) {
+
+	memset(seq, 0, sizeof(struct diseqc_seq));
+}
+
+static struct diseqc_step *diseqc_seq_add(struct diseqc_seq *seq, enum diseqc_step_type type, unsigned int value) {
+
+	if (seq->count >= DISEQC_MAX_STEPS) {
+		printf("Too many steps in the DiSEqC sequence\n");
+		return NULL;
+	}
+
+	struct diseqc_step *step = &seq->steps[seq->count++];
+	memset(step, 0, sizeof(struct diseqc_step));
+	step->type = type;
+	step->value = value;
+
+	return step;
+}
+
+int diseqc_seq_voltage(struct diseqc_seq *seq, fe_sec_voltage_t v) {
+
+	return (diseqc_seq_add(seq, diseqc_step_voltage, v) ? 0 : -1);
+}
+
+int diseqc_seq_tone(struct diseqc_seq *seq, fe_sec_tone_mode_t t) {
+
+	return (diseqc_seq_add(seq, diseqc_step_tone, t) ? 0 : -1);
+}
+
+int diseqc_seq_burst(struct diseqc_seq *seq, fe_sec_mini_cmd_t b) {
+
+	return (diseqc_seq_add(seq, diseqc_step_burst, b) ? 0 : -1);
+}
+
+int diseqc_seq_msg(struct diseqc_seq *seq, unsigned char *msg, unsigned int len, unsigned int repeat) {
+
+	if (len < 3 || len > DISEQC_MAX_MSG) {
+		printf("Invalid DiSEqC message length %u\n", len);
+		return -1;
+	}
+
+	struct diseqc_step *step = diseqc_seq_add(seq, diseqc_step_msg, 0);
+	if (!step)
+		return -1;
+
+	memcpy(step->msg, msg, len);
+	step->len = len;
+	step->repeat = repeat;
+
+	return 0;
+}
+
+int diseqc_seq_wait(struct diseqc_seq *seq, unsigned int ms) {
+
+	return (diseqc_seq_add(seq, diseqc_step_wait, ms) ? 0 : -1);
+}
+
+int diseqc_seq_run(int frontend_fd, struct diseqc_seq *seq) {
+
+	// Messages need the bus quiet for a while after a voltage or tone change,
+	// and everything needs it quiet for a while after a message
+	uint64_t last = 0;
+	unsigned int settle_msg = 0, settle_all = 0;
+
+	unsigned int i;
+	for (i = 0; i < seq->count; i++) {
+		struct diseqc_step *step = &seq->steps[i];
+
+		switch (step->type) {
+			case diseqc_step_voltage:
+			case diseqc_step_tone:
+				diseqc_settle(last, settle_all);
+				if (step->type == diseqc_step_voltage) {
+					if (frontend_set_voltage(frontend_fd, step->value))
+						return -1;
+				} else if (frontend_set_tone(frontend_fd, step->value)) {
+					return -1;
+				}
+				last = diseqc_now();
+				settle_msg = DISEQC_SETTLE;
+				settle_all = 0;
+				break;
+
+			case diseqc_step_burst:
+				diseqc_settle(last, settle_msg);
+				if (frontend_send_burst(frontend_fd, step->value))
+					return -1;
+				last = diseqc_now();
+				settle_msg = settle_all = DISEQC_SETTLE;
+				break;
+
+			case diseqc_step_msg: {
+				diseqc_settle(last, settle_msg);
+				if (frontend_send_diseqc(frontend_fd, step->msg, step->len))
+					return -1;
+
+				// Repeats let devices further down a cascade catch the message
+				unsigned char msg[DISEQC_MAX_MSG];
+				memcpy(msg, step->msg, step->len);
+				if (msg[0] == DISEQC_FRAMING)
+					msg[0] = DISEQC_FRAMING_REPEAT;
+
+				unsigned int j;
+				for (j = 0; j < step->repeat; j++) {
+					diseqc_wait(DISEQC_REPEAT_GAP);
+					if (frontend_send_diseqc(frontend_fd, msg, step->len))
+						return -1;
+				}
+				last = diseqc_now();
+				settle_msg = settle_all = DISEQC_SETTLE;
+				break;
+			}
+
+			case diseqc_step_wait:
+				diseqc_wait(step->value);
+				break;
+		}
+	}
+
+	return 0;
+}
+
+unsigned int diseqc_committed(unsigned char *msg, unsigned int port, int polarity, unsigned int hiband) {
+
+	if (port < 1 || port > 4)
+		return 0;
+
+	// Option and position select the port, horizontal and high band set their bit
+	msg[0] = DISEQC_FRAMING;
+	msg[1] = DISEQC_ADDR_SWITCH;
+	msg[2] = 0x38;
+	msg[3] = 0xf0 | ((port - 1) << 2) | ((polarity ? 0 : 1) << 1) | (hiband ? 1 : 0);
+
+	return 4;
+}
+
+unsigned int diseqc_uncommitted(unsigned char *msg, unsigned int port) {
+
+	if (port < 1 || port > 16)
+		return 0;
+
+	msg[0] = DISEQC_FRAMING;
+	msg[1] = DISEQC_ADDR_SWITCH;
+	msg[2] = 0x39;
+	msg[3] = 0xf0 | (port - 1);
+
+	return 4;
+}
+
+unsigned int diseqc_rotor(unsigned char *msg, enum diseqc_rotor_cmd cmd, unsigned int arg) {
+
+	msg[0] = DISEQC_FRAMING;
+	msg[1] = DISEQC_ADDR_POSITIONER;
+	msg[2] = cmd;
+
+	switch (cmd) {
+		case diseqc_rotor_stop:
+		case diseqc_rotor_limits_off:
+		case diseqc_rotor_limit_east:
+		case diseqc_rotor_limit_west:
+			return 3;
+		case diseqc_rotor_drive_east:
+		case diseqc_rotor_drive_west:
+		case diseqc_rotor_store:
+		case diseqc_rotor_goto:
+			msg[3] = arg & 0xff;
+			return 4;
+		case diseqc_rotor_goto_x:
+			msg[3] = (arg >> 8) & 0xff;
+			msg[4] = arg & 0xff;
+			return 5;
+	}
+
+	return 0;
+}
+
+int diseqc_switch(int frontend_fd, unsigned int port, int polarity, unsigned int hiband, unsigned int repeat) {
+
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len = diseqc_committed(msg, port, polarity, hiband);
+	if (!len) {
+		printf("Invalid DiSEqC switch port %u\n", port);
+		return -1;
+	}
+
+	// The tone must be off while talking, the switch then passes it through to the LNB
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	diseqc_seq_voltage(&seq, (polarity ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18));
+	diseqc_seq_msg(&seq, msg, len, repeat);
+	diseqc_seq_tone(&seq, (hiband ? SEC_TONE_ON : SEC_TONE_OFF));
+
+	return diseqc_seq_run(frontend_fd, &seq);
+}
+
+int diseqc_send(int frontend_fd, unsigned char *msg, unsigned int len, unsigned int repeat) {
+
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	if (diseqc_seq_msg(&seq, msg, len, repeat))
+		return -1;
+
+	return diseqc_seq_run(frontend_fd, &seq);
+}
@@ -0,0 +1,90 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __DISEQC_H__
+#define __DISEQC_H__
+
+#include <linux/dvb/frontend.h>
+
+#define DISEQC_MAX_MSG		6	// Framing, address, command and up to 3 data bytes
+#define DISEQC_MAX_STEPS	16	// Maximum number of steps in a sequence
+#define DISEQC_SETTLE		15	// Quiet time on the bus around a message or after a voltage change in ms
+#define DISEQC_REPEAT_GAP	100	// Time to wait before repeating a message in ms
+
+// Framing bytes
+#define DISEQC_FRAMING		0xe0	// Command from master, no reply required, first transmission
+#define DISEQC_FRAMING_REPEAT	0xe1	// Same thing, repeated transmission
+
+// Address bytes
+#define DISEQC_ADDR_ANY		0x00
+#define DISEQC_ADDR_SWITCH	0x10
+#define DISEQC_ADDR_POSITIONER	0x31
+
+enum diseqc_step_type {
+	diseqc_step_voltage,
+	diseqc_step_tone,
+	diseqc_step_burst,
+	diseqc_step_msg,
+	diseqc_step_wait,
+};
+
+enum diseqc_rotor_cmd {
+	diseqc_rotor_stop = 0x60,
+	diseqc_rotor_limits_off = 0x63,
+	diseqc_rotor_limit_east = 0x66,
+	diseqc_rotor_limit_west = 0x67,
+	diseqc_rotor_drive_east = 0x68,
+	diseqc_rotor_drive_west = 0x69,
+	diseqc_rotor_store = 0x6a,
+	diseqc_rotor_goto = 0x6b,
+	diseqc_rotor_goto_x = 0x6e,
+};
+
+struct diseqc_step {
+	enum diseqc_step_type type;
+	unsigned int value; // Voltage, tone, burst or time to wait in ms
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len;
+	unsigned int repeat; // Number of times the message is sent again
+};
+
+struct diseqc_seq {
+	struct diseqc_step steps[DISEQC_MAX_STEPS];
+	unsigned int count;
+};
+
+void diseqc_seq_init(struct diseqc_seq *seq);
+int diseqc_seq_voltage(struct diseqc_seq *seq, fe_sec_voltage_t v);
+int diseqc_seq_tone(struct diseqc_seq *seq, fe_sec_tone_mode_t t);
+int diseqc_seq_burst(struct diseqc_seq *seq, fe_sec_mini_cmd_t b);
+int diseqc_seq_msg(struct diseqc_seq *seq, unsigned char *msg, unsigned int len, unsigned int repeat);
+int diseqc_seq_wait(struct diseqc_seq *seq, unsigned int ms);
+int diseqc_seq_run(int frontend_fd, struct diseqc_seq *seq);
+
+void diseqc_wait(unsigned int ms);
+unsigned int diseqc_committed(unsigned char *msg, unsigned int port, int polarity, unsigned int hiband);
+unsigned int diseqc_uncommitted(unsigned char *msg, unsigned int port);
+unsigned int diseqc_rotor(unsigned char *msg, enum diseqc_rotor_cmd cmd, unsigned int arg);
+int diseqc_switch(int frontend_fd, unsigned int port, int polarity, unsigned int hiband, unsigned int repeat);
+int diseqc_send(int frontend_fd, unsigned char *msg, unsigned int len, unsigned int repeat);
+
+#endif
@@ -31,23 +31,34 @@
 #include <errno.h>
 #include <linux/dvb/dmx.h>
 #include <signal.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
 
 
+#include "capture.h"
 #include "frontend.h"
 #include "lnb.h"
+#include "pipeline.h"
 #include "config.h"
 
 
 #define PID_FULL_TS "8192"
-#define MPEG_TS_LEN 188
+#define MPEG_TS_LEN CAPTURE_TS_LEN
+#define DVB2PCAP_UDP_PKTS 7 // TS packets in each UDP datagram, the usual 1316 bytes
+#define DVB2PCAP_MARKER_PID 0x1FFF // Filter changes are recorded as null packets, which every demuxer ignores
+#define DVB2PCAP_MARKER "DVB2PCAP PIDS " // Start of the marker payload, followed by the new PID list
+#define DVB2PCAP_MAX_CONTROL 65536 // Maximum size of the control file
 
 #ifndef DLT_MPEG_2_TS
 #define DLT_MPEG_2_TS DLT_USER0
 #endif
 
 static int run = 0;
+static volatile sig_atomic_t reload = 0;
 
 void print_usage(char *app) {
 	
@@ -62,6 +73,7 @@ void print_usage(char *app) {
 		" -f, --frequency=X                               Frequency to tune to in Hz\n"
 		" -s, --symbol-rate=X                             Symbol rate in Sym/s\n"
 		" -p, --polarity=[h,v]                            Polarity (DVB-S only, default: h)\n"
+		" -l, --lnb=X                                     LNB type or LO in Mhz as LO or LOW,HIGH,SWITCH (DVB-S only, default: universal)\n"
 		" -m, --modulation=[auto,16,32,64,128,256]        QAM modulation to use (DVB-C and T only, default: 256)\n"
 		" -b, --bandwidth=[auto,6,7,8]                    Bandwidth in mHz (DVB-T only, default: 8)\n"
 		" -t, --transmission-mode=[auto,2,8]              Transmission mode (DVB-T only, default: 8)\n"
@@ -69,14 +81,199 @@ void print_usage(char *app) {
 		" -g, --guard-interval=[auto,4,8,16,32]           Guard interval 1_X (DVB-T only, default: auto)\n"
 		" -o, --output=X                                  Output file (default: dvb.cap)\n"
 		" -P, --pid=X<,Y,.>                               Capture specific PIDs (default: all)\n"
+		" -C, --control=X                                 Capture the PIDs listed in file X and reload it on SIGUSR1\n"
+		" -U, --udp=HOST:PORT                             Also send the stream over UDP\n"
+		" -S, --stats                                     Also count the packets and continuity errors of each PID\n"
+		" -Y, --policy=NAME:<drop|block><,...>            What pcap, udp or stats does when it can't keep up\n"
+		"                                                 (default: pcap:block,udp:drop,stats:drop)\n"
 		,app);
 
 }
 
 void sighandler(int signal) {
+	if (signal == SIGUSR1) {
+		reload = 1;
+		return;
+	}
 	run = 0;
 }
 
+static char *dvb2pcap_load_pids(char *filename) {
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		perror("Error while opening the control file");
+		return NULL;
+	}
+
+	char *pids = malloc(DVB2PCAP_MAX_CONTROL + 1);
+	if (!pids) {
+		perror("Not enough memory");
+		fclose(f);
+		return NULL;
+	}
+
+	size_t len = fread(pids, 1, DVB2PCAP_MAX_CONTROL, f);
+	pids[len] = 0;
+	fclose(f);
+
+	return pids;
+}
+
+static void dvb2pcap_mark(struct pipeline *pipe, struct capture *cap) {
+
+	// Text of the marker, split over as many packets as needed
+	char text[sizeof(DVB2PCAP_MARKER) + CAPTURE_PID_ALL * 6];
+	size_t len = snprintf(text, sizeof(text), DVB2PCAP_MARKER);
+	len += capture_pid_list(cap, text + len, sizeof(text) - len - 1);
+	text[len++] = '\n';
+
+	printf("\rCapturing PIDs %.*s", (int) (len - sizeof(DVB2PCAP_MARKER) + 1), text + sizeof(DVB2PCAP_MARKER) - 1);
+
+	// Sent down the pipeline like the stream so it lands at the right place
+	static unsigned char cc = 0;
+	struct pipeline_buffer *buff = NULL;
+	size_t pos;
+	for (pos = 0; pos < len;) {
+		if (!buff) {
+			buff = pipeline_get(pipe);
+			gettimeofday(&buff->ts, NULL);
+		}
+
+		pos += capture_text_packet(buff->data + buff->len, DVB2PCAP_MARKER_PID, cc++, text + pos, len - pos);
+		buff->len += MPEG_TS_LEN;
+
+		if (buff->len >= sizeof(buff->data)) {
+			pipeline_push(pipe, buff);
+			buff = NULL;
+		}
+	}
+
+	if (buff)
+		pipeline_push(pipe, buff);
+}
+
+static int dvb2pcap_write_pcap(struct pipeline_buffer *buff, void *priv) {
+
+	pcap_dumper_t *pcap_dumper = priv;
+
+	struct pcap_pkthdr phdr = {0};
+	phdr.ts = buff->ts;
+	phdr.caplen = MPEG_TS_LEN;
+	phdr.len = MPEG_TS_LEN;
+
+	size_t pos;
+	for (pos = 0; pos < buff->len; pos += MPEG_TS_LEN)
+		pcap_dump((u_char*)pcap_dumper, &phdr, buff->data + pos);
+
+	return 0;
+}
+
+static int dvb2pcap_udp_open(char *dest) {
+
+	char *host = strdup(dest);
+	if (!host) {
+		perror("Not enough memory");
+		return -1;
+	}
+
+	char *port = strrchr(host, ':');
+	if (!port) {
+		printf("Invalid UDP destination \"%s\"\n", dest);
+		free(host);
+		return -1;
+	}
+	*port++ = 0;
+
+	struct addrinfo hints = {0}, *res = NULL;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	int err = getaddrinfo(host, port, &hints, &res);
+	free(host);
+	if (err) {
+		printf("Error while resolving \"%s\" : %s\n", dest, gai_strerror(err));
+		return -1;
+	}
+
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd == -1) {
+		perror("Error while creating the UDP socket");
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	if (connect(fd, res->ai_addr, res->ai_addrlen)) {
+		perror("Error while connecting the UDP socket");
+		close(fd);
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	freeaddrinfo(res);
+
+	return fd;
+}
+
+static int dvb2pcap_send_udp(struct pipeline_buffer *buff, void *priv) {
+
+	int fd = *(int *) priv;
+
+	size_t pos;
+	for (pos = 0; pos < buff->len; pos += MPEG_TS_LEN * DVB2PCAP_UDP_PKTS) {
+		size_t len = buff->len - pos;
+		if (len > MPEG_TS_LEN * DVB2PCAP_UDP_PKTS)
+			len = MPEG_TS_LEN * DVB2PCAP_UDP_PKTS;
+		if (send(fd, buff->data + pos, len, 0) != (ssize_t) len)
+			return -1;
+	}
+
+	return 0;
+}
+
+struct dvb2pcap_stats {
+	unsigned long packets[CAPTURE_PID_ALL];
+	unsigned long cc_errors[CAPTURE_PID_ALL];
+	unsigned char cc[CAPTURE_PID_ALL];
+	unsigned char cc_valid[CAPTURE_PID_ALL];
+	unsigned long seq; // Of the next buffer expected
+};
+
+static int dvb2pcap_count(struct pipeline_buffer *buff, void *priv) {
+
+	struct dvb2pcap_stats *stats = priv;
+
+	// Buffers dropped before reaching us aren't errors in the stream
+	if (buff->seq != stats->seq)
+		memset(stats->cc_valid, 0, sizeof(stats->cc_valid));
+	stats->seq = buff->seq + 1;
+
+	size_t pos;
+	for (pos = 0; pos < buff->len; pos += MPEG_TS_LEN) {
+		unsigned char *pkt = buff->data + pos;
+		uint16_t pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+		unsigned char cc = pkt[3] & 0xf;
+
+		// The counter only moves on packets with a payload, a repeat is allowed once
+		if (stats->cc_valid[pid] && pid != 0x1FFF && (pkt[3] & 0x10) && cc != stats->cc[pid] && cc != ((stats->cc[pid] + 1) & 0xf))
+			stats->cc_errors[pid]++;
+
+		stats->cc[pid] = cc;
+		stats->cc_valid[pid] = 1;
+		stats->packets[pid]++;
+	}
+
+	return 0;
+}
+
+static void dvb2pcap_print_stats(struct dvb2pcap_stats *stats) {
+
+	uint16_t pid;
+	for (pid = 0; pid < CAPTURE_PID_ALL; pid++) {
+		if (stats->packets[pid])
+			printf("PID %4hu : %lu packets, %lu continuity errors\n", pid, stats->packets[pid], stats->cc_errors[pid]);
+	}
+}
+
 int main(int argc, char *argv[]) {
 
 	printf("%s : Copyright " PACKAGE_BUGREPORT "\n\n", argv[0]);
@@ -96,12 +293,21 @@ int main(int argc, char *argv[]) {
 	unsigned long int pkt_count = 0;
 
 	char polarity = 'h';
+	enum lnb_type lnb = lnb_type_universal;
 	char *output = "dvb.cap";
 
 	unsigned int verbose = 0;
 
 
 	char *pids = PID_FULL_TS;
+	int pids_set = 0;
+	char *control = NULL;
+	char *control_pids = NULL;
+	char *udp = NULL;
+	int stats = 0;
+	enum pipeline_policy pcap_policy = pipeline_policy_block;
+	enum pipeline_policy udp_policy = pipeline_policy_drop;
+	enum pipeline_policy stats_policy = pipeline_policy_drop;
 
 	while (1) {
 		static struct option long_options[] = {
@@ -120,9 +326,15 @@ int main(int argc, char *argv[]) {
 			{ "guard-interval", 1, 0, 'g' },
 			{ "output", 1, 0, 'o' },
 			{ "pid", 1, 0, 'P' },
+			{ "lnb", 1, 0, 'l' },
+			{ "control", 1, 0, 'C' },
+			{ "udp", 1, 0, 'U' },
+			{ "stats", 0, 0, 'S' },
+			{ "policy", 1, 0, 'Y' },
+			{ 0, 0, 0, 0 },
 		};
 
-		char *args = "hA:F:D:T:f:s:p:m:b:t:c:g:o:P:";
+		char *args = "hA:F:D:T:f:s:p:l:m:b:t:c:g:o:P:C:U:SY:";
 
 		int c = getopt_long(argc, argv, args, long_options, NULL);
 
@@ -280,12 +492,55 @@ int main(int argc, char *argv[]) {
 					return 1;
 				}
 				break;
+			case 'l':
+				if (lnb_get_type(optarg, &lnb)) {
+					printf("Invalid LNB \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
 			case 'o':
 				output = optarg;
 				break;
 			case 'P':
 				pids = optarg;
+				pids_set = 1;
+				break;
+			case 'C':
+				control = optarg;
+				break;
+			case 'U':
+				udp = optarg;
+				break;
+			case 'S':
+				stats = 1;
 				break;
+			case 'Y': {
+				char *str, *token, *saveptr = NULL;
+				for (str = optarg; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+					char *policy = strchr(token, ':');
+					enum pipeline_policy *target = NULL;
+					if (policy) {
+						*policy++ = 0;
+						if (!strcmp(token, "pcap"))
+							target = &pcap_policy;
+						else if (!strcmp(token, "udp"))
+							target = &udp_policy;
+						else if (!strcmp(token, "stats"))
+							target = &stats_policy;
+					}
+					if (target && !strcmp(policy, "drop")) {
+						*target = pipeline_policy_drop;
+					} else if (target && !strcmp(policy, "block")) {
+						*target = pipeline_policy_block;
+					} else {
+						printf("Invalid policy \"%s\"\n", token);
+						print_usage(argv[0]);
+						return 1;
+					}
+				}
+				break;
+			}
 
 			default:
 				print_usage(argv[0]);
@@ -310,7 +565,7 @@ int main(int argc, char *argv[]) {
 		case FE_QPSK: {
 			printf("Tuning to %u MHz, %u MSym/s, %c Polarity ...\n", frequency / 1000, symbol_rate / 1000, polarity);
 			unsigned int ifreq = 0, hiband = 0;
-			if (lnb_get_parameters(lnb_type_univeral, frequency, &ifreq, &hiband)) {	
+			if (lnb_get_parameters(lnb, frequency, &ifreq, &hiband)) {	
 				printf("Error while getting LNB parameters");
 				return 1;
 			}
@@ -361,71 +616,19 @@ int main(int argc, char *argv[]) {
 	printf("Lock aquired\n");
 
 
-	// Open the demux
-	
-	char demux_str[NAME_MAX];
-	snprintf(demux_str, NAME_MAX - 1, "/dev/dvb/adapter%u/demux%u", adapter, frontend);
-
-
-
-	// Setup the demux
-
-	// Parse the PIDS
-	int demux_fd_count = 0;
-	int *demux_fd = NULL;
-	char *my_pids = strdup(pids);
-	char *str, *token, *saveptr = NULL;
-	
-	for (str = my_pids; ; str = NULL) {
-
-		demux_fd = realloc(demux_fd, sizeof(int) * (demux_fd_count + 1));
-		if (!demux_fd) {
-			perror("Not enough memory");
-			return 1;
-		}
-
-
-		demux_fd[demux_fd_count] = open(demux_str, O_RDWR);
-		if (demux_fd[demux_fd_count] == -1) {
-			perror("Error while opening the demux");
-			return 1;
-		}
-		
-		token = strtok_r(str, ",", &saveptr);
-		if (!token)
-			break;
-		uint16_t pid;
-		if (sscanf(token, "%hu", &pid) != 1) {
-			printf("Unparseable PID : \"%s\"\n", token);
-			return 1;
-		}
-
-		struct dmx_pes_filter_params filter = {0};
-		filter.pid = pid;
-		filter.input = DMX_IN_FRONTEND;
-		filter.output = DMX_OUT_TS_TAP;
-		filter.pes_type = DMX_PES_OTHER;
-		filter.flags = DMX_IMMEDIATE_START;
-
-		if (ioctl(demux_fd[demux_fd_count],  DMX_SET_PES_FILTER, &filter) != 0) {
-			perror("Error while setting demux filter");
+	// The control file gives the initial PIDs unless they were given explicitly
+	if (control && !pids_set) {
+		control_pids = dvb2pcap_load_pids(control);
+		if (!control_pids)
 			return 1;
-		}
+		pids = control_pids;
 	}
 
-	free(my_pids);
-
-
-	// Open the DVR
-	
-	char dvr_str[NAME_MAX];
-	snprintf(dvr_str, NAME_MAX - 1, "/dev/dvb/adapter%u/dvr0", adapter);
-
-	int dvr_fd = open(dvr_str, O_RDONLY);
-	if (dvr_fd == -1) {
-		perror("Error while opening the dvr device");
+	// Setup the demux and open the DVR
+	struct capture cap;
+	if (capture_open(&cap, adapter, demux, pids))
 		return 1;
-	}
+	free(control_pids);
 
 
 	// Open pcap
@@ -445,66 +648,106 @@ int main(int argc, char *argv[]) {
 	}
 
 
-	// Read packets and save them
+	// One reader feeding every consumer
+	struct pipeline pipe;
+	pipeline_init(&pipe);
+	pipeline_add(&pipe, "pcap", pcap_policy, dvb2pcap_write_pcap, pcap_dumper);
+
+	int udp_fd = -1;
+	if (udp) {
+		udp_fd = dvb2pcap_udp_open(udp);
+		if (udp_fd == -1)
+			return 1;
+		pipeline_add(&pipe, "udp", udp_policy, dvb2pcap_send_udp, &udp_fd);
+	}
+
+	static struct dvb2pcap_stats pid_stats;
+	if (stats)
+		pipeline_add(&pipe, "stats", stats_policy, dvb2pcap_count, &pid_stats);
+
+	// The consumer threads inherit the mask, the signals must interrupt
+	// the read in this thread and not land on one of them
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGHUP);
+	sigaddset(&sigs, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
 
-	unsigned char buff[MPEG_TS_LEN];
+	if (pipeline_start(&pipe))
+		return 1;
 
 	run = 1;
 	
 	// Install the signal handlers
 	signal(SIGINT, sighandler);
 	signal(SIGHUP, sighandler);
+	if (control) {
+		// No SA_RESTART, don't wait for the next packet to apply the change
+		struct sigaction sa = {0};
+		sa.sa_handler = sighandler;
+		sigaction(SIGUSR1, &sa, NULL);
+	}
+	pthread_sigmask(SIG_UNBLOCK, &sigs, NULL);
+
+	if (control) {
+		dvb2pcap_mark(&pipe, &cap);
+		printf("Send SIGUSR1 to %u to reload the PIDs from %s\n", getpid(), control);
+	}
 
 	printf("Dumping packets ...\n");
 
 	while (run) {
 
-		ssize_t len = 0, r  = 0;
-		// Fetch a packet
-		do {
-			r = read(dvr_fd, buff + len, MPEG_TS_LEN - len);
-			if (!run)
-				break;
-			if (r < 0) {
-				if (errno = EOVERFLOW) {
-					printf("Buffer overflow, your computer is too slow !!!\n");
-					len = 0;
-					r = 0;
-					continue;
-				}
-			}
-
-			len += r;
-
-		} while (len < MPEG_TS_LEN && run);
-
-		struct pcap_pkthdr phdr = {0};
-		gettimeofday(&phdr.ts, NULL);
-		phdr.caplen = MPEG_TS_LEN;
-		phdr.len = MPEG_TS_LEN;
+		if (reload) {
+			// Filters are swapped under the running DVR, the pcap file stays open
+			reload = 0;
+			char *new_pids = dvb2pcap_load_pids(control);
+			int res = (new_pids ? capture_set_pids(&cap, new_pids) : -1);
+			if (res < 0)
+				printf("\rError while changing the PID filter\n");
+
+			// Some filters may have changed before a failure, record
+			// whatever is captured now
+			if (res > 0 || (res < 0 && new_pids))
+				dvb2pcap_mark(&pipe, &cap);
+			free(new_pids);
+		}
 
-		// Save the packet
-		pcap_dump((u_char*)pcap_dumper, &phdr, buff);
+		// Fetch as many packets as available straight in a shared buffer
+		struct pipeline_buffer *buff = pipeline_get(&pipe);
+		ssize_t len = capture_read(&cap, buff->data, sizeof(buff->data));
+		if (len < 0) {
+			pipeline_push(&pipe, buff);
+			break;
+		}
 
-		pkt_count++;
+		gettimeofday(&buff->ts, NULL);
+		buff->len = len;
+		pipeline_push(&pipe, buff);
 
-		if (!(pkt_count % 1000)) {
+		unsigned long prev = pkt_count;
+		pkt_count += len / MPEG_TS_LEN;
+		if (pkt_count / 1000 != prev / 1000) {
 			printf("\rGot %lu", pkt_count);
 			fflush(stdout);
 		}
 	}
 
+	// Let the consumers finish what's queued
+	pipeline_stop(&pipe);
 
 	pcap_dump_close(pcap_dumper);
 	pcap_close(pcap);
 	printf("\rDumped %lu packets\n", pkt_count);
 
-	close(dvr_fd);
-	int i;
-	for (i = 0; i < demux_fd_count; i++)
-		close(demux_fd[i]);
-	free(demux_fd);
+	pipeline_print_stats(&pipe);
+	if (stats)
+		dvb2pcap_print_stats(&pid_stats);
+	if (udp_fd != -1)
+		close(udp_fd);
+
+	capture_close(&cap);
 	close(frontend_fd);
 
 }
-
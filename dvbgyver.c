@@ -0,0 +1,328 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+
+#include "dvbgyver.h"
+#include "capture.h"
+#include "diseqc.h"
+#include "frontend.h"
+#include "lnb.h"
+#include "positioner.h"
+#include "scan.h"
+#include "usals.h"
+
+struct dvbgyver {
+	int fd;
+	struct dvb_frontend_info info;
+	enum lnb_type lnb;
+	unsigned int timeout; // Tuning timeout in seconds
+	unsigned int port; // DiSEqC switch port, 1 to 4, 0 without switch
+	unsigned int repeat; // Times each DiSEqC message is sent again
+
+
+	// Set by dvbgyver_stop(), possibly from a signal handler
+	volatile sig_atomic_t stop;
+};
+
+struct dvbgyver_capture {
+	struct capture c;
+};
+
+struct dvbgyver_site {
+	struct usals_table table;
+};
+
+int dvbgyver_api_version(void) {
+	return DVBGYVER_API_VERSION;
+}
+
+struct dvbgyver *dvbgyver_open(unsigned int adapter, unsigned int frontend, char *lnb, unsigned int timeout) {
+
+	struct dvbgyver *dg = malloc(sizeof(struct dvbgyver));
+	if (!dg)
+		return NULL;
+	memset(dg, 0, sizeof(struct dvbgyver));
+	dg->timeout = (timeout ? timeout : 3);
+
+	if (lnb_get_type(lnb, &dg->lnb)) {
+		free(dg);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	char frontend_str[NAME_MAX];
+	snprintf(frontend_str, NAME_MAX - 1, "/dev/dvb/adapter%u/frontend%u", adapter, frontend);
+	dg->fd = frontend_open(frontend_str, &dg->info);
+	if (dg->fd == -1) {
+		free(dg);
+		return NULL;
+	}
+
+	// Only satellite for now, the LNB is part of the handle
+	if (dg->info.type != FE_QPSK) {
+		frontend_close(dg->fd);
+		free(dg);
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	return dg;
+}
+
+int dvbgyver_set_switch(struct dvbgyver *dg, unsigned int port, unsigned int repeat) {
+
+	if (port > 4) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	dg->port = port;
+	dg->repeat = repeat;
+
+	return 0;
+}
+
+int dvbgyver_tune(struct dvbgyver *dg, unsigned int freq, int polarity, unsigned int symbol_rate) {
+
+	unsigned int ifreq, hiband;
+	if (lnb_get_parameters(dg->lnb, freq, &ifreq, &hiband))
+		return -1;
+
+	if (dg->port) {
+		// The switch command carries the polarity and the band as well
+		if (diseqc_switch(dg->fd, dg->port, polarity, hiband, dg->repeat))
+			return -1;
+	} else {
+		// 13V is vertical polarity and 18V is horizontal
+		if (frontend_set_voltage(dg->fd, (polarity ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18)) || frontend_set_tone(dg->fd, (hiband ? SEC_TONE_ON : SEC_TONE_OFF)))
+			return -1;
+	}
+
+	if (frontend_tune_dvb_s(dg->fd, ifreq, symbol_rate))
+		return -1;
+
+	fe_status_t status;
+	if (frontend_get_status(dg->fd, dg->timeout, &status))
+		return -1;
+
+	return !!(status & FE_HAS_LOCK);
+}
+
+int dvbgyver_signal(struct dvbgyver *dg, unsigned int *strength, unsigned int *snr) {
+
+	return frontend_get_signal(dg->fd, strength, snr);
+}
+
+int dvbgyver_scan(struct dvbgyver *dg, unsigned int start, unsigned int end, unsigned int *symbol_rates, unsigned int rate_count, dvbgyver_found_cb found, void *priv) {
+
+	unsigned int limit_start, limit_end;
+	if (!rate_count || rate_count > SCAN_MAX_RATES || lnb_get_limits(dg->lnb, &limit_start, &limit_end))
+		return -1;
+
+	struct scan_params params = {0};
+	params.type = FE_QPSK;
+	params.lnb = dg->lnb;
+	params.mode = scan_mode_adaptive;
+	params.timeout = dg->timeout;
+	params.start_freq = (start < limit_start ? limit_start : start);
+	params.end_freq = (!end || end > limit_end ? limit_end : end);
+	params.step = (dg->info.frequency_stepsize < 1000 ? 1000 : dg->info.frequency_stepsize);
+	memcpy(params.symbol_rates, symbol_rates, sizeof(unsigned int) * rate_count);
+	params.rate_count = rate_count;
+	params.dvb_s2 = !!(dg->info.caps & FE_CAN_2G_MODULATION);
+	params.quiet = 1;
+	params.stop = &dg->stop;
+	params.switch_port = dg->port;
+	params.switch_repeat = dg->repeat;
+
+	if (params.start_freq > params.end_freq)
+		return -1;
+
+	int res = scan(dg->fd, &params);
+
+	unsigned int i;
+	for (i = 0; i < params.result_count && found; i++) {
+		struct scan_result *r = &params.results[i];
+		struct dvbgyver_transponder tp = { r->freq, r->polarity, r->symbol_rate, r->strength, r->snr };
+		found(&tp, priv);
+	}
+	scan_cleanup(&params);
+
+	// A stop ends the scan in progress or the next one, not the ones after
+	dg->stop = 0;
+
+	return (res ? -1 : (int) params.found);
+}
+
+void dvbgyver_stop(struct dvbgyver *dg) {
+
+	dg->stop = 1;
+}
+
+void dvbgyver_close(struct dvbgyver *dg) {
+
+	frontend_close(dg->fd);
+	free(dg);
+}
+
+static int dvbgyver_rotor(struct dvbgyver *dg, enum diseqc_rotor_cmd cmd, unsigned int arg) {
+
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len = diseqc_rotor(msg, cmd, arg);
+
+	// Most rotors are faster at 18V, the next tune sets the voltage back
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	diseqc_seq_voltage(&seq, SEC_VOLTAGE_18);
+	if (diseqc_seq_msg(&seq, msg, len, dg->repeat))
+		return -1;
+
+	return diseqc_seq_run(dg->fd, &seq);
+}
+
+int dvbgyver_rotor_stop(struct dvbgyver *dg) {
+
+	return dvbgyver_rotor(dg, diseqc_rotor_stop, 0);
+}
+
+int dvbgyver_rotor_step(struct dvbgyver *dg, int steps) {
+
+	if (!steps || steps > 0x7F || steps < -0x7F) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Steps are sent as a negative number
+	if (steps > 0)
+		return dvbgyver_rotor(dg, diseqc_rotor_drive_east, 0x100 - steps);
+	return dvbgyver_rotor(dg, diseqc_rotor_drive_west, 0x100 + steps);
+}
+
+int dvbgyver_rotor_store(struct dvbgyver *dg, unsigned int slot) {
+
+	if (slot >= POSITIONER_MAX_SLOTS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return dvbgyver_rotor(dg, diseqc_rotor_store, slot);
+}
+
+int dvbgyver_rotor_goto(struct dvbgyver *dg, unsigned int slot) {
+
+	if (slot >= POSITIONER_MAX_SLOTS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return dvbgyver_rotor(dg, diseqc_rotor_goto, slot);
+}
+
+int dvbgyver_rotor_goto_x(struct dvbgyver *dg, double angle) {
+
+	if (isnan(angle) || fabs(angle) > POSITIONER_MAX_ANGLE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return dvbgyver_rotor(dg, diseqc_rotor_goto_x, usals_goto_x(angle));
+}
+
+struct dvbgyver_capture *dvbgyver_capture_open(unsigned int adapter, unsigned int demux, char *pids) {
+
+	struct dvbgyver_capture *cap = malloc(sizeof(struct dvbgyver_capture));
+	if (!cap)
+		return NULL;
+
+	if (capture_open(&cap->c, adapter, demux, pids)) {
+		free(cap);
+		return NULL;
+	}
+
+	return cap;
+}
+
+int dvbgyver_capture_set_pids(struct dvbgyver_capture *cap, char *pids) {
+
+	return capture_set_pids(&cap->c, pids);
+}
+
+ssize_t dvbgyver_capture_read(struct dvbgyver_capture *cap, unsigned char *buff, size_t size) {
+
+	return capture_read(&cap->c, buff, size);
+}
+
+unsigned long dvbgyver_capture_overflows(struct dvbgyver_capture *cap) {
+
+	return cap->c.overflows;
+}
+
+void dvbgyver_capture_close(struct dvbgyver_capture *cap) {
+
+	capture_close(&cap->c);
+	free(cap);
+}
+
+struct dvbgyver_site *dvbgyver_site_open(double lon, double lat) {
+
+	if (lon < -180.0 || lon > 180.0 || lat < -90.0 || lat > 90.0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct dvbgyver_site *site = malloc(sizeof(struct dvbgyver_site));
+	if (!site)
+		return NULL;
+
+	struct usals_site s;
+	usals_site_init(&s, lon, lat);
+	if (usals_table_init(&site->table, &s, USALS_TABLE_STEP)) {
+		free(site);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return site;
+}
+
+int dvbgyver_site_angle(struct dvbgyver_site *site, double satpos, double *angle) {
+
+	// Below the horizon
+	if (usals_table_angle(&site->table, satpos, angle)) {
+		errno = ERANGE;
+		return -1;
+	}
+
+	return 0;
+}
+
+void dvbgyver_site_close(struct dvbgyver_site *site) {
+
+	usals_table_cleanup(&site->table);
+	free(site);
+}
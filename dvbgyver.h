@@ -0,0 +1,81 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __DVBGYVER_H__
+#define __DVBGYVER_H__
+
+// Public API of libdvbgyver, the only header installed. Programs only
+// see opaque handles for a frontend, a capture or a site, compare
+// dvbgyver_api_version() with DVBGYVER_API_VERSION to make sure the
+// library matches.
+
+#include <sys/types.h>
+
+#define DVBGYVER_API_VERSION	1	// Bumped when the library API changes in an incompatible way
+
+// One opened satellite frontend
+struct dvbgyver;
+
+// Demux filters and DVR of one adapter
+struct dvbgyver_capture;
+
+// Rotor angles of the satellites visible from one place
+struct dvbgyver_site;
+
+struct dvbgyver_transponder {
+	unsigned int freq; // kHz
+	int polarity; // 1 for vertical
+	unsigned int symbol_rate; // Sym/s
+	unsigned int strength, snr;
+};
+
+// Called by dvbgyver_scan() for each transponder found
+typedef void (*dvbgyver_found_cb)(struct dvbgyver_transponder *tp, void *priv);
+
+int dvbgyver_api_version(void);
+
+struct dvbgyver *dvbgyver_open(unsigned int adapter, unsigned int frontend, char *lnb, unsigned int timeout);
+int dvbgyver_set_switch(struct dvbgyver *dg, unsigned int port, unsigned int repeat);
+int dvbgyver_tune(struct dvbgyver *dg, unsigned int freq, int polarity, unsigned int symbol_rate);
+int dvbgyver_signal(struct dvbgyver *dg, unsigned int *strength, unsigned int *snr);
+int dvbgyver_scan(struct dvbgyver *dg, unsigned int start, unsigned int end, unsigned int *symbol_rates, unsigned int rate_count, dvbgyver_found_cb found, void *priv);
+void dvbgyver_stop(struct dvbgyver *dg);
+void dvbgyver_close(struct dvbgyver *dg);
+
+// DiSEqC 1.2 positioner, angles in degrees with east positive
+int dvbgyver_rotor_stop(struct dvbgyver *dg);
+int dvbgyver_rotor_step(struct dvbgyver *dg, int steps);
+int dvbgyver_rotor_store(struct dvbgyver *dg, unsigned int slot);
+int dvbgyver_rotor_goto(struct dvbgyver *dg, unsigned int slot);
+int dvbgyver_rotor_goto_x(struct dvbgyver *dg, double angle);
+
+struct dvbgyver_capture *dvbgyver_capture_open(unsigned int adapter, unsigned int demux, char *pids);
+int dvbgyver_capture_set_pids(struct dvbgyver_capture *cap, char *pids);
+ssize_t dvbgyver_capture_read(struct dvbgyver_capture *cap, unsigned char *buff, size_t size);
+unsigned long dvbgyver_capture_overflows(struct dvbgyver_capture *cap);
+void dvbgyver_capture_close(struct dvbgyver_capture *cap);
+
+struct dvbgyver_site *dvbgyver_site_open(double lon, double lat);
+int dvbgyver_site_angle(struct dvbgyver_site *site, double satpos, double *angle);
+void dvbgyver_site_close(struct dvbgyver_site *site);
+
+#endif
@@ -0,0 +1,996 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#define _GNU_SOURCE // struct ucred
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "capture.h"
+#include "diseqc.h"
+#include "frontend.h"
+#include "lnb.h"
+#include "positioner.h"
+#include "scan.h"
+#include "usals.h"
+#include "utils.h"
+#include "config.h"
+
+#define DVBGYVERD_MAX_FRONTENDS	16	// Maximum number of frontends held open
+#define DVBGYVERD_SOCKET	"/var/run/dvbgyverd.sock"	// Default command socket
+#define DVBGYVERD_MAX_LINE	1024	// Maximum length of a command
+#define DVBGYVERD_MAX_ARGS	8	// Maximum number of words in a command
+#define DVBGYVERD_POLL		500	// Interval at which blocking loops check for shutdown in ms
+#define DVBGYVERD_READ_PKTS	64	// Number of TS packets read at once when capturing
+#define DVBGYVERD_MAX_GROUPS	256	// Maximum number of groups of a client checked against the socket group
+
+// Protocol : one command per line, words separated by spaces. Each command
+// gets zero or more data lines followed by a single "ok ..." or "error ..." line.
+//
+//  list
+//  tune <fe> <freq Mhz> <h|v> <kSym/s>
+//  status <fe>
+//  scan <fe> <start Mhz> <end Mhz> [kSym/s,...]
+//  capture <fe> <pid,...> <secs> <file name in the output directory>
+//  rotor <fe> <goto_x XX.X<e|w>|goto_sat X|store_sat X|stop>
+//  quit
+
+struct dvbgyverd_frontend {
+	unsigned int adapter, frontend;
+	int fd;
+	struct dvb_frontend_info info;
+
+	// Held for the whole duration of each command
+	pthread_mutex_t lock;
+
+	// Last LNB settings sent, -1 when unknown
+	int voltage, tone;
+
+	// Currently tuned transponder, 0 if none
+	unsigned int freq; // kHz
+	int polarity;
+	unsigned int symbol_rate; // Sym/s
+};
+
+static struct dvbgyverd_frontend frontends[DVBGYVERD_MAX_FRONTENDS];
+static unsigned int frontend_count = 0;
+
+static enum lnb_type lnb = lnb_type_universal;
+static unsigned int tuning_timeout = 3;
+static unsigned int repeat = 0;
+
+// There is only one dish, whatever frontend carries the commands
+static struct positioner rotor;
+static pthread_mutex_t rotor_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *rotor_state = NULL;
+static double rotor_speed = 0.0; // Overrides the calibrated speed when set
+
+// Clients must be root, the user running the daemon or in that group
+static gid_t socket_group = (gid_t) -1;
+
+// Captures are only written there, disabled when not set
+static char *output_dir = NULL;
+
+static volatile sig_atomic_t stopped = 0;
+
+void sighandler(int signal) {
+
+	stopped = 1;
+}
+
+void print_usage(char *app) {
+
+	printf("Usage : %s <options>\n"
+		"\n"
+		"Options are :\n"
+		" -a, --adapter=X<,Y>    Adapters to hold open, default 0\n"
+		" -f, --frontend=X       Frontend to use on each adapter, default 0\n"
+		" -l, --lnb=X            LNB type, see feedhunter\n"
+		" -s, --socket=X         Command socket, default " DVBGYVERD_SOCKET "\n"
+		" -g, --group=X          Group allowed to use the socket, default only root and the daemon user\n"
+		" -o, --output-dir=X     Directory where the captures are written, captures are disabled without it\n"
+		" -t, --timeout=X        Tuning timeout in seconds, default 3\n"
+		" -w, --wait=X           Time to let the LNB and rotor power up at startup in ms, default none\n"
+		" -r, --repeat=X         Repeat the DiSEqC commands X times for cascaded or unreliable devices\n"
+		" -S, --speed=X          Rotor speed in degrees per second, default 1.5\n"
+		" -Q, --rotor-state=X    Keep track of the rotor position in file X\n"
+		" -v, --verbose          Increase verbosity\n"
+		"\n", app);
+}
+
+static void dvbgyverd_reply(FILE *out, const char *format, ...) {
+
+	va_list arg_list;
+	va_start(arg_list, format);
+	vfprintf(out, format, arg_list);
+	va_end(arg_list);
+	fflush(out);
+}
+
+static void dvbgyverd_sleep(double secs) {
+
+	// Sleep in small chunks to notice the shutdown
+	while (secs > 0.0 && !stopped) {
+		double chunk = (secs > DVBGYVERD_POLL / 1000.0 ? DVBGYVERD_POLL / 1000.0 : secs);
+		struct timespec ts = { (time_t) chunk, (long) ((chunk - (time_t) chunk) * 1000000000.0) };
+		while (nanosleep(&ts, &ts) && errno == EINTR && !stopped);
+		secs -= chunk;
+	}
+}
+
+static int dvbgyverd_lnb(struct dvbgyverd_frontend *fe, fe_sec_voltage_t voltage, fe_sec_tone_mode_t tone) {
+
+	// The LNB stays powered between commands, only send what changed
+	if (fe->voltage != (int) voltage) {
+		if (frontend_set_voltage(fe->fd, voltage)) {
+			fe->voltage = -1;
+			return -1;
+		}
+		fe->voltage = voltage;
+	}
+
+	if (fe->tone != (int) tone) {
+		if (frontend_set_tone(fe->fd, tone)) {
+			fe->tone = -1;
+			return -1;
+		}
+		fe->tone = tone;
+	}
+
+	return 0;
+}
+
+static struct dvbgyverd_frontend *dvbgyverd_get_frontend(FILE *out, char *str) {
+
+	unsigned int i;
+	if (!str || sscanf(str, "%u", &i) != 1 || i >= frontend_count) {
+		dvbgyverd_reply(out, "error Invalid frontend\n");
+		return NULL;
+	}
+
+	return &frontends[i];
+}
+
+static void dvbgyverd_list(FILE *out) {
+
+	unsigned int i;
+	for (i = 0; i < frontend_count; i++) {
+		struct dvbgyverd_frontend *fe = &frontends[i];
+		dvbgyverd_reply(out, "frontend %u adapter%u/frontend%u \"%s\"\n", i, fe->adapter, fe->frontend, fe->info.name);
+	}
+	dvbgyverd_reply(out, "ok %u\n", frontend_count);
+}
+
+static int dvbgyverd_tune(FILE *out, struct dvbgyverd_frontend *fe, unsigned int freq, int polarity, unsigned int symbol_rate) {
+
+	fe->freq = 0;
+
+	int res;
+	if (fe->info.type == FE_QPSK) {
+		unsigned int ifreq, hiband;
+		if (lnb_get_parameters(lnb, freq, &ifreq, &hiband)) {
+			dvbgyverd_reply(out, "error Frequency out of the LNB range\n");
+			return -1;
+		}
+
+		// 13V is vertical polarity and 18V is horizontal
+		if (dvbgyverd_lnb(fe, (polarity ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18), (hiband ? SEC_TONE_ON : SEC_TONE_OFF))) {
+			dvbgyverd_reply(out, "error Unable to set the LNB\n");
+			return -1;
+		}
+		res = frontend_tune_dvb_s_auto(fe->fd, ifreq, symbol_rate, !!(fe->info.caps & FE_CAN_2G_MODULATION));
+	} else if (fe->info.type == FE_QAM) {
+		// The API wants Hz for cable and terrestrial
+		res = frontend_tune_dvb_c(fe->fd, freq * 1000, symbol_rate, QAM_AUTO);
+	} else {
+		res = frontend_tune_dvb_t(fe->fd, freq * 1000, QAM_AUTO, BANDWIDTH_AUTO, TRANSMISSION_MODE_AUTO, FEC_AUTO, GUARD_INTERVAL_AUTO);
+	}
+
+	if (res) {
+		dvbgyverd_reply(out, "error Unable to tune\n");
+		return -1;
+	}
+
+	fe_status_t status;
+	if (frontend_get_status(fe->fd, tuning_timeout, &status)) {
+		dvbgyverd_reply(out, "error Unable to read the status\n");
+		return -1;
+	}
+
+	if (!(status & FE_HAS_LOCK)) {
+		dvbgyverd_reply(out, "error No lock\n");
+		return -1;
+	}
+
+	fe->freq = freq;
+	fe->polarity = polarity;
+	fe->symbol_rate = symbol_rate;
+
+	unsigned int strength = 0, snr = 0;
+	frontend_get_signal(fe->fd, &strength, &snr);
+	dvbgyverd_reply(out, "ok lock %u %u\n", strength, snr);
+
+	return 0;
+}
+
+static int dvbgyverd_status(FILE *out, struct dvbgyverd_frontend *fe) {
+
+	fe_status_t status;
+	if (frontend_read_status(fe->fd, &status)) {
+		dvbgyverd_reply(out, "error Unable to read the status\n");
+		return -1;
+	}
+
+	unsigned int strength = 0, snr = 0;
+	frontend_get_signal(fe->fd, &strength, &snr);
+
+	dvbgyverd_reply(out, "ok %s %u %u", ((status & FE_HAS_LOCK) ? "lock" : "nolock"), strength, snr);
+	if (fe->freq)
+		dvbgyverd_reply(out, " %u %c %u", fe->freq / 1000, (fe->polarity ? 'v' : 'h'), fe->symbol_rate / 1000);
+	dvbgyverd_reply(out, "\n");
+
+	return 0;
+}
+
+static int dvbgyverd_scan(FILE *out, struct dvbgyverd_frontend *fe, unsigned int start, unsigned int end, char *rates) {
+
+	struct scan_params params = {0};
+	params.type = fe->info.type;
+	params.lnb = lnb;
+	params.mode = scan_mode_linear;
+	params.timeout = tuning_timeout;
+	params.dvb_s2 = !!(fe->info.caps & FE_CAN_2G_MODULATION);
+	params.qam_auto = (fe->info.type != FE_QPSK && (fe->info.caps & FE_CAN_QAM_AUTO));
+	params.quiet = 1;
+	params.stop = &stopped;
+
+	unsigned int limit_start, limit_end, stepsize;
+	if (fe->info.type == FE_QPSK) {
+		if (lnb_get_limits(lnb, &limit_start, &limit_end)) {
+			dvbgyverd_reply(out, "error Unable to get the LNB limits\n");
+			return -1;
+		}
+		stepsize = fe->info.frequency_stepsize;
+		params.symbol_rates[0] = 27500000;
+	} else {
+		// Cable and terrestrial frontends use Hz
+		limit_start = fe->info.frequency_min / 1000;
+		limit_end = fe->info.frequency_max / 1000;
+		stepsize = fe->info.frequency_stepsize / 1000;
+		params.symbol_rates[0] = 6900000;
+	}
+	params.rate_count = 1;
+
+	if (rates) {
+		char *str, *token, *saveptr = NULL;
+		params.rate_count = 0;
+		for (str = rates; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+			if (params.rate_count >= SCAN_MAX_RATES || sscanf(token, "%u", &params.symbol_rates[params.rate_count]) != 1 || !params.symbol_rates[params.rate_count]) {
+				dvbgyverd_reply(out, "error Invalid symbol rate\n");
+				return -1;
+			}
+			params.symbol_rates[params.rate_count++] *= 1000; // Switch to Sym/s
+		}
+	}
+
+	params.start_freq = (start < limit_start ? limit_start : start);
+	params.end_freq = (!end || end > limit_end ? limit_end : end);
+	params.step = (stepsize < 1000 ? 1000 : stepsize);
+	if (params.start_freq > params.end_freq) {
+		dvbgyverd_reply(out, "error Invalid frequency range\n");
+		return -1;
+	}
+
+	fe->freq = 0;
+	int res = scan(fe->fd, &params);
+
+	// The scan drives the LNB by itself
+	fe->voltage = -1;
+	fe->tone = -1;
+
+	unsigned int i;
+	for (i = 0; i < params.result_count; i++) {
+		struct scan_result *r = &params.results[i];
+		dvbgyverd_reply(out, "result %u %c %u %u %u\n", r->freq / 1000, (r->polarity ? 'v' : 'h'), r->symbol_rate / 1000, r->strength, r->snr);
+	}
+
+	if (res)
+		dvbgyverd_reply(out, "error Scan failed\n");
+	else
+		dvbgyverd_reply(out, "ok %u %u\n", params.found, params.attempts);
+
+	scan_cleanup(&params);
+
+	return res;
+}
+
+static int dvbgyverd_capture(FILE *out, struct dvbgyverd_frontend *fe, char *pids, unsigned int duration, char *filename) {
+
+	if (!fe->freq) {
+		dvbgyverd_reply(out, "error Not tuned\n");
+		return -1;
+	}
+
+	// The daemon may write where the clients can't, only take plain names
+	if (!output_dir) {
+		dvbgyverd_reply(out, "error Captures are disabled\n");
+		return -1;
+	}
+	if (!filename[0] || filename[0] == '.' || strchr(filename, '/')) {
+		dvbgyverd_reply(out, "error Invalid file name\n");
+		return -1;
+	}
+
+	char path[PATH_MAX];
+	int path_len = snprintf(path, sizeof(path), "%s/%s", output_dir, filename);
+	if (path_len < 0 || (size_t) path_len >= sizeof(path)) {
+		dvbgyverd_reply(out, "error Invalid file name\n");
+		return -1;
+	}
+	int ts_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+	FILE *ts = (ts_fd != -1 ? fdopen(ts_fd, "w") : NULL);
+	if (!ts) {
+		dvbgyverd_reply(out, "error Unable to open %s : %s\n", filename, strerror(errno));
+		if (ts_fd != -1)
+			close(ts_fd);
+		return -1;
+	}
+
+	struct capture cap;
+	if (capture_open(&cap, fe->adapter, fe->frontend, pids)) {
+		fclose(ts);
+		dvbgyverd_reply(out, "error Unable to open the demux\n");
+		return -1;
+	}
+
+	unsigned char buff[CAPTURE_TS_LEN * DVBGYVERD_READ_PKTS];
+	unsigned long packets = 0;
+	int res = 0;
+	time_t end = time(NULL) + duration;
+
+	while (!stopped && time(NULL) < end) {
+
+		struct pollfd pfd = { cap.dvr_fd, POLLIN, 0 };
+		int ready = poll(&pfd, 1, DVBGYVERD_POLL);
+		if (ready < 0 && errno != EINTR) {
+			res = -1;
+			break;
+		}
+		if (ready <= 0)
+			continue;
+
+		ssize_t len = capture_read(&cap, buff, sizeof(buff));
+		if (len < 0) {
+			res = -1;
+			break;
+		}
+
+		if (len && fwrite(buff, len, 1, ts) != 1) {
+			res = -1;
+			break;
+		}
+		packets += len / CAPTURE_TS_LEN;
+	}
+
+	unsigned long overflows = cap.overflows;
+	capture_close(&cap);
+	if (fclose(ts))
+		res = -1;
+
+	if (res)
+		dvbgyverd_reply(out, "error Capture failed after %lu packets\n", packets);
+	else
+		dvbgyverd_reply(out, "ok %lu %lu\n", packets, overflows);
+
+	return res;
+}
+
+static void dvbgyverd_dish_lock() {
+
+	// One dish feeds every frontend, wait for all of them to be idle
+	// before moving it. Always in the same order to avoid deadlocks.
+	pthread_mutex_lock(&rotor_lock);
+	unsigned int i;
+	for (i = 0; i < frontend_count; i++)
+		pthread_mutex_lock(&frontends[i].lock);
+}
+
+static void dvbgyverd_dish_unlock() {
+
+	unsigned int i;
+	for (i = frontend_count; i > 0; i--)
+		pthread_mutex_unlock(&frontends[i - 1].lock);
+	pthread_mutex_unlock(&rotor_lock);
+}
+
+static int dvbgyverd_rotor_load() {
+
+	if (!rotor_state)
+		return 0;
+
+	// Other programs may have moved the dish since the last command and
+	// must not move it while we do
+	int lock_fd = positioner_lock(rotor_state);
+	if (lock_fd == -1)
+		return -1;
+
+	positioner_init(&rotor, rotor_speed);
+	if (positioner_load(&rotor, rotor_state)) {
+		positioner_unlock(lock_fd);
+		return -1;
+	}
+	if (rotor_speed > 0.0)
+		rotor.speed = rotor_speed;
+
+	return lock_fd;
+}
+
+static void dvbgyverd_rotor_save(int lock_fd) {
+
+	if (!rotor_state)
+		return;
+
+	positioner_save(&rotor, rotor_state);
+	positioner_unlock(lock_fd);
+}
+
+static int dvbgyverd_rotor(FILE *out, struct dvbgyverd_frontend *fe, char *action, char *arg) {
+
+	if (fe->info.type != FE_QPSK) {
+		dvbgyverd_reply(out, "error Not a satellite frontend\n");
+		return -1;
+	}
+
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len;
+	int goto_slot = -1, store = -1, target_known = 0;
+	double target = 0.0, distance = 0.0;
+	unsigned int pos = 0;
+
+	if (!action) {
+		dvbgyverd_reply(out, "error Missing rotor command\n");
+		return -1;
+	}
+
+	if (!strcmp(action, "goto_x")) {
+		if (!arg || positioner_parse_angle(arg, &target)) {
+			dvbgyverd_reply(out, "error Invalid orientation\n");
+			return -1;
+		}
+		len = diseqc_rotor(msg, diseqc_rotor_goto_x, usals_goto_x(target));
+		target_known = 1;
+	} else if (!strcmp(action, "goto_sat") || !strcmp(action, "store_sat")) {
+		if (!arg || sscanf(arg, "%u", &pos) != 1 || pos >= POSITIONER_MAX_SLOTS) {
+			dvbgyverd_reply(out, "error Invalid position\n");
+			return -1;
+		}
+		if (action[0] == 'g') {
+			len = diseqc_rotor(msg, diseqc_rotor_goto, pos);
+			goto_slot = pos;
+		} else {
+			len = diseqc_rotor(msg, diseqc_rotor_store, pos);
+			store = pos;
+		}
+	} else if (!strcmp(action, "stop")) {
+		len = diseqc_rotor(msg, diseqc_rotor_stop, 0);
+	} else {
+		dvbgyverd_reply(out, "error Invalid rotor command\n");
+		return -1;
+	}
+
+	dvbgyverd_dish_lock();
+
+	int lock_fd = dvbgyverd_rotor_load();
+	if (lock_fd == -1) {
+		dvbgyverd_dish_unlock();
+		dvbgyverd_reply(out, "error Rotor state unavailable or in use\n");
+		return -1;
+	}
+
+	if (goto_slot >= 0) {
+		// Without the angle of the slot, assume it is at the end of the arc
+		target = POSITIONER_MAX_ANGLE;
+		target_known = !positioner_get_slot(&rotor, goto_slot, &target);
+	}
+
+	if ((goto_slot >= 0 && positioner_is_at_slot(&rotor, goto_slot)) || (goto_slot < 0 && target_known && positioner_is_at(&rotor, target))) {
+		if (rotor_state)
+			positioner_unlock(lock_fd);
+		dvbgyverd_dish_unlock();
+		dvbgyverd_reply(out, "ok 0.0\n");
+		return 0;
+	}
+
+	if (goto_slot >= 0 || target_known)
+		distance = positioner_distance(&rotor, target);
+
+	// The positioner is powered like the LNB, keep the current voltage
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	if (fe->voltage < 0)
+		diseqc_seq_voltage(&seq, SEC_VOLTAGE_18);
+	diseqc_seq_msg(&seq, msg, len, repeat);
+
+	if (diseqc_seq_run(fe->fd, &seq)) {
+		fe->voltage = -1;
+		fe->tone = -1;
+		positioner_lost(&rotor);
+		dvbgyverd_rotor_save(lock_fd);
+		dvbgyverd_dish_unlock();
+		dvbgyverd_reply(out, "error Unable to send the DiSEqC command\n");
+		return -1;
+	}
+	if (fe->voltage < 0)
+		fe->voltage = SEC_VOLTAGE_18;
+	fe->tone = SEC_TONE_OFF;
+
+	// No frontend is on its transponder anymore
+	unsigned int i;
+	for (i = 0; i < frontend_count; i++)
+		frontends[i].freq = 0;
+
+	double wait = (distance > 0.0 ? positioner_travel_time(&rotor, distance) : 0.0);
+	dvbgyverd_sleep(wait);
+
+	if (stopped && wait > 0.0) {
+		positioner_lost(&rotor);
+	} else if (goto_slot >= 0) {
+		positioner_moved_slot(&rotor, goto_slot, POSITIONER_CONF_TIMED);
+	} else if (target_known) {
+		positioner_moved(&rotor, target, POSITIONER_CONF_TIMED);
+	} else if (store >= 0) {
+		positioner_store_slot(&rotor, store);
+	} else {
+		// It may have been moving
+		positioner_lost(&rotor);
+	}
+
+	dvbgyverd_rotor_save(lock_fd);
+
+	dvbgyverd_dish_unlock();
+
+	dvbgyverd_reply(out, "ok %.1f\n", wait);
+
+	return 0;
+}
+
+static int dvbgyverd_command(FILE *out, char *line) {
+
+	char *argv[DVBGYVERD_MAX_ARGS] = { NULL };
+	unsigned int argc = 0;
+
+	char *str, *token, *saveptr = NULL;
+	for (str = line; argc < DVBGYVERD_MAX_ARGS && (token = strtok_r(str, " \t\r\n", &saveptr)); str = NULL)
+		argv[argc++] = token;
+
+	if (!argc)
+		return 0;
+
+	dvb_debug("Command : %s\n", argv[0]);
+
+	if (!strcmp(argv[0], "quit"))
+		return 1;
+
+	if (!strcmp(argv[0], "list")) {
+		dvbgyverd_list(out);
+		return 0;
+	}
+
+	int tune = !strcmp(argv[0], "tune"), status = !strcmp(argv[0], "status"), scan = !strcmp(argv[0], "scan");
+	int cap = !strcmp(argv[0], "capture"), rot = !strcmp(argv[0], "rotor");
+	if (!tune && !status && !scan && !cap && !rot) {
+		dvbgyverd_reply(out, "error Unknown command\n");
+		return 0;
+	}
+
+	struct dvbgyverd_frontend *fe = dvbgyverd_get_frontend(out, argv[1]);
+	if (!fe)
+		return 0;
+
+	// Parse everything before waiting for the frontend
+	unsigned int freq = 0, end = 0, symbol_rate = 0, duration = 0;
+	char pol = 0;
+	if (tune && (argc < 5 || sscanf(argv[2], "%u", &freq) != 1 || sscanf(argv[3], "%c", &pol) != 1 || (pol != 'h' && pol != 'v') || sscanf(argv[4], "%u", &symbol_rate) != 1)) {
+		dvbgyverd_reply(out, "error Usage : tune <fe> <freq Mhz> <h|v> <kSym/s>\n");
+		return 0;
+	}
+	if (scan && (argc < 4 || sscanf(argv[2], "%u", &freq) != 1 || sscanf(argv[3], "%u", &end) != 1)) {
+		dvbgyverd_reply(out, "error Usage : scan <fe> <start Mhz> <end Mhz> [kSym/s,...]\n");
+		return 0;
+	}
+	if (cap && (argc < 5 || sscanf(argv[3], "%u", &duration) != 1 || !duration)) {
+		dvbgyverd_reply(out, "error Usage : capture <fe> <pid,...> <secs> <file>\n");
+		return 0;
+	}
+
+	// Moving the dish locks every frontend itself
+	if (rot) {
+		dvbgyverd_rotor(out, fe, argv[2], argv[3]);
+		return 0;
+	}
+
+	// Commands on the same frontend run one after the other
+	pthread_mutex_lock(&fe->lock);
+
+	if (tune)
+		dvbgyverd_tune(out, fe, freq * 1000, (pol == 'v'), symbol_rate * 1000);
+	else if (status)
+		dvbgyverd_status(out, fe);
+	else if (scan)
+		dvbgyverd_scan(out, fe, freq * 1000, end * 1000, argv[4]);
+	else
+		dvbgyverd_capture(out, fe, argv[2], duration, argv[4]);
+
+	pthread_mutex_unlock(&fe->lock);
+
+	return 0;
+}
+
+static void *dvbgyverd_client(void *arg) {
+
+	int fd = (long) arg;
+
+	FILE *in = fdopen(fd, "r");
+	int out_fd = dup(fd);
+	FILE *out = (out_fd != -1 ? fdopen(out_fd, "w") : NULL);
+	if (!in || !out) {
+		perror("Error while opening the client stream");
+		if (in)
+			fclose(in);
+		else
+			close(fd);
+		if (out_fd != -1)
+			close(out_fd);
+		return NULL;
+	}
+
+	dvb_debug("Client connected\n");
+
+	char line[DVBGYVERD_MAX_LINE];
+	while (!stopped && fgets(line, sizeof(line), in)) {
+		if (dvbgyverd_command(out, line))
+			break;
+	}
+
+	dvb_debug("Client disconnected\n");
+
+	fclose(out);
+	fclose(in);
+
+	return NULL;
+}
+
+static int dvbgyverd_allowed(int fd) {
+
+	// The socket permissions already keep others out, this also covers
+	// sockets made reachable by mistake
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)) {
+		perror("Error while getting the client credentials");
+		return 0;
+	}
+
+	if (cred.uid == 0 || cred.uid == geteuid())
+		return 1;
+
+	if (socket_group == (gid_t) -1)
+		goto refused;
+	if (cred.gid == socket_group)
+		return 1;
+
+	struct passwd pw, *found = NULL;
+	char buff[1024];
+	if (getpwuid_r(cred.uid, &pw, buff, sizeof(buff), &found) || !found)
+		goto refused;
+
+	gid_t groups[DVBGYVERD_MAX_GROUPS];
+	int i, count = DVBGYVERD_MAX_GROUPS;
+	if (getgrouplist(pw.pw_name, pw.pw_gid, groups, &count) == -1)
+		goto refused;
+	for (i = 0; i < count; i++) {
+		if (groups[i] == socket_group)
+			return 1;
+	}
+
+refused:
+	printf("Refused client with pid %d and uid %u\n", (int) cred.pid, (unsigned int) cred.uid);
+	return 0;
+}
+
+static int dvbgyverd_listen(char *path) {
+
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("Error while creating the socket");
+		return -1;
+	}
+
+	// Remove the socket left behind by a previous run
+	unlink(path);
+
+	// Created with mode 0660 right away, clients need write access to connect
+	mode_t mask = umask(0117);
+	int res = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+
+	if (res || listen(fd, DVBGYVERD_MAX_FRONTENDS)) {
+		perror("Error while binding the socket");
+		close(fd);
+		return -1;
+	}
+
+	if (socket_group != (gid_t) -1 && chown(path, -1, socket_group)) {
+		perror("Error while setting the socket group");
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+
+	return fd;
+}
+
+int main(int argc, char *argv[]) {
+
+	printf(PACKAGE " : Copyright " PACKAGE_BUGREPORT "\n\n");
+
+	// Parse command line
+	unsigned int adapters[DVBGYVERD_MAX_FRONTENDS] = { 0 };
+	unsigned int adapter_count = 1;
+	unsigned int frontend = 0;
+	char *socket_path = DVBGYVERD_SOCKET;
+	unsigned int power_up = 0;
+	double speed = POSITIONER_SPEED;
+	int speed_set = 0;
+
+	while (1) {
+
+		static struct option long_options[] = {
+			{ "adapter", 1, 0, 'a' },
+			{ "frontend", 1, 0, 'f' },
+			{ "lnb", 1, 0, 'l' },
+			{ "socket", 1, 0, 's' },
+			{ "group", 1, 0, 'g' },
+			{ "output-dir", 1, 0, 'o' },
+			{ "timeout", 1, 0, 't' },
+			{ "wait", 1, 0, 'w' },
+			{ "repeat", 1, 0, 'r' },
+			{ "speed", 1, 0, 'S' },
+			{ "rotor-state", 1, 0, 'Q' },
+			{ "verbose", 0, 0, 'v' },
+			{ 0, 0, 0, 0 },
+		};
+
+		char *args = "a:f:l:s:g:o:t:w:r:S:Q:v";
+
+		int c = getopt_long(argc, argv, args, long_options, NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'a': {
+				char *str, *token, *saveptr = NULL;
+				adapter_count = 0;
+				for (str = optarg; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+					if (adapter_count >= DVBGYVERD_MAX_FRONTENDS || sscanf(token, "%u", &adapters[adapter_count]) != 1) {
+						printf("Invalid adapter \"%s\"\n", token);
+						print_usage(argv[0]);
+						return 1;
+					}
+					adapter_count++;
+				}
+				if (!adapter_count) {
+					printf("Invalid adapter \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			}
+			case 'f':
+				if (sscanf(optarg, "%u", &frontend) != 1) {
+					printf("Invalid frontend \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'l':
+				if (lnb_get_type(optarg, &lnb)) {
+					printf("Invalid LNB \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				socket_path = optarg;
+				break;
+			case 'g': {
+				struct group *gr = getgrnam(optarg);
+				if (!gr) {
+					printf("Invalid group \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				socket_group = gr->gr_gid;
+				break;
+			}
+			case 'o':
+				output_dir = optarg;
+				break;
+			case 't':
+				if (sscanf(optarg, "%u", &tuning_timeout) != 1 || !tuning_timeout) {
+					printf("Invalid timeout \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'w':
+				if (sscanf(optarg, "%u", &power_up) != 1) {
+					printf("Invalid power up time \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'r':
+				if (sscanf(optarg, "%u", &repeat) != 1) {
+					printf("Invalid repeat count \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'S':
+				if (sscanf(optarg, "%lf", &speed) != 1 || speed <= 0.0) {
+					printf("Invalid speed \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				speed_set = 1;
+				break;
+			case 'Q':
+				rotor_state = optarg;
+				break;
+			case 'v':
+				dvb_set_verbose(1);
+				break;
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	// Check the rotor state now rather than on the first command
+	if (speed_set)
+		rotor_speed = speed;
+	positioner_init(&rotor, rotor_speed);
+	int lock_fd = dvbgyverd_rotor_load();
+	if (lock_fd == -1)
+		return 1;
+	if (rotor_state)
+		positioner_unlock(lock_fd);
+
+	// Open all the frontends once and keep the LNBs powered
+	unsigned int i;
+	for (i = 0; i < adapter_count; i++) {
+		struct dvbgyverd_frontend *fe = &frontends[i];
+		fe->adapter = adapters[i];
+		fe->frontend = frontend;
+
+		char frontend_str[NAME_MAX];
+		snprintf(frontend_str, NAME_MAX - 1, "/dev/dvb/adapter%u/frontend%u", fe->adapter, fe->frontend);
+
+		printf("Opening frontend %s\n", frontend_str);
+		fe->fd = frontend_open(frontend_str, &fe->info);
+		if (fe->fd == -1)
+			goto err;
+		frontend_count++;
+
+		pthread_mutex_init(&fe->lock, NULL);
+		fe->voltage = -1;
+		fe->tone = -1;
+
+		if (fe->info.type == FE_QPSK && dvbgyverd_lnb(fe, SEC_VOLTAGE_18, SEC_TONE_OFF))
+			goto err;
+	}
+
+	if (power_up)
+		diseqc_wait(power_up);
+
+	int listen_fd = dvbgyverd_listen(socket_path);
+	if (listen_fd == -1)
+		goto err;
+
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Listening on %s with %u frontend(s)\n", socket_path, frontend_count);
+
+	while (!stopped) {
+
+		struct pollfd pfd = { listen_fd, POLLIN, 0 };
+		if (poll(&pfd, 1, DVBGYVERD_POLL) <= 0)
+			continue;
+
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1) {
+			if (errno != EINTR)
+				perror("Error while accepting a client");
+			continue;
+		}
+
+		if (!dvbgyverd_allowed(fd)) {
+			close(fd);
+			continue;
+		}
+
+		pthread_t thread;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&thread, &attr, dvbgyverd_client, (void *) (long) fd)) {
+			printf("Error while creating the client thread\n");
+			close(fd);
+		}
+		pthread_attr_destroy(&attr);
+	}
+
+	printf("Shutting down\n");
+	close(listen_fd);
+	unlink(socket_path);
+
+	// Wait for the running commands to finish
+	for (i = 0; i < frontend_count; i++) {
+		pthread_mutex_lock(&frontends[i].lock);
+		frontend_close(frontends[i].fd);
+	}
+
+	return 0;
+
+err:
+	for (i = 0; i < frontend_count; i++)
+		frontend_close(frontends[i].fd);
+	return 1;
+}
@@ -21,12 +21,31 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <limits.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "frontend.h"
+#include "hunter.h"
 #include "lnb.h"
+#include "planner.h"
+#include "scan.h"
+#include "tpdb.h"
+#include "utils.h"
 #include "config.h"
 
+#define FEEDHUNTER_MAX_ADAPTERS	16
+
 unsigned int verbose = 0;
+unsigned int hunt = 0;
+
+static unsigned int sat_count = 0;
+
+static volatile sig_atomic_t stopped = 0;
+
+void sighandler(int signal) {
+	stopped = 1;
+}
 
 void print_usage(char *app) {
 
@@ -34,13 +53,36 @@ void print_usage(char *app) {
 		"\n"
 		"Options are :\n"
 		" -h, --help             Display this help and exit\n"
-		" -a, --adapter=X        Adapter to use\n"
+		" -a, --adapter=X<,Y,.>  Adapter(s) to use, the range is shared between them\n"
 		" -f, --frontend=X       Frontend to use\n"
+		" -l, --lnb=X            LNB type : universal (default), ku-10750, ku-11300, c-band, wideband-10400,\n"
+		"                        wideband-10700 or custom LO in Mhz as LO or LOW,HIGH,SWITCH\n"
 		" -t, --timeout=X        Tuning timeout in seconds, default 5\n"
 		" -v, --verbose          Increase verbosity\n"
 		" -m, --min-freq         Lower bound of the frequency range to scan in Mhz\n"
 		" -M, --max-freq         Higher bound of the frequency range to scan in Mhz\n"
 		" -s, --step-freq        Frequency steps in Mhz. Default 1Mhz or higher depending on the card\n"
+		" -r, --symbol-rates=X<,Y,.> Symbol rates to try in kSym/s, default 27500 or 6900,6875 on cable\n"
+		" -A, --adaptive         Coarse steps based on the symbol rate, refined around found transponders\n"
+		" -B, --blind            Let the driver find the tuning parameters and skip past found transponders\n"
+		" -P, --presweep=X       Read the signal strength at each step waiting X ms, then only try to lock on peaks\n"
+		" -p, --profile=X        Save the pre-sweep power profile in CSV file X\n"
+		" -d, --database=X       Transponder database to verify first and update\n"
+		" -S, --satellite=X      Satellite name used in the database, default \"default\"\n"
+		" -R, --rescan=X         Sweep again regions not swept for X hours, default 168\n"
+		" -c, --classify=X       Read the PSI tables for up to X ms after each lock to spot feeds\n"
+		" -o, --output=X         Write a record of every tuning attempt in file X, - for stdout and the messages on stderr\n"
+		" -F, --format=X         Format of the records : json (JSON Lines, default) or csv\n"
+		" -L, --latency          Time each tuning phase and print latency histograms at the end\n"
+		" -C, --checkpoint=X     Save the progress regularly in file X and resume from it\n"
+		" -H, --hunt=X           Never stop, sweep again every X minutes and more often where transponders are\n"
+		" -u, --unicable=X<,Y,.> Share the cable through a Unicable SCR using the user bands at X, Y, ... Mhz\n"
+		"                        or ID:FREQ pairs, one band is assigned to each adapter\n"
+		" -U, --jess             The SCR is a Unicable II / JESS (EN50607) one\n"
+		" -D, --diseqc=X<,Y>     Select input X (1-4) of a committed DiSEqC switch, repeating the command Y times\n"
+		" -X, --satellites=X<,Y,.> Orbital positions to visit with a USALS rotor, as 19.2e or 19.2e:PRIORITY\n"
+		" -G, --site=LON,LAT     Coordinates of the dish in degrees, east and north are positive\n"
+		" -Q, --rotor-state=X    Rotor state file shared with the rotor tool\n"
 		"\n"
 		,app);
 
@@ -49,14 +91,35 @@ void print_usage(char *app) {
 int main(int argc, char *argv[]) {
 
 
-	printf(PACKAGE " : Copyright " PACKAGE_BUGREPORT "\n\n");
-	
 	// Parse command line
-	unsigned int adapter = 0;
+	unsigned int adapters[FEEDHUNTER_MAX_ADAPTERS] = { 0 };
+	unsigned int adapter_count = 1;
 	unsigned int frontend = 0;
+	enum lnb_type lnb = lnb_type_universal;
 	unsigned int tuning_timeout = 3;
 
 	unsigned int freq_start = 0, freq_end = 0, freq_step = 0;
+	enum scan_mode mode = scan_mode_linear;
+	char *db_file = NULL;
+	char *sat = "default";
+	unsigned int rescan = 168;
+	unsigned int dwell = 0;
+	unsigned int symbol_rates[SCAN_MAX_RATES] = { 27500000 };
+	unsigned int rate_count = 1;
+	int rates_set = 0;
+	char *profile_file = NULL;
+	unsigned int classify = 0;
+	char *output_file = NULL;
+	enum output_format output_format = output_format_json;
+	int latency = 0;
+	char *checkpoint = NULL;
+	char *unicable_bands = NULL;
+	enum unicable_type unicable_type = unicable_type_en50494;
+	unsigned int switch_port = 0, switch_repeat = 0;
+	static struct planner_sat sats[PLANNER_MAX_SATS];
+	double site_lon = 0.0, site_lat = 0.0;
+	int site_set = 0;
+	char *rotor_state = NULL;
 
 
 	while (1) {
@@ -65,15 +128,37 @@ int main(int argc, char *argv[]) {
 			{ "help", 0, 0, 'h' },
 			{ "adapter", 1, 0, 'a' },
 			{ "frontend", 1, 0, 'f' },
+			{ "lnb", 1, 0, 'l' },
 			{ "timeout", 1, 0, 't' },
 			{ "verbose", 0, 0, 'v' },
 			{ "min-freq", 1, 0, 'm' },
 			{ "max-freq", 1, 0, 'M' },
 			{ "step-freq", 1, 0, 's' },
+			{ "symbol-rates", 1, 0, 'r' },
+			{ "adaptive", 0, 0, 'A' },
+			{ "blind", 0, 0, 'B' },
+			{ "presweep", 1, 0, 'P' },
+			{ "profile", 1, 0, 'p' },
+			{ "database", 1, 0, 'd' },
+			{ "satellite", 1, 0, 'S' },
+			{ "rescan", 1, 0, 'R' },
+			{ "classify", 1, 0, 'c' },
+			{ "output", 1, 0, 'o' },
+			{ "format", 1, 0, 'F' },
+			{ "latency", 0, 0, 'L' },
+			{ "checkpoint", 1, 0, 'C' },
+			{ "hunt", 1, 0, 'H' },
+			{ "unicable", 1, 0, 'u' },
+			{ "jess", 0, 0, 'U' },
+			{ "diseqc", 1, 0, 'D' },
+			{ "satellites", 1, 0, 'X' },
+			{ "site", 1, 0, 'G' },
+			{ "rotor-state", 1, 0, 'Q' },
+			{ 0, 0, 0, 0 },
 
 		};
 
-		char *args = "ha:f:t:vm:M:s:";
+		char *args = "ha:f:l:t:vm:M:s:r:ABP:p:d:S:R:c:o:F:LC:H:u:UD:X:G:Q:";
 
 		int c = getopt_long(argc, argv, args, long_options, NULL);
 
@@ -85,13 +170,24 @@ int main(int argc, char *argv[]) {
 				print_usage(argv[0]);
 				return 1;
 
-			case 'a':
-				if (sscanf(optarg, "%u", &adapter) != 1) {
+			case 'a': {
+				char *str, *token, *saveptr = NULL;
+				adapter_count = 0;
+				for (str = optarg; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+					if (adapter_count >= FEEDHUNTER_MAX_ADAPTERS || sscanf(token, "%u", &adapters[adapter_count]) != 1) {
+						printf("Invalid adapter \"%s\"\n", token);
+						print_usage(argv[0]);
+						return 1;
+					}
+					adapter_count++;
+				}
+				if (!adapter_count) {
 					printf("Invalid adapter \"%s\"\n", optarg);
 					print_usage(argv[0]);
 					return 1;
 				}
 				break;
+			}
 			case 'f':
 				if (sscanf(optarg, "%u", &frontend) != 1) {
 					printf("Invalid frontend \"%s\"\n", optarg);
@@ -99,6 +195,13 @@ int main(int argc, char *argv[]) {
 					return 1;
 				}
 				break;
+			case 'l':
+				if (lnb_get_type(optarg, &lnb)) {
+					printf("Invalid LNB \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
 			case 't':
 				if (sscanf(optarg, "%u", &tuning_timeout) != 1) {
 					printf("Invalid timeout \"%s\"\n", optarg);
@@ -139,6 +242,128 @@ int main(int argc, char *argv[]) {
 				}
 				freq_step *= 1000; // Switch to kHz
 				break;
+			case 'r': {
+				char *str, *token, *saveptr = NULL;
+				rate_count = 0;
+				for (str = optarg; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+					if (rate_count >= SCAN_MAX_RATES || sscanf(token, "%u", &symbol_rates[rate_count]) != 1 || !symbol_rates[rate_count]) {
+						printf("Invalid symbol rate \"%s\"\n", token);
+						print_usage(argv[0]);
+						return 1;
+					}
+					symbol_rates[rate_count++] *= 1000; // Switch to Sym/s
+				}
+				rates_set = 1;
+				if (!rate_count) {
+					printf("Invalid symbol rates \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			}
+			case 'A':
+				mode = scan_mode_adaptive;
+				break;
+			case 'B':
+				mode = scan_mode_blind;
+				break;
+			case 'P':
+				if (sscanf(optarg, "%u", &dwell) != 1 || !dwell) {
+					printf("Invalid pre-sweep dwell time \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				mode = scan_mode_presweep;
+				break;
+			case 'p':
+				profile_file = optarg;
+				break;
+			case 'd':
+				db_file = optarg;
+				break;
+			case 'S':
+				if (strlen(optarg) >= TPDB_SAT_LEN || strpbrk(optarg, " \t\n")) {
+					printf("Invalid satellite name \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				sat = optarg;
+				break;
+			case 'R':
+				if (sscanf(optarg, "%u", &rescan) != 1) {
+					printf("Invalid rescan interval \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'c':
+				if (sscanf(optarg, "%u", &classify) != 1 || !classify) {
+					printf("Invalid classification time \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'o':
+				output_file = optarg;
+				break;
+			case 'F':
+				if (!strcmp(optarg, "json")) {
+					output_format = output_format_json;
+				} else if (!strcmp(optarg, "csv")) {
+					output_format = output_format_csv;
+				} else {
+					printf("Invalid output format \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'L':
+				latency = 1;
+				break;
+			case 'C':
+				checkpoint = optarg;
+				break;
+			case 'u':
+				unicable_bands = optarg;
+				break;
+			case 'U':
+				unicable_type = unicable_type_en50607;
+				break;
+			case 'X': {
+				int res = planner_parse(optarg, sats, PLANNER_MAX_SATS);
+				if (res <= 0) {
+					printf("Invalid satellite list\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				sat_count = res;
+				break;
+			}
+			case 'G':
+				if (sscanf(optarg, "%lf,%lf", &site_lon, &site_lat) != 2) {
+					printf("Invalid site coordinates \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				site_set = 1;
+				break;
+			case 'Q':
+				rotor_state = optarg;
+				break;
+			case 'D':
+				if (sscanf(optarg, "%u,%u", &switch_port, &switch_repeat) < 1 || switch_port < 1 || switch_port > 4) {
+					printf("Invalid DiSEqC switch port \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'H':
+				if (sscanf(optarg, "%u", &hunt) != 1 || !hunt) {
+					printf("Invalid hunting interval \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
 
 			default:
 				print_usage(argv[0]);
@@ -147,36 +372,95 @@ int main(int argc, char *argv[]) {
 
 	}
 
-	// Open the DVB device
+	// Records written to stdout must not be mixed with the progress and
+	// the results, those go to stderr instead
+	struct output output;
+	if (output_file) {
+		// Lose the records rather than the scan when the reader goes away
+		signal(SIGPIPE, SIG_IGN);
+		if (output_open(&output, output_file, output_format))
+			return 1;
+		if (!strcmp(output_file, "-")) {
+			fflush(stdout);
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+	}
+
+	printf(PACKAGE " : Copyright " PACKAGE_BUGREPORT "\n\n");
 
-	char frontend_str[NAME_MAX];
-	snprintf(frontend_str, NAME_MAX - 1, "/dev/dvb/adapter%u/frontend%u", adapter, frontend);
+	// Open the DVB devices
 
+	int frontend_fds[FEEDHUNTER_MAX_ADAPTERS];
+	char demux_strs[FEEDHUNTER_MAX_ADAPTERS][NAME_MAX];
+	char *demux_devs[FEEDHUNTER_MAX_ADAPTERS];
 	struct dvb_frontend_info fe_info;
+	unsigned int i, opened = 0;
+
+	for (i = 0; i < adapter_count; i++) {
+		char frontend_str[NAME_MAX];
+		snprintf(frontend_str, NAME_MAX - 1, "/dev/dvb/adapter%u/frontend%u", adapters[i], frontend);
+
+		snprintf(demux_strs[i], NAME_MAX - 1, "/dev/dvb/adapter%u/demux%u", adapters[i], frontend);
+		demux_devs[i] = demux_strs[i];
 
-	int frontend_fd = frontend_open(frontend_str, &fe_info);
-	if (frontend_fd == -1)
-		return 1;
+		struct dvb_frontend_info info;
+		frontend_fds[i] = frontend_open(frontend_str, &info);
+		if (frontend_fds[i] == -1)
+			goto err;
+		opened++;
 
-	unsigned int lnb_freq_start, lnb_freq_end;
-	if (lnb_get_limits(lnb_type_univeral, &lnb_freq_start, &lnb_freq_end)) {
-		printf("Error while getting LNB limits\n");
+		if (i && info.type != fe_info.type) {
+			printf("All the adapters must be of the same type\n");
+			goto err;
+		}
+
+		// Use the most restrictive step size
+		if (!i || info.frequency_stepsize > fe_info.frequency_stepsize)
+			fe_info = info;
+	}
+
+	unsigned int limit_start, limit_end, stepsize;
+	if (fe_info.type == FE_QPSK) {
+		if (lnb_get_limits(lnb, &limit_start, &limit_end)) {
+			printf("Error while getting LNB limits\n");
+			goto err;
+		}
+		stepsize = fe_info.frequency_stepsize;
+		dvb_debug("Using %s LNB\n", lnb_get_name(lnb));
+	} else if (fe_info.type == FE_QAM || fe_info.type == FE_OFDM) {
+		// Cable and terrestrial frontends use Hz
+		limit_start = fe_info.frequency_min / 1000;
+		limit_end = fe_info.frequency_max / 1000;
+		stepsize = fe_info.frequency_stepsize / 1000;
+
+		if (mode != scan_mode_linear || db_file) {
+			printf("Only the linear mode without database is available on cable and terrestrial\n");
+			goto err;
+		}
+
+		if (fe_info.type == FE_QAM && !rates_set) {
+			symbol_rates[0] = 6900000;
+			symbol_rates[1] = 6875000;
+			rate_count = 2;
+		}
+	} else {
+		printf("Unhandled frontend type\n");
 		goto err;
 	}
 
-	if (freq_start < lnb_freq_start)
-		freq_start = lnb_freq_start;
+	if (freq_start < limit_start)
+		freq_start = limit_start;
 
-	if (!freq_end || freq_end > lnb_freq_end)
-		freq_end = lnb_freq_end;
+	if (!freq_end || freq_end > limit_end)
+		freq_end = limit_end;
 
 	if (freq_start > freq_end) {
 		printf("Invalid frequency range : start %u Mhz, end %u Mhz\n", freq_start, freq_end);
 		goto err;
 	}
 
-	if (fe_info.frequency_stepsize > freq_step)
-		freq_step = fe_info.frequency_stepsize;
+	if (stepsize > freq_step)
+		freq_step = stepsize;
 
 	if (freq_step < 1000) {
 		printf("Frontend returned frequency step size < 1Mhz, defaulting to 1Mhz\n");
@@ -185,15 +469,144 @@ int main(int argc, char *argv[]) {
 
 	frontend_print_info(&fe_info);
 
-	scan(frontend_fd, tuning_timeout, freq_start, freq_end, freq_step);
+	struct scan_params params = {0};
+	params.type = fe_info.type;
+	params.lnb = lnb;
+	params.mode = mode;
+	params.timeout = tuning_timeout;
+	params.start_freq = freq_start;
+	params.end_freq = freq_end;
+	params.step = freq_step;
+	memcpy(params.symbol_rates, symbol_rates, sizeof(symbol_rates));
+	params.rate_count = rate_count;
+	params.dwell = dwell;
+	params.dvb_s2 = !!(fe_info.caps & FE_CAN_2G_MODULATION);
+	params.qam_auto = (fe_info.type != FE_QPSK && (fe_info.caps & FE_CAN_QAM_AUTO));
+	params.classify = classify;
+	params.checkpoint = checkpoint;
+	params.switch_port = switch_port;
+	params.switch_repeat = switch_repeat;
+	params.stop = &stopped;
+
+	if (profile_file) {
+		if (mode != scan_mode_presweep) {
+			printf("The power profile is only available in pre-sweep mode\n");
+			goto err;
+		}
+		params.profile = fopen(profile_file, "w");
+		if (!params.profile) {
+			perror("Error while opening the profile file");
+			goto err;
+		}
+	}
+
+	static struct latency lat;
+	if (latency)
+		params.latency = &lat;
+
+	if (output_file)
+		params.output = &output;
+
+	static struct positioner rotor;
+	int rotor_lock = -1;
+	if (sat_count) {
+		if (fe_info.type != FE_QPSK || unicable_bands || hunt || checkpoint) {
+			printf("Visiting satellites is only available on satellite frontends without Unicable, hunting or checkpoint\n");
+			goto err;
+		}
+		if (!site_set) {
+			printf("The site coordinates are needed to point the rotor\n");
+			goto err;
+		}
+		positioner_init(&rotor, 0.0);
+		// The dish is ours for the whole tour
+		if (rotor_state && (rotor_lock = positioner_lock(rotor_state)) == -1)
+			goto err;
+		if (rotor_state && positioner_load(&rotor, rotor_state))
+			goto err;
+		if (planner_angles(sats, sat_count, site_lon, site_lat))
+			goto err;
+	}
+
+	static struct unicable unicable;
+	if (unicable_bands) {
+		if (fe_info.type != FE_QPSK || switch_port) {
+			printf("Unicable is only available on satellite frontends without DiSEqC switch\n");
+			goto err;
+		}
+		if (unicable_init(&unicable, unicable_type, unicable_bands)) {
+			printf("Invalid Unicable user bands \"%s\"\n", unicable_bands);
+			goto err;
+		}
+		if (unicable.band_count < adapter_count) {
+			printf("Not enough Unicable user bands for %u adapters\n", adapter_count);
+			unicable_cleanup(&unicable);
+			goto err;
+		}
+		params.unicable = &unicable;
+	}
 
+	struct tpdb db;
+	if (db_file) {
+		if (tpdb_open(&db, db_file))
+			goto err;
+		params.db = &db;
+		params.sat = sat;
+		params.stale = rescan * 3600;
+	}
+
+	// Stop cleanly so the progress can be saved
+	signal(SIGINT, sighandler);
+	signal(SIGTERM, sighandler);
+
+	// Failures still let us save what was found, the exit status tells
+	int res;
+	if (hunt)
+		res = hunter_run(frontend_fds, demux_devs, adapter_count, &params, hunt * 60);
+	else if (sat_count)
+		res = planner_run(frontend_fds, demux_devs, adapter_count, &params, sats, sat_count, &rotor);
+	else
+		res = scan_parallel(frontend_fds, demux_devs, adapter_count, &params);
+	scan_cleanup(&params);
+
+	if (sat_count && rotor_state) {
+		if (positioner_save(&rotor, rotor_state))
+			res = -1;
+		positioner_unlock(rotor_lock);
+	}
+
+	if (params.unicable)
+		unicable_cleanup(params.unicable);
+
+	if (params.latency)
+		latency_print(params.latency);
+
+	if (params.profile)
+		fclose(params.profile);
+
+	// What was found still goes in the database when the output failed
+	if (params.output && output_close(params.output))
+		res = -1;
+
+	if (db_file) {
+		if (tpdb_save(&db)) {
+			tpdb_close(&db);
+			goto err;
+		}
+		tpdb_close(&db);
+	}
+
+	if (res)
+		goto err;
 
-	frontend_close(frontend_fd);
+	for (i = 0; i < opened; i++)
+		frontend_close(frontend_fds[i]);
 
 	return 0;
 
 err:
-	frontend_close(frontend_fd);
+	for (i = 0; i < opened; i++)
+		frontend_close(frontend_fds[i]);
 	return 1;
 
 }
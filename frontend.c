@@ -29,6 +29,10 @@
 #include <errno.h>
 #include <string.h>
 #include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <time.h>
 
 int frontend_open(char *frontend, struct dvb_frontend_info *fe_info) {
 	// Open the DVB device
@@ -113,6 +117,125 @@ int frontend_tune_dvb_s(int frontend_fd, unsigned int ifreq, unsigned int symbol
 	return 0;
 }
 
+int frontend_tune_dvb_s_auto(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate, int dvb_s2) {
+
+	// Let the driver find the FEC, modulation and roll-off
+	struct dtv_property props[] = {
+		{ .cmd = DTV_CLEAR },
+		{ .cmd = DTV_DELIVERY_SYSTEM, .u.data = (dvb_s2 ? SYS_DVBS2 : SYS_DVBS) },
+		{ .cmd = DTV_FREQUENCY, .u.data = ifreq },
+		{ .cmd = DTV_SYMBOL_RATE, .u.data = symbol_rate },
+		{ .cmd = DTV_INVERSION, .u.data = INVERSION_AUTO },
+		{ .cmd = DTV_INNER_FEC, .u.data = FEC_AUTO },
+		{ .cmd = DTV_MODULATION, .u.data = (dvb_s2 ? QAM_AUTO : QPSK) },
+		{ .cmd = DTV_ROLLOFF, .u.data = ROLLOFF_AUTO },
+		{ .cmd = DTV_PILOT, .u.data = PILOT_AUTO },
+		{ .cmd = DTV_TUNE },
+	};
+	struct dtv_properties cmd = { .num = sizeof(props) / sizeof(props[0]), .props = props };
+
+	if (ioctl(frontend_fd, FE_SET_PROPERTY, &cmd)) {
+		perror("Error while setting frontend");
+		return 1;
+	}
+
+	return 0;
+}
+
+int frontend_get_tuning(int frontend_fd, struct frontend_tuning *tuning) {
+
+	struct dtv_property props[] = {
+		{ .cmd = DTV_DELIVERY_SYSTEM },
+		{ .cmd = DTV_FREQUENCY },
+		{ .cmd = DTV_SYMBOL_RATE },
+		{ .cmd = DTV_MODULATION },
+		{ .cmd = DTV_INNER_FEC },
+		{ .cmd = DTV_ROLLOFF },
+	};
+	struct dtv_properties cmd = { .num = sizeof(props) / sizeof(props[0]), .props = props };
+
+	if (ioctl(frontend_fd, FE_GET_PROPERTY, &cmd)) {
+		dvb_debug("Unable to read the tuning parameters : %s\n", strerror(errno));
+		return -1;
+	}
+
+	tuning->delivery_system = props[0].u.data;
+	tuning->frequency = props[1].u.data;
+	tuning->symbol_rate = props[2].u.data;
+	tuning->modulation = props[3].u.data;
+	tuning->fec = props[4].u.data;
+	tuning->rolloff = props[5].u.data;
+
+	return 0;
+}
+
+char *frontend_delivery_system_str(unsigned int delivery_system) {
+
+	switch (delivery_system) {
+		case SYS_DVBS:
+			return "DVB-S";
+		case SYS_DVBS2:
+			return "DVB-S2";
+		case SYS_DVBC_ANNEX_A:
+			return "DVB-C";
+		case SYS_DVBT:
+			return "DVB-T";
+		case SYS_DVBT2:
+			return "DVB-T2";
+	}
+
+	return "unknown";
+}
+
+char *frontend_modulation_str(unsigned int modulation) {
+
+	switch (modulation) {
+		case QPSK:
+			return "QPSK";
+		case PSK_8:
+			return "8PSK";
+		case APSK_16:
+			return "16APSK";
+		case APSK_32:
+			return "32APSK";
+		case QAM_16:
+			return "QAM16";
+		case QAM_32:
+			return "QAM32";
+		case QAM_64:
+			return "QAM64";
+		case QAM_128:
+			return "QAM128";
+		case QAM_256:
+			return "QAM256";
+	}
+
+	return "auto";
+}
+
+char *frontend_fec_str(unsigned int fec) {
+
+	static char *fecs[] = {
+		[FEC_NONE] = "none",
+		[FEC_1_2] = "1/2",
+		[FEC_2_3] = "2/3",
+		[FEC_3_4] = "3/4",
+		[FEC_4_5] = "4/5",
+		[FEC_5_6] = "5/6",
+		[FEC_6_7] = "6/7",
+		[FEC_7_8] = "7/8",
+		[FEC_8_9] = "8/9",
+		[FEC_AUTO] = "auto",
+		[FEC_3_5] = "3/5",
+		[FEC_9_10] = "9/10",
+	};
+
+	if (fec >= sizeof(fecs) / sizeof(fecs[0]) || !fecs[fec])
+		return "auto";
+
+	return fecs[fec];
+}
+
 int frontend_tune_dvb_c(int frontend_fd, unsigned int freq, unsigned int symbol_rate, fe_modulation_t modulation) {
 	
 	struct dvb_frontend_parameters params = {0};
@@ -138,7 +261,7 @@ int frontend_tune_dvb_t(int frontend_fd, unsigned int freq, fe_modulation_t modu
 	params.u.ofdm.constellation = modulation;
 	params.u.ofdm.code_rate_HP = code_rate;
 	params.u.ofdm.code_rate_LP = FEC_NONE;
-	params.u.ofdm.constellation = modulation;
+	params.u.ofdm.bandwidth = bandwidth;
 	params.u.ofdm.transmission_mode = transmit_mode;
 	params.u.ofdm.guard_interval = guard_interval;
 	params.u.ofdm.hierarchy_information = HIERARCHY_NONE; // Only this is supported now
@@ -154,10 +277,34 @@ int frontend_tune_dvb_t(int frontend_fd, unsigned int freq, fe_modulation_t modu
 
 int frontend_get_status(int frontend_fd, unsigned int timeout, fe_status_t *status) {
 
+	return frontend_get_status_timed(frontend_fd, timeout, status, NULL);
+}
+
+static unsigned int frontend_elapsed(struct timespec *start) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+int frontend_get_status_timed(int frontend_fd, unsigned int timeout, fe_status_t *status, unsigned int *first) {
+
 	struct pollfd pfd[1];
 	pfd[0].fd = frontend_fd;
 	pfd[0].events = POLLIN;
 
+	*status = 0;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int i;
+	if (first) {
+		for (i = 0; i < FRONTEND_STATUS_BITS; i++)
+			first[i] = FRONTEND_STATUS_NEVER;
+	}
+
 	struct timeval now;
 	gettimeofday(&now, NULL);
 	
@@ -167,13 +314,16 @@ int frontend_get_status(int frontend_fd, unsigned int timeout, fe_status_t *stat
 
 		int res = poll(pfd, 1, 1000);
 
+		if (res < 0 && errno == EINTR) // Interrupted by a signal, report what we have
+			return 0;
+
 		if (res < 0) {
 			perror("Error while polling frontend");
 			return -1;
 		}
 
 		if (!res) { // Timeout
-			gettimeofday(&now);
+			gettimeofday(&now, NULL);
 			continue;
 		}
 		
@@ -184,6 +334,14 @@ int frontend_get_status(int frontend_fd, unsigned int timeout, fe_status_t *stat
 				return -1;
 			}
 
+			if (first) {
+				unsigned int elapsed = frontend_elapsed(&start);
+				for (i = 0; i < FRONTEND_STATUS_BITS; i++) {
+					if ((*status & (1 << i)) && first[i] == FRONTEND_STATUS_NEVER)
+						first[i] = elapsed;
+				}
+			}
+
 			dvb_debug("Status : ");
 			if (*status & FE_HAS_SIGNAL)
 				dvb_debug("SIGNAL ");
@@ -209,6 +367,80 @@ int frontend_get_status(int frontend_fd, unsigned int timeout, fe_status_t *stat
 	return 0;
 }
 
+int frontend_read_status(int frontend_fd, fe_status_t *status) {
+
+	*status = 0;
+	if (ioctl(frontend_fd, FE_READ_STATUS, status)) {
+		perror("Error while getting frontend status");
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+static int frontend_get_stats(int frontend_fd, unsigned int *strength, unsigned int *snr) {
+
+	struct dtv_property props[2] = { { .cmd = DTV_STAT_SIGNAL_STRENGTH }, { .cmd = DTV_STAT_CNR } };
+	struct dtv_properties cmd = { .num = 2, .props = props };
+
+	if (ioctl(frontend_fd, FE_GET_PROPERTY, &cmd))
+		return -1;
+
+	struct dtv_stats *st = &props[0].u.st.stat[0];
+	if (!props[0].u.st.len || st->scale == FE_SCALE_NOT_AVAILABLE)
+		return -1;
+
+	if (st->scale == FE_SCALE_RELATIVE) {
+		*strength = st->uvalue;
+	} else if (st->scale == FE_SCALE_DECIBEL) {
+		// Map -100..0 dBm to the 16 bits range of FE_READ_SIGNAL_STRENGTH
+		long long dbm = st->svalue + 100000;
+		if (dbm < 0)
+			dbm = 0;
+		if (dbm > 100000)
+			dbm = 100000;
+		*strength = dbm * 0xFFFF / 100000;
+	}
+
+	st = &props[1].u.st.stat[0];
+	if (props[1].u.st.len && st->scale == FE_SCALE_RELATIVE)
+		*snr = st->uvalue;
+	else if (props[1].u.st.len && st->scale == FE_SCALE_DECIBEL && st->svalue > 0)
+		*snr = st->svalue / 100; // 0.1 dB steps
+
+	return 0;
+}
+#endif
+
+int frontend_get_signal(int frontend_fd, unsigned int *strength, unsigned int *snr) {
+
+	*strength = 0;
+	*snr = 0;
+
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+	// Prefer the DVBv5 statistics when the driver provides them
+	if (!frontend_get_stats(frontend_fd, strength, snr))
+		return 0;
+#endif
+
+	// Not all drivers implement these, report 0 if unsupported
+	uint16_t val = 0;
+
+	if (!ioctl(frontend_fd, FE_READ_SIGNAL_STRENGTH, &val))
+		*strength = val;
+	else
+		dvb_debug("Unable to read signal strength : %s\n", strerror(errno));
+
+	val = 0;
+	if (!ioctl(frontend_fd, FE_READ_SNR, &val))
+		*snr = val;
+	else
+		dvb_debug("Unable to read SNR : %s\n", strerror(errno));
+
+	return 0;
+}
+
 int frontend_set_voltage(int frontend_fd, fe_sec_voltage_t v) {
 
 	if (ioctl(frontend_fd, FE_SET_VOLTAGE, v)) {
@@ -219,6 +451,31 @@ int frontend_set_voltage(int frontend_fd, fe_sec_voltage_t v) {
 	return 0;
 }
 
+int frontend_send_diseqc(int frontend_fd, unsigned char *msg, unsigned int len) {
+
+	struct dvb_diseqc_master_cmd cmd = { { 0 }, len };
+	if (len < 3 || len > sizeof(cmd.msg))
+		return -1;
+	memcpy(cmd.msg, msg, len);
+
+	if (ioctl(frontend_fd, FE_DISEQC_SEND_MASTER_CMD, &cmd)) {
+		perror("Error while sending DiSEqC command");
+		return -1;
+	}
+
+	return 0;
+}
+
+int frontend_send_burst(int frontend_fd, fe_sec_mini_cmd_t b) {
+
+	if (ioctl(frontend_fd, FE_DISEQC_SEND_BURST, b)) {
+		perror("Error while sending tone burst");
+		return -1;
+	}
+
+	return 0;
+}
+
 int frontend_set_tone(int frontend_fd, fe_sec_tone_mode_t t) {
 
 	if (ioctl(frontend_fd, FE_SET_TONE, t)) {
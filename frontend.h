@@ -23,14 +23,38 @@
 
 #include <linux/dvb/frontend.h>
 
+// FE_HAS_SIGNAL to FE_HAS_LOCK, for the time each status bit first showed up
+#define FRONTEND_STATUS_BITS	5
+#define FRONTEND_STATUS_NEVER	((unsigned int) -1)
+
+// Tuning parameters as reported by the driver
+struct frontend_tuning {
+	unsigned int delivery_system; // fe_delivery_system_t
+	unsigned int frequency; // kHz, intermediate frequency for DVB-S
+	unsigned int symbol_rate; // Sym/s
+	unsigned int modulation; // fe_modulation_t
+	unsigned int fec; // fe_code_rate_t
+	unsigned int rolloff; // fe_rolloff_t
+};
+
 int frontend_open(char *frontend, struct dvb_frontend_info *fe_info);
 void frontend_print_info(struct dvb_frontend_info *fe_info);
 int frontend_tune_dvb_s(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate);
+int frontend_tune_dvb_s_auto(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate, int dvb_s2);
+int frontend_get_tuning(int frontend_fd, struct frontend_tuning *tuning);
+char *frontend_delivery_system_str(unsigned int delivery_system);
+char *frontend_modulation_str(unsigned int modulation);
+char *frontend_fec_str(unsigned int fec);
 int frontend_tune_dvb_c(int frontend_fd, unsigned int freq, unsigned int symbol_rate, fe_modulation_t modulation);
 int frontend_tune_dvb_t(int frontend_fd, unsigned int freq, fe_modulation_t modulation, fe_bandwidth_t bandwidth, fe_transmit_mode_t transmit_mode, fe_code_rate_t code_rate, fe_guard_interval_t guard_interval);
 int frontend_get_status(int frontend_fd, unsigned int timeout, fe_status_t *status);
+int frontend_get_status_timed(int frontend_fd, unsigned int timeout, fe_status_t *status, unsigned int *first);
+int frontend_read_status(int frontend_fd, fe_status_t *status);
+int frontend_get_signal(int frontend_fd, unsigned int *strength, unsigned int *snr);
 int frontend_set_voltage(int frontend_fd, fe_sec_voltage_t v);
 int frontend_set_tone(int frontend_fd, fe_sec_tone_mode_t t);
+int frontend_send_diseqc(int frontend_fd, unsigned char *msg, unsigned int len);
+int frontend_send_burst(int frontend_fd, fe_sec_mini_cmd_t b);
 int frontend_close(int frontend_fd);
 
 #endif
@@ -0,0 +1,363 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "hunter.h"
+#include "lnb.h"
+#include "utils.h"
+
+// The hunter never stops : the range is split in tasks kept in a priority
+// queue ordered by the time they are due. A task is due again after the
+// revisit interval, shortened by how many transponders it usually has.
+
+struct hunter_task {
+	char *sat;
+	int polarity;
+	unsigned int start, end; // kHz
+	time_t last_visit, due;
+	unsigned int visits;
+	double hit_rate; // Transponders found per visit, moving average
+};
+
+struct hunter;
+
+struct hunter_worker {
+	pthread_t thread;
+	int frontend_fd;
+	struct scan_params params;
+	struct hunter *hunter;
+};
+
+struct hunter {
+	unsigned int interval; // Revisit interval of empty units in seconds
+
+	struct hunter_task *tasks;
+	unsigned int task_count;
+	struct hunter_task **queue; // Min heap on the due time
+	unsigned int queue_count;
+
+	pthread_mutex_t lock; // Protects the database and all the fields
+	pthread_cond_t cond;
+	struct tpdb *db;
+	time_t saved;
+	int saving; // A worker is saving a copy of the database
+	unsigned int visits, found;
+	int res;
+};
+
+
+static void hunter_queue_push(struct hunter *h, struct hunter_task *task) {
+
+	unsigned int i = h->queue_count++;
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		if (h->queue[parent]->due <= task->due)
+			break;
+		h->queue[i] = h->queue[parent];
+		i = parent;
+	}
+	h->queue[i] = task;
+}
+
+static struct hunter_task *hunter_queue_pop(struct hunter *h) {
+
+	struct hunter_task *top = h->queue[0];
+	struct hunter_task *last = h->queue[--h->queue_count];
+
+	unsigned int i = 0;
+	while (1) {
+		unsigned int child = 2 * i + 1;
+		if (child >= h->queue_count)
+			break;
+		if (child + 1 < h->queue_count && h->queue[child + 1]->due < h->queue[child]->due)
+			child++;
+		if (last->due <= h->queue[child]->due)
+			break;
+		h->queue[i] = h->queue[child];
+		i = child;
+	}
+	if (h->queue_count)
+		h->queue[i] = last;
+
+	return top;
+}
+
+static void hunter_task_schedule(struct hunter *h, struct hunter_task *task) {
+
+	unsigned int interval = h->interval / (1.0 + HUNTER_HIT_WEIGHT * task->hit_rate);
+	if (interval < HUNTER_MIN_INTERVAL)
+		interval = HUNTER_MIN_INTERVAL;
+
+	task->due = task->last_visit + interval;
+}
+
+static int hunter_tasks(struct hunter *h, struct scan_params *params) {
+
+	// One task per scan unit
+	struct scan_unit *units = NULL;
+	int unit_count = scan_units(params, &units);
+	if (unit_count < 0)
+		return -1;
+
+	h->tasks = calloc(unit_count ? unit_count : 1, sizeof(struct hunter_task));
+	if (!h->tasks) {
+		perror("Not enough memory");
+		free(units);
+		return -1;
+	}
+
+	unsigned int i;
+	for (i = 0; i < (unsigned int) unit_count; i++) {
+		struct hunter_task *task = &h->tasks[h->task_count++];
+		task->sat = params->sat;
+		task->polarity = units[i].polarity;
+		task->start = units[i].start;
+		task->end = units[i].end;
+	}
+	free(units);
+
+	h->queue = malloc(sizeof(struct hunter_task *) * (h->task_count ? h->task_count : 1));
+	if (!h->queue) {
+		perror("Not enough memory");
+		return -1;
+	}
+
+	// Start from what the database remembers
+	unsigned int j;
+	for (i = 0; i < h->task_count; i++) {
+		struct hunter_task *task = &h->tasks[i];
+		if (h->db) {
+			unsigned int region;
+			task->last_visit = -1;
+			for (region = task->start - task->start % TPDB_REGION_SIZE; region <= task->end; region += TPDB_REGION_SIZE) {
+				time_t last_swept = tpdb_region_get(h->db, task->sat, task->polarity, region);
+				if (last_swept < task->last_visit || task->last_visit == -1)
+					task->last_visit = last_swept;
+			}
+
+			for (j = 0; j < h->db->tp_count; j++) {
+				struct tpdb_transponder *tp = &h->db->tps[j];
+				if (!strcmp(tp->sat, task->sat) && tp->polarity == task->polarity && tp->freq >= task->start && tp->freq <= task->end)
+					task->hit_rate++;
+			}
+		}
+		hunter_task_schedule(h, task);
+		hunter_queue_push(h, task);
+	}
+
+	return 0;
+}
+
+static int hunter_visited(struct hunter *h, struct hunter_task *task, unsigned int found, struct tpdb *snapshot) {
+
+	// Called with the lock held, only the bookkeeping is done here
+	task->visits++;
+	task->last_visit = time(NULL);
+	task->hit_rate = (task->hit_rate * (100 - HUNTER_HIT_SMOOTHING) + found * HUNTER_HIT_SMOOTHING) / 100.0;
+	hunter_task_schedule(h, task);
+	hunter_queue_push(h, task);
+
+	h->visits++;
+	h->found += found;
+
+	// Saving takes a while, copy the database so that one worker can
+	// write it out without holding the others
+	if (!h->db || h->saving || task->last_visit - h->saved < HUNTER_SAVE_INTERVAL)
+		return 0;
+
+	if (tpdb_copy(snapshot, h->db)) {
+		h->res = -1;
+		return 0;
+	}
+	h->saving = 1;
+	h->saved = task->last_visit;
+
+	return 1;
+}
+
+static void hunter_report(struct hunter_worker *w, struct hunter_task *task, unsigned int found, time_t visit, time_t due) {
+
+	struct scan_params *p = &w->params;
+
+	char date[32];
+	struct tm tm;
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&visit, &tm));
+
+	// Keep the lines of each visit together
+	flockfile(stdout);
+	unsigned int i;
+	for (i = 0; i < p->result_count; i++) {
+		printf("%s ", date);
+		scan_result_print(&p->results[i]);
+	}
+	funlockfile(stdout);
+
+	dvb_debug("%s Visited %u - %u Mhz %s Polarity on frontend %d : %u transponders, next visit in %u s\n", date, task->start / 1000, task->end / 1000,
+		(task->polarity ? "V" : "H"), w->frontend_fd, found, (unsigned int) (due - visit));
+}
+
+static void *hunter_thread(void *arg) {
+
+	struct hunter_worker *w = arg;
+	struct hunter *h = w->hunter;
+	struct scan_params *p = &w->params;
+
+	pthread_mutex_lock(&h->lock);
+	while (!scan_stopped(p) && !h->res) {
+
+		time_t now = time(NULL);
+
+		if (!h->queue_count || h->queue[0]->due > now) {
+			// Wake up regularly to notice when we're asked to stop
+			struct timespec ts = { now + 1, 0 };
+			if (h->queue_count && h->queue[0]->due < ts.tv_sec)
+				ts.tv_sec = h->queue[0]->due;
+			pthread_cond_timedwait(&h->cond, &h->lock, &ts);
+			continue;
+		}
+
+		struct hunter_task *task = hunter_queue_pop(h);
+		pthread_mutex_unlock(&h->lock);
+
+		// Everything in the task is swept, regardless of the stale interval
+		p->sat = task->sat;
+		p->started = time(NULL);
+		unsigned int found = p->found;
+		int res = scan_task(w->frontend_fd, p, task->polarity, task->start, task->end);
+		found = p->found - found;
+
+		pthread_mutex_lock(&h->lock);
+		if (res) {
+			// Put it back for next time
+			hunter_queue_push(h, task);
+			if (!scan_stopped(p))
+				h->res = -1;
+			break;
+		}
+		struct tpdb snapshot;
+		int save = hunter_visited(h, task, found, &snapshot);
+		time_t visit = task->last_visit, due = task->due;
+		pthread_cond_broadcast(&h->cond);
+		pthread_mutex_unlock(&h->lock);
+
+		// Results are in the database, start afresh for the next task
+		hunter_report(w, task, found, visit, due);
+		scan_cleanup(p);
+
+		int saved = 0;
+		if (save) {
+			saved = tpdb_save(&snapshot);
+			tpdb_close(&snapshot);
+		}
+
+		pthread_mutex_lock(&h->lock);
+		if (save) {
+			h->saving = 0;
+			if (saved)
+				h->res = -1;
+		}
+	}
+	pthread_cond_broadcast(&h->cond);
+	pthread_mutex_unlock(&h->lock);
+
+	return NULL;
+}
+
+int hunter_run(int *frontend_fds, char **demux_devs, unsigned int count, struct scan_params *params, unsigned int interval) {
+
+	if (params->type != FE_QPSK) {
+		printf("Hunting is only available on satellite\n");
+		return -1;
+	}
+
+	struct hunter h = { 0 };
+	h.interval = interval;
+	h.db = params->db;
+	h.saved = time(NULL);
+	pthread_mutex_init(&h.lock, NULL);
+	pthread_cond_init(&h.cond, NULL);
+
+	scan_reset(params);
+	params->stale = 0;
+
+	int res = hunter_tasks(&h, params);
+
+	struct hunter_worker *workers = NULL;
+	if (!res) {
+		workers = calloc(count, sizeof(struct hunter_worker));
+		if (!workers) {
+			perror("Not enough memory");
+			res = -1;
+		}
+	}
+
+	if (!res)
+		printf("Hunting from %u Mhz to %u Mhz on %u frontends, %u tasks revisited every %u minutes or more often when they have transponders ...\n",
+			params->start_freq / 1000, params->end_freq / 1000, count, h.task_count, interval / 60);
+
+	unsigned int i, started = 0;
+	for (i = 0; !res && i < count; i++) {
+		struct hunter_worker *w = &workers[i];
+		w->frontend_fd = frontend_fds[i];
+		w->hunter = &h;
+		w->params = *params;
+		w->params.demux = demux_devs[i];
+		w->params.quiet = 1;
+		w->params.lock = &h.lock;
+
+		if (pthread_create(&w->thread, NULL, hunter_thread, w)) {
+			perror("Error while creating hunter thread");
+			res = -1;
+			break;
+		}
+		started++;
+	}
+
+	if (res) {
+		// Stop the workers that were started
+		pthread_mutex_lock(&h.lock);
+		h.res = -1;
+		pthread_mutex_unlock(&h.lock);
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		params->attempts += workers[i].params.attempts;
+		params->probes += workers[i].params.probes;
+		scan_cleanup(&workers[i].params);
+	}
+
+	if (h.res)
+		res = -1;
+
+	printf("Hunting stopped : %u transponders found in %u visits and %u tuning attempts\n", h.found, h.visits, params->attempts);
+
+	pthread_mutex_destroy(&h.lock);
+	pthread_cond_destroy(&h.cond);
+	free(workers);
+	free(h.queue);
+	free(h.tasks);
+
+	return res;
+}
@@ -0,0 +1,35 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __HUNTER_H__
+#define __HUNTER_H__
+
+#include "scan.h"
+
+#define HUNTER_HIT_WEIGHT	4	// Units with one transponder per visit are visited 1 + X times more often
+#define HUNTER_HIT_SMOOTHING	30	// Weight of the last visit in the hit rate in percent
+#define HUNTER_MIN_INTERVAL	60	// Never visit a unit again sooner than that in seconds
+#define HUNTER_SAVE_INTERVAL	300	// Minimum time between two database saves in seconds
+
+int hunter_run(int *frontend_fds, char **demux_devs, unsigned int count, struct scan_params *params, unsigned int interval);
+
+#endif
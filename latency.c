@@ -0,0 +1,151 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "latency.h"
+
+static char *latency_phase_names[latency_phase_count] = {
+	"voltage",
+	"tone",
+	"tune",
+	"signal",
+	"carrier",
+	"viterbi",
+	"sync",
+	"lock",
+	"probe",
+};
+
+uint64_t latency_now() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned int latency_bucket(unsigned int usec) {
+
+	if (usec < 2 * LATENCY_SUB_BUCKETS)
+		return usec;
+
+	unsigned int msb = 31 - __builtin_clz(usec);
+	unsigned int shift = msb - LATENCY_SUB_BITS;
+
+	return 2 * LATENCY_SUB_BUCKETS + (shift - 1) * LATENCY_SUB_BUCKETS + (usec >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+static unsigned int latency_bucket_value(unsigned int bucket) {
+
+	// Upper bound of the bucket
+	if (bucket < 2 * LATENCY_SUB_BUCKETS)
+		return bucket;
+
+	bucket -= 2 * LATENCY_SUB_BUCKETS;
+	unsigned int shift = bucket / LATENCY_SUB_BUCKETS + 1;
+	unsigned int sub = bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+void latency_record(struct latency *l, enum latency_phase phase, unsigned int usec) {
+
+	struct latency_histogram *h = &l->phases[phase];
+
+	h->counts[latency_bucket(usec)]++;
+	if (!h->count || usec < h->min)
+		h->min = usec;
+	if (usec > h->max)
+		h->max = usec;
+	h->count++;
+	h->total += usec;
+}
+
+unsigned int latency_percentile(struct latency_histogram *h, double percentile) {
+
+	if (!h->count)
+		return 0;
+
+	uint64_t target = (uint64_t) (h->count * percentile / 100.0 + 0.5);
+	if (!target)
+		target = 1;
+
+	uint64_t seen = 0;
+	unsigned int i;
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen >= target) {
+			unsigned int value = latency_bucket_value(i);
+			return (value > h->max ? h->max : value);
+		}
+	}
+
+	return h->max;
+}
+
+void latency_print(struct latency *l) {
+
+	printf("\nLatency (ms)     count      min      p50      p90      p99    p99.9      max     mean\n");
+
+	int i;
+	for (i = 0; i < latency_phase_count; i++) {
+		struct latency_histogram *h = &l->phases[i];
+		if (!h->count) {
+			printf("%-10s %11u\n", latency_phase_names[i], 0);
+			continue;
+		}
+
+		printf("%-10s %11llu %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", latency_phase_names[i], (unsigned long long) h->count,
+			h->min / 1000.0, latency_percentile(h, 50) / 1000.0, latency_percentile(h, 90) / 1000.0,
+			latency_percentile(h, 99) / 1000.0, latency_percentile(h, 99.9) / 1000.0, h->max / 1000.0,
+			(double) h->total / h->count / 1000.0);
+	}
+
+	// Coarse distribution of the time to lock, one line per power of two
+	struct latency_histogram *h = &l->phases[latency_phase_lock];
+	if (!h->count)
+		return;
+
+	printf("\nTime to lock distribution :\n");
+	uint64_t max_count = 0, counts[32] = { 0 };
+	int j, first = -1, last = 0;
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		if (!h->counts[i])
+			continue;
+		unsigned int value = latency_bucket_value(i);
+		j = (value ? 31 - __builtin_clz(value) : 0);
+		counts[j] += h->counts[i];
+		if (counts[j] > max_count)
+			max_count = counts[j];
+		if (first < 0)
+			first = j;
+		last = j;
+	}
+
+	for (j = first; j <= last; j++) {
+		char bar[51] = { 0 };
+		int len = counts[j] * 50 / max_count, k;
+		for (k = 0; k < len; k++)
+			bar[k] = '#';
+		printf(" < %9.1f ms %8llu %s\n", (2ULL << j) / 1000.0, (unsigned long long) counts[j], bar);
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdint.h>
+
+// Log-linear buckets like HDR histograms : values below 2 * LATENCY_SUB_BUCKETS
+// are exact, above that each power of two is split in LATENCY_SUB_BUCKETS
+// buckets which keeps the error under 1 / LATENCY_SUB_BUCKETS
+#define LATENCY_SUB_BITS	4
+#define LATENCY_SUB_BUCKETS	(1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS		(2 * LATENCY_SUB_BUCKETS + (32 - LATENCY_SUB_BITS - 1) * LATENCY_SUB_BUCKETS)
+
+enum latency_phase {
+	latency_phase_voltage,	// Polarity switching
+	latency_phase_tone,	// Band switching
+	latency_phase_tune,	// FE_SET_FRONTEND or FE_SET_PROPERTY
+	latency_phase_signal,	// Time to first status bit after tuning
+	latency_phase_carrier,
+	latency_phase_viterbi,
+	latency_phase_sync,
+	latency_phase_lock,
+	latency_phase_probe,	// Reading the PSI tables to classify a transponder
+	latency_phase_count,
+};
+
+struct latency_histogram {
+	uint64_t counts[LATENCY_BUCKETS];
+	uint64_t count, total;
+	unsigned int min, max; // us
+};
+
+struct latency {
+	struct latency_histogram phases[latency_phase_count];
+};
+
+uint64_t latency_now();
+void latency_record(struct latency *l, enum latency_phase phase, unsigned int usec);
+unsigned int latency_percentile(struct latency_histogram *h, double percentile);
+void latency_print(struct latency *l);
+
+#endif
@@ -20,39 +20,50 @@
 
 
 #include "lnb.h"
+#include <stdio.h>
+#include <string.h>
 
 
-static struct lnb_parameters lnbs[] = {
-	{ "universal", 9750000, 10600000, 11700000, 10700000, 12750000 },
+static struct lnb_parameters lnbs[lnb_type_count] = {
+	{ "universal", { 9750000, 10600000 }, 11700000, 10700000, 12750000, 0 },
+	{ "ku-10750", { 10750000, 10750000 }, 12200000, 11700000, 12200000, 0 },
+	{ "ku-11300", { 11300000, 11300000 }, 12750000, 12250000, 12750000, 0 },
+	{ "c-band", { 5150000, 5150000 }, 4200000, 3400000, 4200000, 1 },
+	{ "wideband-10400", { 10400000, 10400000 }, 12750000, 10700000, 12750000, 0 },
+	{ "wideband-10700", { 10700000, 10700000 }, 12750000, 10950000, 12750000, 0 },
+	{ "custom", { 9750000, 10600000 }, 11700000, 10700000, 12750000, 0 },
 };
 
 int lnb_get_parameters(enum lnb_type type, unsigned int frequency, unsigned int *ifreq, unsigned int *hiband) {
 
-	if (!ifreq || !hiband)
+	if (!ifreq || !hiband || type >= lnb_type_count)
 		return -1;
 
-	*hiband = 0;
-
 	struct lnb_parameters *lnb = &lnbs[type];
 
-	if (frequency > lnb->switch_val)
-		*hiband = 1;
+	// No branches, this is called for every step of a sweep
+	*hiband = (frequency > lnb->switch_val);
+	int offset = (int) frequency - (int) lnb->lo[*hiband];
+	*ifreq = offset * (1 - 2 * lnb->inverted);
 
-	if (*hiband) {
-		*ifreq = frequency - lnb->high_val;
-	} else {
-		if (frequency < lnb->low_val)
-			*ifreq = lnb->low_val - frequency;
-		else
-			*ifreq = frequency - lnb->low_val;
-	}
+	return 0;
+}
+
+int lnb_get_frequency(enum lnb_type type, unsigned int ifreq, unsigned int hiband, unsigned int *frequency) {
+
+	if (!frequency || type >= lnb_type_count)
+		return -1;
+
+	struct lnb_parameters *lnb = &lnbs[type];
+
+	*frequency = lnb->lo[!!hiband] + (int) ifreq * (1 - 2 * lnb->inverted);
 
 	return 0;
 }
 
 int lnb_get_limits(enum lnb_type type, unsigned int *min_freq, unsigned int *max_freq) {
 
-	if (!min_freq || !max_freq)
+	if (!min_freq || !max_freq || type >= lnb_type_count)
 		return -1;
 	
 	*min_freq = lnbs[type].min_freq;
@@ -62,3 +73,80 @@ int lnb_get_limits(enum lnb_type type, unsigned int *min_freq, unsigned int *max
 	
 }
 
+int lnb_get_switch(enum lnb_type type, unsigned int *switch_freq) {
+
+	if (!switch_freq || type >= lnb_type_count)
+		return -1;
+
+	*switch_freq = lnbs[type].switch_val;
+
+	return 0;
+}
+
+int lnb_get_type(char *str, enum lnb_type *type) {
+
+	int i;
+	for (i = 0; i < lnb_type_count; i++) {
+		if (!strcmp(str, lnbs[i].name)) {
+			*type = i;
+			return 0;
+		}
+	}
+
+	// Custom LO values in Mhz : LO or LOW,HIGH,SWITCH
+	unsigned int low, high, switch_freq;
+	int res = sscanf(str, "%u,%u,%u", &low, &high, &switch_freq);
+	if (res == 1)
+		res = lnb_set_custom(low * 1000, low * 1000, 0);
+	else if (res == 3)
+		res = lnb_set_custom(low * 1000, high * 1000, switch_freq * 1000);
+	else
+		return -1;
+
+	if (res)
+		return -1;
+
+	*type = lnb_type_custom;
+
+	return 0;
+}
+
+char *lnb_get_name(enum lnb_type type) {
+
+	if (type >= lnb_type_count)
+		return "unknown";
+
+	return lnbs[type].name;
+}
+
+int lnb_set_custom(unsigned int low, unsigned int high, unsigned int switch_freq) {
+
+	if (!low || high < low)
+		return -1;
+
+	struct lnb_parameters *lnb = &lnbs[lnb_type_custom];
+	lnb->lo[0] = low;
+	lnb->lo[1] = high;
+
+	// Anything below 9 Ghz is C-band with the LO above the signal
+	lnb->inverted = (low < 9000000);
+	if (lnb->inverted) {
+		if (low < LNB_IF_MAX)
+			return -1;
+		lnb->min_freq = low - LNB_IF_MAX;
+		lnb->max_freq = low - LNB_IF_MIN;
+		lnb->lo[1] = low;
+		lnb->switch_val = lnb->max_freq;
+		return 0;
+	}
+
+	lnb->min_freq = low + LNB_IF_MIN;
+	lnb->max_freq = high + LNB_IF_MAX;
+
+	// Single LO, never switch to the high band
+	if (low == high || !switch_freq)
+		switch_freq = lnb->max_freq;
+	lnb->switch_val = switch_freq;
+
+	return 0;
+}
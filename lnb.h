@@ -19,24 +19,40 @@
  */
 
 
+
 #ifndef __LNB_H__
 #define __LNB_H__
 
+#define LNB_IF_MIN	950000	// Usual IF range used to derive the limits of custom LNBs in kHz
+#define LNB_IF_MAX	2150000
+
 enum lnb_type {
-	lnb_type_univeral,
+	lnb_type_universal,	// Ku 9750/10600 Mhz, switching at 11700 Mhz
+	lnb_type_ku_10750,	// Ku single LO
+	lnb_type_ku_11300,	// Ku single LO for the upper part of the band
+	lnb_type_cband,		// C-band 5150 Mhz, the LO is above the signal
+	lnb_type_wideband_10400,	// Wideband, the whole Ku band in one IF
+	lnb_type_wideband_10700,
+	lnb_type_custom,	// Set with lnb_set_custom()
+	lnb_type_count,
 };
 
 struct lnb_parameters {
 	char *name;
-	unsigned int low_val;
-	unsigned int high_val;
-	unsigned int switch_val;
+	unsigned int lo[2]; // Local oscillator of the low and high band in kHz
+	unsigned int switch_val; // Last frequency of the low band
 	unsigned int min_freq;
 	unsigned int max_freq;
+	int inverted; // IF = LO - frequency
 };
 
 int lnb_get_parameters(enum lnb_type type, unsigned int frequency, unsigned int *ifreq, unsigned int *hiband);
 int lnb_get_limits(enum lnb_type, unsigned int *min_freq, unsigned int *max_freq);
+int lnb_get_frequency(enum lnb_type type, unsigned int ifreq, unsigned int hiband, unsigned int *frequency);
+int lnb_get_switch(enum lnb_type type, unsigned int *switch_freq);
+int lnb_get_type(char *str, enum lnb_type *type);
+char *lnb_get_name(enum lnb_type type);
+int lnb_set_custom(unsigned int low, unsigned int high, unsigned int switch_freq);
 
 
 
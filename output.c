@@ -0,0 +1,223 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "output.h"
+
+// The scan threads only copy formatted records in a ring buffer, a
+// separate thread writes them out so a slow consumer never stalls the scan
+
+static void output_discard(struct output *out) {
+
+	// Called with the lock held, count the records that won't make it
+	unsigned int i;
+	for (i = 0; i < out->len; i++) {
+		if (out->buff[(out->head + i) % OUTPUT_BUFF_SIZE] == '\n')
+			out->dropped++;
+	}
+	out->head = 0;
+	out->len = 0;
+}
+
+static void *output_thread(void *arg) {
+
+	struct output *out = arg;
+	struct pollfd pfd = { out->fd, POLLOUT, 0 };
+
+	pthread_mutex_lock(&out->lock);
+	while (1) {
+		while (!out->len && !out->stop)
+			pthread_cond_wait(&out->cond, &out->lock);
+
+		if (!out->len)
+			break;
+
+		// Don't wait forever on a reader that stopped reading
+		if (out->failed || (out->stop && time(NULL) >= out->deadline)) {
+			output_discard(out);
+			continue;
+		}
+
+		// Write the contiguous part, the producers only touch the free space.
+		// No more than a pipe takes at once so the write never blocks.
+		unsigned int head = out->head;
+		unsigned int len = out->len;
+		if (head + len > OUTPUT_BUFF_SIZE)
+			len = OUTPUT_BUFF_SIZE - head;
+		if (len > PIPE_BUF)
+			len = PIPE_BUF;
+		pthread_mutex_unlock(&out->lock);
+
+		ssize_t res = 0;
+		int ready = poll(&pfd, 1, OUTPUT_POLL);
+		if (ready > 0)
+			res = write(out->fd, out->buff + head, len);
+		int err = ((ready < 0 || res < 0) && errno != EINTR ? errno : 0);
+
+		pthread_mutex_lock(&out->lock);
+		if (err) {
+			// Most likely the reader went away, keep scanning without it
+			printf("Error while writing the output : %s\n", strerror(err));
+			out->failed = 1;
+			continue;
+		}
+		if (res > 0) {
+			out->head = (out->head + res) % OUTPUT_BUFF_SIZE;
+			out->len -= res;
+		}
+	}
+	pthread_mutex_unlock(&out->lock);
+
+	return NULL;
+}
+
+int output_open(struct output *out, char *filename, enum output_format format) {
+
+	memset(out, 0, sizeof(struct output));
+	out->format = format;
+
+	if (!strcmp(filename, "-")) {
+		// Our own descriptor, the caller may point stdout elsewhere afterwards
+		out->fd = dup(STDOUT_FILENO);
+		if (out->fd == -1) {
+			perror("Error while duplicating stdout");
+			return -1;
+		}
+	} else {
+		out->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (out->fd == -1) {
+			perror("Error while opening the output file");
+			return -1;
+		}
+	}
+
+	out->buff = malloc(OUTPUT_BUFF_SIZE);
+	if (!out->buff) {
+		perror("Not enough memory");
+		goto err;
+	}
+
+	pthread_mutex_init(&out->lock, NULL);
+	pthread_cond_init(&out->cond, NULL);
+
+	if (format == output_format_csv) {
+		char *header = "time,frequency,polarity,band,symbol_rate,status,lock,tune_time,strength,snr\n";
+		unsigned int len = strlen(header);
+		memcpy(out->buff, header, len);
+		out->len = len;
+	}
+
+	if (pthread_create(&out->thread, NULL, output_thread, out)) {
+		perror("Error while creating output thread");
+		pthread_mutex_destroy(&out->lock);
+		pthread_cond_destroy(&out->cond);
+		free(out->buff);
+		goto err;
+	}
+
+	return 0;
+
+err:
+	close(out->fd);
+	return -1;
+}
+
+int output_record(struct output *out, struct output_record *rec) {
+
+	char line[OUTPUT_LINE_LEN];
+	int len;
+
+	int lock = !!(rec->status & FE_HAS_LOCK);
+	char polarity = (rec->polarity ? 'V' : 'H');
+	char *band = (rec->hiband ? "high" : "low");
+
+	if (out->format == output_format_csv)
+		len = snprintf(line, sizeof(line), "%ld.%03ld,%u,%c,%s,%u,%u,%u,%u,%u,%u\n",
+			(long) rec->time.tv_sec, (long) rec->time.tv_usec / 1000, rec->freq, polarity, band, rec->symbol_rate,
+			rec->status, lock, rec->tune_time, rec->strength, rec->snr);
+	else
+		len = snprintf(line, sizeof(line), "{\"time\":%ld.%03ld,\"frequency\":%u,\"polarity\":\"%c\",\"band\":\"%s\",\"symbol_rate\":%u,"
+			"\"status\":%u,\"lock\":%s,\"tune_time\":%u,\"strength\":%u,\"snr\":%u}\n",
+			(long) rec->time.tv_sec, (long) rec->time.tv_usec / 1000, rec->freq, polarity, band, rec->symbol_rate,
+			rec->status, (lock ? "true" : "false"), rec->tune_time, rec->strength, rec->snr);
+
+	if (len < 0 || (size_t) len >= sizeof(line))
+		return -1;
+
+	pthread_mutex_lock(&out->lock);
+
+	if (out->failed || out->len + len > OUTPUT_BUFF_SIZE) {
+		out->dropped++;
+		pthread_mutex_unlock(&out->lock);
+		return 0;
+	}
+
+	unsigned int tail = (out->head + out->len) % OUTPUT_BUFF_SIZE;
+	unsigned int first = len;
+	if (tail + first > OUTPUT_BUFF_SIZE)
+		first = OUTPUT_BUFF_SIZE - tail;
+	memcpy(out->buff + tail, line, first);
+	memcpy(out->buff, line + first, len - first);
+	out->len += len;
+
+	pthread_cond_signal(&out->cond);
+	pthread_mutex_unlock(&out->lock);
+
+	return 0;
+}
+
+int output_close(struct output *out) {
+
+	// Let the thread flush what's left
+	pthread_mutex_lock(&out->lock);
+	out->stop = 1;
+	out->deadline = time(NULL) + OUTPUT_CLOSE_TIMEOUT;
+	pthread_cond_signal(&out->cond);
+	pthread_mutex_unlock(&out->lock);
+
+	pthread_join(out->thread, NULL);
+
+	int res = 0;
+	if (out->failed) {
+		printf("Output failed, %u records were dropped\n", out->dropped);
+		res = -1;
+	} else if (out->dropped) {
+		printf("Output was too slow, %u records were dropped\n", out->dropped);
+	}
+
+	pthread_mutex_destroy(&out->lock);
+	pthread_cond_destroy(&out->cond);
+	free(out->buff);
+
+	if (close(out->fd)) {
+		perror("Error while closing the output file");
+		return -1;
+	}
+
+	return res;
+}
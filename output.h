@@ -0,0 +1,72 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <linux/dvb/frontend.h>
+
+#define OUTPUT_BUFF_SIZE	(1024 * 1024)	// Records are dropped rather than blocking when it's full
+#define OUTPUT_LINE_LEN		256
+#define OUTPUT_POLL		500	// Interval at which a stalled writer checks for close in ms
+#define OUTPUT_CLOSE_TIMEOUT	5	// Time left to a stalled reader to take the remaining records on close in seconds
+
+enum output_format {
+	output_format_json,	// One JSON object per line
+	output_format_csv,
+};
+
+struct output_record {
+	struct timeval time;
+	unsigned int freq; // kHz
+	int polarity;
+	unsigned int hiband;
+	unsigned int symbol_rate; // Sym/s
+	fe_status_t status;
+	unsigned int tune_time; // ms until lock or timeout
+	unsigned int strength, snr;
+};
+
+struct output {
+	int fd;
+	enum output_format format;
+
+	char *buff;
+	unsigned int head, len;
+	unsigned int dropped;
+	int failed; // Writing failed, the records are only counted as dropped
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	time_t deadline; // Give up on what's left after that once stopped
+};
+
+int output_open(struct output *out, char *filename, enum output_format format);
+int output_record(struct output *out, struct output_record *rec);
+int output_close(struct output *out);
+
+#endif
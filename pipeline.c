@@ -0,0 +1,221 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "utils.h"
+
+// One reader fills buffers taken from a pool and hands the same buffer to
+// every consumer. Each consumer has its own queue and thread, the buffer
+// goes back to the pool once the last consumer is done with it.
+
+static void pipeline_release(struct pipeline *p, struct pipeline_buffer *buff) {
+
+	// Called with the lock held
+	if (--buff->refs)
+		return;
+
+	buff->next = p->free;
+	p->free = buff;
+	pthread_cond_broadcast(&p->space);
+}
+
+static void *pipeline_thread(void *arg) {
+
+	struct pipeline_consumer *c = arg;
+	struct pipeline *p = c->pipeline;
+
+	pthread_mutex_lock(&p->lock);
+	while (1) {
+		while (!c->len && !p->stop)
+			pthread_cond_wait(&c->cond, &p->lock);
+
+		// Drain the queue before stopping
+		if (!c->len)
+			break;
+
+		struct pipeline_buffer *buff = c->queue[c->head];
+		pthread_mutex_unlock(&p->lock);
+
+		int res = c->process(buff, c->priv);
+
+		pthread_mutex_lock(&p->lock);
+		c->head = (c->head + 1) % PIPELINE_QUEUE_SIZE;
+		c->len--;
+		c->buffers++;
+		c->packets += buff->len / CAPTURE_TS_LEN;
+		if (res)
+			c->errors++;
+		pipeline_release(p, buff);
+
+		// The slot is free, wake up the reader if it waits for it
+		pthread_cond_broadcast(&p->space);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+void pipeline_init(struct pipeline *p) {
+
+	memset(p, 0, sizeof(struct pipeline));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->space, NULL);
+}
+
+int pipeline_add(struct pipeline *p, char *name, enum pipeline_policy policy, pipeline_process_t process, void *priv) {
+
+	if (p->consumer_count >= PIPELINE_MAX_CONSUMERS) {
+		printf("Too many consumers in the pipeline\n");
+		return -1;
+	}
+
+	struct pipeline_consumer *c = &p->consumers[p->consumer_count];
+	memset(c, 0, sizeof(struct pipeline_consumer));
+	c->name = name;
+	c->policy = policy;
+	c->process = process;
+	c->priv = priv;
+	c->pipeline = p;
+	pthread_cond_init(&c->cond, NULL);
+
+	p->consumer_count++;
+
+	dvb_debug("Added consumer %s, %s when full\n", name, (policy == pipeline_policy_drop ? "dropping" : "blocking"));
+
+	return 0;
+}
+
+int pipeline_start(struct pipeline *p) {
+
+	// Enough buffers to fill every queue and still have one to read into
+	unsigned int count = p->consumer_count * PIPELINE_QUEUE_SIZE + 2;
+	p->pool = calloc(count, sizeof(struct pipeline_buffer));
+	if (!p->pool) {
+		perror("Not enough memory");
+		return -1;
+	}
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		p->pool[i].next = p->free;
+		p->free = &p->pool[i];
+	}
+
+	for (i = 0; i < p->consumer_count; i++) {
+		if (pthread_create(&p->consumers[i].thread, NULL, pipeline_thread, &p->consumers[i])) {
+			perror("Error while creating a consumer thread");
+			p->consumer_count = i;
+			pipeline_stop(p);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+struct pipeline_buffer *pipeline_get(struct pipeline *p) {
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->free)
+		pthread_cond_wait(&p->space, &p->lock);
+
+	struct pipeline_buffer *buff = p->free;
+	p->free = buff->next;
+	pthread_mutex_unlock(&p->lock);
+
+	buff->next = NULL;
+	buff->refs = 0;
+	buff->len = 0;
+
+	return buff;
+}
+
+void pipeline_push(struct pipeline *p, struct pipeline_buffer *buff) {
+
+	pthread_mutex_lock(&p->lock);
+
+	// Hold a reference while queuing, the first consumers may be done
+	// with it while waiting for a blocking one
+	buff->refs++;
+
+	if (buff->len)
+		buff->seq = p->seq++;
+
+	// Empty buffers go straight back to the pool
+	unsigned int i;
+	for (i = 0; i < p->consumer_count && buff->len; i++) {
+		struct pipeline_consumer *c = &p->consumers[i];
+
+		if (c->len >= PIPELINE_QUEUE_SIZE) {
+			if (c->policy == pipeline_policy_drop) {
+				c->dropped += buff->len / CAPTURE_TS_LEN;
+				continue;
+			}
+			c->stalls++;
+			while (c->len >= PIPELINE_QUEUE_SIZE)
+				pthread_cond_wait(&p->space, &p->lock);
+		}
+
+		// No copy, all the consumers share the same buffer
+		c->queue[(c->head + c->len) % PIPELINE_QUEUE_SIZE] = buff;
+		c->len++;
+		buff->refs++;
+		pthread_cond_signal(&c->cond);
+	}
+
+	pipeline_release(p, buff);
+
+	pthread_mutex_unlock(&p->lock);
+}
+
+void pipeline_stop(struct pipeline *p) {
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	unsigned int i;
+	for (i = 0; i < p->consumer_count; i++)
+		pthread_cond_signal(&p->consumers[i].cond);
+	pthread_mutex_unlock(&p->lock);
+
+	for (i = 0; i < p->consumer_count; i++) {
+		pthread_join(p->consumers[i].thread, NULL);
+		pthread_cond_destroy(&p->consumers[i].cond);
+	}
+
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->space);
+	free(p->pool);
+	p->pool = NULL;
+	p->free = NULL;
+}
+
+void pipeline_print_stats(struct pipeline *p) {
+
+	unsigned int i;
+	for (i = 0; i < p->consumer_count; i++) {
+		struct pipeline_consumer *c = &p->consumers[i];
+		printf("%-8s : %lu packets, %lu dropped, %lu stalls, %lu errors\n", c->name, c->packets, c->dropped, c->stalls, c->errors);
+	}
+}
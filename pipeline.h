@@ -0,0 +1,97 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "capture.h"
+
+#define PIPELINE_BUFF_PKTS	64	// TS packets in each buffer
+#define PIPELINE_QUEUE_SIZE	32	// Buffers waiting for each consumer
+#define PIPELINE_MAX_CONSUMERS	8
+
+// What happens when a consumer queue is full
+enum pipeline_policy {
+	pipeline_policy_drop,	// The consumer misses the buffer
+	pipeline_policy_block,	// The reader waits, the DVR buffer absorbs the delay
+};
+
+struct pipeline_buffer {
+	unsigned char data[CAPTURE_TS_LEN * PIPELINE_BUFF_PKTS];
+	size_t len;
+	struct timeval ts; // When it was read
+	unsigned long seq; // Increases by one for each buffer, a gap means the consumer missed some
+	unsigned int refs; // Consumers still using it
+	struct pipeline_buffer *next; // In the free list
+};
+
+struct pipeline;
+
+// Called from the consumer thread, the buffer is shared and must not be modified
+typedef int (*pipeline_process_t)(struct pipeline_buffer *buff, void *priv);
+
+struct pipeline_consumer {
+	char *name;
+	enum pipeline_policy policy;
+	pipeline_process_t process;
+	void *priv;
+
+	struct pipeline *pipeline;
+	pthread_t thread;
+	pthread_cond_t cond;
+
+	struct pipeline_buffer *queue[PIPELINE_QUEUE_SIZE];
+	unsigned int head, len;
+
+	// Counters
+	unsigned long buffers, packets; // Processed
+	unsigned long dropped; // Packets missed because the queue was full
+	unsigned long stalls; // Times the reader waited for this consumer
+	unsigned long errors;
+};
+
+struct pipeline {
+	// All the buffers are allocated once
+	struct pipeline_buffer *pool;
+	struct pipeline_buffer *free;
+
+	struct pipeline_consumer consumers[PIPELINE_MAX_CONSUMERS];
+	unsigned int consumer_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t space; // A buffer or a queue slot was released
+	unsigned long seq; // Of the next buffer pushed
+	int stop;
+};
+
+void pipeline_init(struct pipeline *p);
+int pipeline_add(struct pipeline *p, char *name, enum pipeline_policy policy, pipeline_process_t process, void *priv);
+int pipeline_start(struct pipeline *p);
+struct pipeline_buffer *pipeline_get(struct pipeline *p);
+void pipeline_push(struct pipeline *p, struct pipeline_buffer *buff);
+void pipeline_stop(struct pipeline *p);
+void pipeline_print_stats(struct pipeline *p);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "diseqc.h"
+#include "planner.h"
+#include "usals.h"
+#include "utils.h"
+
+// Satellites all sit on one arc, so the best visit order is found with a
+// dynamic program over the intervals of satellites sorted by rotor angle :
+// after the first move, the set of visited satellites is always an
+// interval and the dish is at one of its ends. Each move costs its travel
+// plus scan time, times the priority of everything not visited yet. That
+// is exact for the travel time, orders that pass a low priority satellite
+// to come back for it later are not considered.
+
+
+int planner_parse(char *str, struct planner_sat *sats, unsigned int max) {
+
+	// 19.2e or 19.2e:PRIORITY, the position is also the name
+	unsigned int count = 0;
+	char *token, *saveptr = NULL;
+	for (token = strtok_r(str, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+		if (count >= max)
+			return -1;
+
+		struct planner_sat *sat = &sats[count];
+		memset(sat, 0, sizeof(struct planner_sat));
+		sat->name = token;
+		sat->priority = 1.0;
+
+		char *prio = strchr(token, ':');
+		if (prio) {
+			*prio = 0;
+			if (sscanf(prio + 1, "%lf", &sat->priority) != 1 || sat->priority < 0.0)
+				return -1;
+		}
+
+		// sscanf() would take the e for an exponent
+		char *dir;
+		sat->position = strtod(token, &dir);
+		if (dir == token || dir[0] == 0 || dir[1] != 0 || sat->position < 0.0 || sat->position > 180.0)
+			return -1;
+		if (*dir == 'w' || *dir == 'W')
+			sat->position = -sat->position;
+		else if (*dir != 'e' && *dir != 'E')
+			return -1;
+
+		count++;
+	}
+
+	return count;
+}
+
+int planner_angles(struct planner_sat *sats, unsigned int count, double lon, double lat) {
+
+	struct usals_site site;
+	usals_site_init(&site, lon, lat);
+
+	struct usals_table table;
+	if (usals_table_init(&table, &site, USALS_TABLE_STEP))
+		return -1;
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		if (usals_table_angle(&table, sats[i].position, &sats[i].angle)) {
+			printf("Satellite %s is below the horizon\n", sats[i].name);
+			usals_table_cleanup(&table);
+			return -1;
+		}
+	}
+
+	usals_table_cleanup(&table);
+
+	return 0;
+}
+
+static double planner_move(struct positioner *p, double from, double to) {
+
+	return positioner_travel_time(p, (from > to ? from - to : to - from));
+}
+
+static double planner_start(struct positioner *p) {
+
+	// Without a known position, plan from due south
+	return (p->known ? p->angle : 0.0);
+}
+
+int planner_plan(struct planner_sat *sats, unsigned int count, struct positioner *p, double scan_time, unsigned int *order) {
+
+	if (!count)
+		return 0;
+
+	// Sort by angle, west to east
+	unsigned int *sorted = malloc(sizeof(unsigned int) * count);
+	double *cost = malloc(sizeof(double) * count * count * 2);
+	unsigned char *prev = malloc(count * count * 2);
+	if (!sorted || !cost || !prev) {
+		perror("Not enough memory");
+		free(sorted);
+		free(cost);
+		free(prev);
+		return -1;
+	}
+
+	unsigned int i, j, len;
+	for (i = 0; i < count; i++) {
+		for (j = i; j > 0 && sats[sorted[j - 1]].angle > sats[i].angle; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = i;
+	}
+
+	double total = 0.0;
+	for (i = 0; i < count; i++)
+		total += sats[i].priority;
+
+	// cost[(i * count + j) * 2 + side] : best cost having visited i to j, standing at i (side 0) or j (side 1)
+#define PLANNER_COST(i, j, side) cost[((i) * count + (j)) * 2 + (side)]
+#define PLANNER_PREV(i, j, side) prev[((i) * count + (j)) * 2 + (side)]
+#define PLANNER_ANGLE(i) sats[sorted[i]].angle
+
+	double start = planner_start(p);
+	for (i = 0; i < count; i++) {
+		PLANNER_COST(i, i, 0) = PLANNER_COST(i, i, 1) = (planner_move(p, start, PLANNER_ANGLE(i)) + scan_time) * total;
+		PLANNER_PREV(i, i, 0) = PLANNER_PREV(i, i, 1) = 0;
+	}
+
+	for (len = 1; len < count; len++) {
+		for (i = 0; i + len < count; i++) {
+			j = i + len;
+
+			// Priority left to visit before the last move
+			double left = total;
+			unsigned int k;
+			for (k = i; k <= j; k++)
+				left -= sats[sorted[k]].priority;
+
+			// Stand at i, coming from either end of i + 1 .. j
+			double w = left + sats[sorted[i]].priority;
+			double a = PLANNER_COST(i + 1, j, 0) + (planner_move(p, PLANNER_ANGLE(i + 1), PLANNER_ANGLE(i)) + scan_time) * w;
+			double b = PLANNER_COST(i + 1, j, 1) + (planner_move(p, PLANNER_ANGLE(j), PLANNER_ANGLE(i)) + scan_time) * w;
+			PLANNER_COST(i, j, 0) = (a <= b ? a : b);
+			PLANNER_PREV(i, j, 0) = (a <= b ? 0 : 1);
+
+			// Stand at j, coming from either end of i .. j - 1
+			w = left + sats[sorted[j]].priority;
+			a = PLANNER_COST(i, j - 1, 0) + (planner_move(p, PLANNER_ANGLE(i), PLANNER_ANGLE(j)) + scan_time) * w;
+			b = PLANNER_COST(i, j - 1, 1) + (planner_move(p, PLANNER_ANGLE(j - 1), PLANNER_ANGLE(j)) + scan_time) * w;
+			PLANNER_COST(i, j, 1) = (a <= b ? a : b);
+			PLANNER_PREV(i, j, 1) = (a <= b ? 0 : 1);
+		}
+	}
+
+	// Walk back from the cheapest end
+	i = 0;
+	j = count - 1;
+	int side = (PLANNER_COST(i, j, 0) <= PLANNER_COST(i, j, 1) ? 0 : 1);
+	for (len = count; len > 0; len--) {
+		order[len - 1] = sorted[side ? j : i];
+		int from = PLANNER_PREV(i, j, side);
+		if (side)
+			j--;
+		else
+			i++;
+		side = from;
+	}
+
+#undef PLANNER_COST
+#undef PLANNER_PREV
+#undef PLANNER_ANGLE
+
+	free(sorted);
+	free(cost);
+	free(prev);
+
+	return 0;
+}
+
+double planner_travel_time(struct planner_sat *sats, unsigned int *order, unsigned int count, struct positioner *p) {
+
+	double secs = 0.0, cur = planner_start(p);
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		secs += planner_move(p, cur, sats[order[i]].angle);
+		cur = sats[order[i]].angle;
+	}
+
+	return secs;
+}
+
+static int planner_goto(int frontend_fd, struct scan_params *params, struct positioner *p, double angle) {
+
+	if (positioner_is_at(p, angle)) {
+		dvb_debug("Rotor already there\n");
+		return 0;
+	}
+
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len = diseqc_rotor(msg, diseqc_rotor_goto_x, usals_goto_x(angle));
+	double wait = positioner_travel_time(p, positioner_distance(p, angle));
+
+	// Most rotors move faster at 18V
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	diseqc_seq_voltage(&seq, SEC_VOLTAGE_18);
+	diseqc_seq_msg(&seq, msg, len, 0);
+	if (diseqc_seq_run(frontend_fd, &seq))
+		return -1;
+
+	dvb_debug("Waiting %.1f secs for the rotor\n", wait);
+	while (wait > 0.0 && !scan_stopped(params)) {
+		double chunk = (wait > 0.5 ? 0.5 : wait);
+		struct timespec ts = { 0, chunk * 1000000000.0 };
+		nanosleep(&ts, NULL);
+		wait -= chunk;
+	}
+
+	if (scan_stopped(params)) {
+		// Nobody knows where it stopped
+		positioner_lost(p);
+		return 0;
+	}
+
+	positioner_moved(p, angle, POSITIONER_CONF_TIMED);
+
+	return 0;
+}
+
+int planner_run(int *frontend_fds, char **demux_devs, unsigned int count, struct scan_params *params, struct planner_sat *sats, unsigned int sat_count, struct positioner *p) {
+
+	unsigned int order[PLANNER_MAX_SATS], given[PLANNER_MAX_SATS];
+	if (sat_count > PLANNER_MAX_SATS)
+		return -1;
+
+	unsigned int i;
+	for (i = 0; i < sat_count; i++)
+		given[i] = i;
+
+	if (planner_plan(sats, sat_count, p, PLANNER_SCAN_TIME, order))
+		return -1;
+
+	printf("Visiting order :");
+	for (i = 0; i < sat_count; i++)
+		printf(" %s", sats[order[i]].name);
+	printf("\nEstimated rotor movement : %.0f secs instead of %.0f secs in the given order\n", planner_travel_time(sats, order, sat_count, p), planner_travel_time(sats, given, sat_count, p));
+
+	int res = 0;
+	for (i = 0; i < sat_count && !scan_stopped(params); i++) {
+		struct planner_sat *sat = &sats[order[i]];
+
+		printf("Moving to %s, rotor angle %.1f ...\n", sat->name, sat->angle);
+		if (planner_goto(frontend_fds[0], params, p, sat->angle)) {
+			res = -1;
+			break;
+		}
+		if (scan_stopped(params))
+			break;
+
+		// Results of the previous satellite were already printed
+		scan_cleanup(params);
+		params->sat = sat->name;
+		if (scan_parallel(frontend_fds, demux_devs, count, params)) {
+			res = -1;
+			break;
+		}
+	}
+
+	return (scan_stopped(params) ? 0 : res);
+}
@@ -0,0 +1,45 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+#include "positioner.h"
+#include "scan.h"
+
+#define PLANNER_MAX_SATS	64	// Maximum number of satellites to visit
+#define PLANNER_SCAN_TIME	600	// Rough time spent on each satellite in seconds, weighs the priorities against travel
+
+struct planner_sat {
+	char *name; // Used as database key
+	double position; // Orbital position in degrees, east is positive
+	double angle; // Rotor angle for the site
+	double priority; // Higher is visited sooner
+};
+
+int planner_parse(char *str, struct planner_sat *sats, unsigned int max);
+int planner_angles(struct planner_sat *sats, unsigned int count, double lon, double lat);
+int planner_plan(struct planner_sat *sats, unsigned int count, struct positioner *p, double scan_time, unsigned int *order);
+double planner_travel_time(struct planner_sat *sats, unsigned int *order, unsigned int count, struct positioner *p);
+int planner_run(int *frontend_fds, char **demux_devs, unsigned int count, struct scan_params *params, struct planner_sat *sats, unsigned int sat_count, struct positioner *p);
+
+#endif
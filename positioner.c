@@ -0,0 +1,472 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "diseqc.h"
+#include "frontend.h"
+#include "positioner.h"
+#include "utils.h"
+
+void positioner_init(struct positioner *p, double speed) {
+
+	memset(p, 0, sizeof(struct positioner));
+	p->speed = (speed > 0.0 ? speed : POSITIONER_SPEED);
+	p->spinup = POSITIONER_SPINUP;
+	p->slot = -1;
+}
+
+int positioner_parse_angle(char *str, double *angle) {
+
+	// XX.X followed by e or w, sscanf() would take the e for an exponent
+	char *dir;
+	*angle = strtod(str, &dir);
+	if (dir == str || dir[0] == 0 || dir[1] != 0 || *angle < 0.0 || *angle > POSITIONER_MAX_ANGLE)
+		return -1;
+
+	if (*dir == 'w' || *dir == 'W')
+		*angle = -*angle;
+	else if (*dir != 'e' && *dir != 'E')
+		return -1;
+
+	return 0;
+}
+
+double positioner_distance(struct positioner *p, double target) {
+
+	if (p->known)
+		return fabs(target - p->angle);
+
+	// Assume the worst, coming from the other end of the arc
+	return fabs(target) + POSITIONER_MAX_ANGLE;
+}
+
+double positioner_travel_time(struct positioner *p, double distance) {
+
+	if (distance <= 0.0)
+		return 0.0;
+
+	double secs = p->spinup + distance / p->speed;
+
+	return secs * (100 + POSITIONER_MARGIN) / 100;
+}
+
+void positioner_moved(struct positioner *p, double angle, unsigned int confidence) {
+
+	p->angle = angle;
+	p->known = 1;
+	p->slot = -1;
+	p->confidence = confidence;
+	p->updated = time(NULL);
+}
+
+void positioner_moved_slot(struct positioner *p, unsigned int slot, unsigned int confidence) {
+
+	if (slot < POSITIONER_MAX_SLOTS && p->slot_known[slot])
+		positioner_moved(p, p->slots[slot], confidence);
+	else
+		positioner_lost(p);
+
+	// Even without its angle, we know which satellite it points to
+	p->slot = slot;
+	p->confidence = confidence;
+	p->updated = time(NULL);
+}
+
+void positioner_lost(struct positioner *p) {
+
+	p->known = 0;
+	p->slot = -1;
+	p->confidence = 0;
+	p->updated = time(NULL);
+}
+
+unsigned int positioner_confidence(struct positioner *p) {
+
+	// Wind, a manual move or another controller, the older the less we trust it
+	time_t age = time(NULL) - p->updated;
+	unsigned int decay = (age > 0 ? age / 3600 * POSITIONER_DECAY : 0);
+
+	return (decay < p->confidence ? p->confidence - decay : 0);
+}
+
+int positioner_is_at(struct positioner *p, double angle) {
+
+	return (p->known && positioner_confidence(p) >= POSITIONER_TRUST && fabs(angle - p->angle) < POSITIONER_SAME);
+}
+
+int positioner_is_at_slot(struct positioner *p, unsigned int slot) {
+
+	return (p->slot == (int) slot && positioner_confidence(p) >= POSITIONER_TRUST);
+}
+
+void positioner_store_slot(struct positioner *p, unsigned int slot) {
+
+	if (slot >= POSITIONER_MAX_SLOTS)
+		return;
+
+	// The rotor points to it now, whether we know the angle or not
+	p->slot = slot;
+	p->slot_known[slot] = p->known;
+	if (p->known)
+		p->slots[slot] = p->angle;
+}
+
+int positioner_get_slot(struct positioner *p, unsigned int slot, double *angle) {
+
+	if (slot >= POSITIONER_MAX_SLOTS || !p->slot_known[slot])
+		return -1;
+
+	*angle = p->slots[slot];
+
+	return 0;
+}
+
+void positioner_calibrate(struct positioner *p, double distance, double seconds) {
+
+	// Short moves are mostly spin up time and tell nothing about the speed
+	double moving = seconds - p->spinup;
+	if (distance < 1.0 || moving <= 0.0)
+		return;
+
+	// Running average, the first moves count more than the later ones
+	double speed = distance / moving;
+	unsigned int weight = (p->moves < POSITIONER_CALIBRATION ? p->moves : POSITIONER_CALIBRATION);
+	p->speed = (p->speed * weight + speed) / (weight + 1);
+	p->moves++;
+
+	dvb_debug("Measured %.2f deg/s over %.1f deg, rotor speed now %.2f deg/s\n", speed, distance, p->speed);
+}
+
+int positioner_lock(char *filename) {
+
+	// The state file itself is replaced on save, lock a file next to it
+	char lock[PATH_MAX];
+	snprintf(lock, PATH_MAX - 1, "%s.lock", filename);
+
+	int fd = open(lock, O_RDWR | O_CREAT, 0666);
+	if (fd == -1) {
+		perror("Error while opening the rotor lock");
+		return -1;
+	}
+
+	// Only one program moves the dish at a time
+	if (flock(fd, LOCK_EX | LOCK_NB)) {
+		if (errno == EWOULDBLOCK)
+			printf("The rotor is in use by another program\n");
+		else
+			perror("Error while locking the rotor");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+void positioner_unlock(int lock_fd) {
+
+	flock(lock_fd, LOCK_UN);
+	close(lock_fd);
+}
+
+int positioner_load(struct positioner *p, char *filename) {
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		if (errno == ENOENT)
+			return 0; // Nothing known yet
+		perror("Error while opening the rotor state");
+		return -1;
+	}
+
+	char line[256];
+	unsigned int line_num = 0;
+	while (fgets(line, sizeof(line), f)) {
+		line_num++;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		double angle;
+		int slot;
+		unsigned int confidence;
+		long long updated;
+
+		if (line[0] == 'P') {
+			// Current position, the angle is only meaningful when known
+			int known;
+			if (sscanf(line, "P %d %lf %d %u %lld", &known, &angle, &slot, &confidence, &updated) != 5)
+				goto invalid;
+			p->known = known;
+			p->angle = angle;
+			p->slot = (slot >= 0 && slot < POSITIONER_MAX_SLOTS ? slot : -1);
+			p->confidence = confidence;
+			p->updated = updated;
+		} else if (line[0] == 'M') {
+			if (sscanf(line, "M %lf %lf %u", &p->speed, &p->spinup, &p->moves) != 3 || p->speed <= 0.0)
+				goto invalid;
+		} else if (line[0] == 'S') {
+			if (sscanf(line, "S %d %lf", &slot, &angle) != 2 || slot < 0 || slot >= POSITIONER_MAX_SLOTS)
+				goto invalid;
+			p->slots[slot] = angle;
+			p->slot_known[slot] = 1;
+		} else {
+			goto invalid;
+		}
+	}
+
+	fclose(f);
+
+	return 0;
+
+invalid:
+	printf("Invalid line %u in the rotor state %s\n", line_num, filename);
+	fclose(f);
+	return -1;
+}
+
+int positioner_save(struct positioner *p, char *filename) {
+
+	char tmp[PATH_MAX];
+	snprintf(tmp, PATH_MAX - 1, "%s.XXXXXX", filename);
+
+	// Unique name, a fixed one could be a link planted by someone else
+	int fd = mkstemp(tmp);
+	if (fd == -1) {
+		perror("Error while creating the rotor state");
+		return -1;
+	}
+	fchmod(fd, 0644);
+
+	FILE *f = fdopen(fd, "w");
+	if (!f) {
+		perror("Error while opening the rotor state for writing");
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+
+	fprintf(f, "# dvbgyver rotor state\n");
+	fprintf(f, "P %d %.3f %d %u %lld\n", p->known, p->angle, p->slot, p->confidence, (long long) p->updated);
+	fprintf(f, "M %.4f %.3f %u\n", p->speed, p->spinup, p->moves);
+
+	unsigned int i;
+	for (i = 0; i < POSITIONER_MAX_SLOTS; i++) {
+		if (p->slot_known[i])
+			fprintf(f, "S %u %.3f\n", i, p->slots[i]);
+	}
+
+	if (fclose(f)) {
+		perror("Error while writing the rotor state");
+		unlink(tmp);
+		return -1;
+	}
+
+	// Atomically replace the previous version, other tools may be reading it
+	if (rename(tmp, filename)) {
+		perror("Error while renaming the rotor state");
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+static uint64_t positioner_now() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int positioner_wait_lock(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate, double timeout, double *elapsed) {
+
+	// Keep the reference transponder tuned while the dish moves, it is only
+	// there when the dish is because of a lock that holds with a steady SNR
+	uint64_t start = positioner_now(), tuned = 0, now = start;
+	unsigned int snr[POSITIONER_STABLE];
+	unsigned int locked = 0;
+
+	while (now - start < timeout * 1000) {
+
+		if (!locked && now - tuned >= POSITIONER_RETUNE) {
+			if (frontend_tune_dvb_s(frontend_fd, ifreq, symbol_rate))
+				return -1;
+			tuned = now;
+		}
+
+		struct timespec ts = { 0, POSITIONER_POLL * 1000000 };
+		nanosleep(&ts, NULL);
+		now = positioner_now();
+
+		fe_status_t status = 0;
+		if (frontend_read_status(frontend_fd, &status))
+			return -1;
+
+		if (!(status & FE_HAS_LOCK)) {
+			locked = 0;
+			continue;
+		}
+
+		unsigned int strength;
+		if (frontend_get_signal(frontend_fd, &strength, &snr[locked % POSITIONER_STABLE]))
+			return -1;
+
+		if (++locked < POSITIONER_STABLE)
+			continue;
+
+		unsigned int i, min = snr[0], max = snr[0];
+		for (i = 1; i < POSITIONER_STABLE; i++) {
+			if (snr[i] < min)
+				min = snr[i];
+			if (snr[i] > max)
+				max = snr[i];
+		}
+
+		if ((uint64_t) (max - min) * 100 <= (uint64_t) max * POSITIONER_SNR_STEADY) {
+			// Report when the lock started holding, not when we were sure of it
+			*elapsed = (double) (now - start - (POSITIONER_STABLE - 1) * POSITIONER_POLL) / 1000.0;
+			return 0;
+		}
+	}
+
+	*elapsed = (double) (now - start) / 1000.0;
+
+	return 1;
+}
+
+int positioner_step(int frontend_fd, struct positioner *p, int steps, fe_sec_tone_mode_t tone, unsigned int repeat) {
+
+	if (!steps || steps > 127 || steps < -127)
+		return -1;
+
+	// Steps are sent as a negative count, east is positive for us
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int count = (steps > 0 ? steps : -steps);
+	unsigned int len = diseqc_rotor(msg, (steps > 0 ? diseqc_rotor_drive_east : diseqc_rotor_drive_west), 0x100 - count);
+
+	// The tone has to be off while talking to the rotor
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	diseqc_seq_msg(&seq, msg, len, repeat);
+	diseqc_seq_wait(&seq, POSITIONER_STEP_SETTLE * count);
+	diseqc_seq_tone(&seq, tone);
+	if (diseqc_seq_run(frontend_fd, &seq))
+		return -1;
+
+	unsigned int confidence = positioner_confidence(p);
+	if (p->known)
+		positioner_moved(p, p->angle + steps * POSITIONER_STEP, (confidence < POSITIONER_CONF_STEPS ? confidence : POSITIONER_CONF_STEPS));
+	else
+		positioner_lost(p);
+
+	return 0;
+}
+
+static int positioner_sample(int frontend_fd, unsigned int dwell, uint64_t *snr) {
+
+	// Average the SNR over the dwell time, no lock counts as nothing
+	uint64_t total = 0;
+	unsigned int samples = 0;
+	do {
+		struct timespec ts = { 0, POSITIONER_POLL * 1000000 };
+		nanosleep(&ts, NULL);
+
+		fe_status_t status = 0;
+		if (frontend_read_status(frontend_fd, &status))
+			return -1;
+
+		unsigned int strength = 0, cur = 0;
+		if ((status & FE_HAS_LOCK) && frontend_get_signal(frontend_fd, &strength, &cur))
+			return -1;
+
+		total += cur;
+		samples++;
+	} while (samples * POSITIONER_POLL < dwell);
+
+	*snr = total / samples;
+
+	return 0;
+}
+
+int positioner_peak(int frontend_fd, struct positioner *p, fe_sec_tone_mode_t tone, unsigned int dwell, unsigned int repeat, int *offset) {
+
+	// Hill climb one step at a time : go east while it gets better,
+	// otherwise try west, then come back one step from where it dropped
+	uint64_t best = 0, cur = 0;
+	if (positioner_sample(frontend_fd, dwell, &best))
+		return -1;
+
+	dvb_debug("Peaking from SNR %llu\n", (unsigned long long) best);
+
+	int pos = 0, dir = 1, tried_west = 0;
+	while (1) {
+		if (pos + dir > POSITIONER_PEAK_MAX || pos + dir < -POSITIONER_PEAK_MAX) {
+			printf("No peak found within %u steps\n", POSITIONER_PEAK_MAX);
+			break;
+		}
+
+		if (positioner_step(frontend_fd, p, dir, tone, repeat))
+			return -1;
+		pos += dir;
+
+		if (positioner_sample(frontend_fd, dwell, &cur))
+			return -1;
+
+		dvb_debug("Step %+d : SNR %llu\n", pos, (unsigned long long) cur);
+
+		if (cur > best) {
+			best = cur;
+			continue;
+		}
+
+		// Worse, go back to the best position
+		if (positioner_step(frontend_fd, p, -dir, tone, repeat))
+			return -1;
+		pos -= dir;
+
+		// First step east made it worse, try west
+		if (dir > 0 && !pos && !tried_west) {
+			dir = -1;
+			tried_west = 1;
+			continue;
+		}
+
+		break;
+	}
+
+	*offset = pos;
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __POSITIONER_H__
+#define __POSITIONER_H__
+
+#include <time.h>
+#include <linux/dvb/frontend.h>
+
+#define POSITIONER_MAX_ANGLE	80.0	// Mechanical limit on each side in degrees
+#define POSITIONER_SPEED	1.5	// Default speed in degrees per second, most rotors are faster at 18V
+#define POSITIONER_SPINUP	1.0	// Time to start and stop the motor in seconds
+#define POSITIONER_MARGIN	10	// Safety margin added to the predicted travel time in percent
+#define POSITIONER_STEP		0.125	// Angle of a single step in degrees
+#define POSITIONER_MAX_SLOTS	256	// Number of stored satellite positions
+#define POSITIONER_CALIBRATION	8	// Weight of the history when calibrating the speed
+#define POSITIONER_POLL		100	// Status polling interval while moving in ms
+#define POSITIONER_STABLE	5	// Consecutive locked samples needed to consider the move done
+#define POSITIONER_SNR_STEADY	2	// Maximum SNR variation over these samples in percent
+#define POSITIONER_RETUNE	3000	// Time after which the reference transponder is tuned again in ms
+#define POSITIONER_STEP_SETTLE	300	// Time for a single step to complete in ms
+#define POSITIONER_DWELL	500	// Default time to average the SNR over at each step when peaking in ms
+#define POSITIONER_PEAK_MAX	40	// Maximum number of steps away from the start when peaking
+#define POSITIONER_SAME		0.05	// Moves shorter than that in degrees are skipped
+#define POSITIONER_TRUST	50	// Minimum confidence in the current position to skip a move in percent
+#define POSITIONER_DECAY	2	// Confidence lost per hour since the position was reached in percent
+
+// Confidence in the current position depending on how it was reached
+#define POSITIONER_CONF_LOCKED	100	// A transponder of the target satellite locked
+#define POSITIONER_CONF_TIMED	80	// Waited for the predicted travel time
+#define POSITIONER_CONF_STEPS	60	// Moved by steps from a known position
+
+struct positioner {
+	double angle; // Current angle in degrees, east is positive
+	int known; // Whether the current angle is known
+	int slot; // Stored position last gone to, -1 if moved since
+	unsigned int confidence; // In the current angle, percent
+	time_t updated; // When the current angle was reached
+
+	// Calibrated motion model
+	double speed; // Degrees per second
+	double spinup; // Seconds
+	unsigned int moves; // Number of measured moves
+
+	// Angle of the stored satellite positions
+	double slots[POSITIONER_MAX_SLOTS];
+	unsigned char slot_known[POSITIONER_MAX_SLOTS];
+};
+
+void positioner_init(struct positioner *p, double speed);
+int positioner_parse_angle(char *str, double *angle);
+double positioner_distance(struct positioner *p, double target);
+double positioner_travel_time(struct positioner *p, double distance);
+void positioner_moved(struct positioner *p, double angle, unsigned int confidence);
+void positioner_moved_slot(struct positioner *p, unsigned int slot, unsigned int confidence);
+void positioner_lost(struct positioner *p);
+unsigned int positioner_confidence(struct positioner *p);
+int positioner_is_at(struct positioner *p, double angle);
+int positioner_is_at_slot(struct positioner *p, unsigned int slot);
+void positioner_store_slot(struct positioner *p, unsigned int slot);
+int positioner_get_slot(struct positioner *p, unsigned int slot, double *angle);
+void positioner_calibrate(struct positioner *p, double distance, double seconds);
+int positioner_wait_lock(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate, double timeout, double *elapsed);
+int positioner_step(int frontend_fd, struct positioner *p, int steps, fe_sec_tone_mode_t tone, unsigned int repeat);
+int positioner_lock(char *filename);
+void positioner_unlock(int lock_fd);
+int positioner_load(struct positioner *p, char *filename);
+int positioner_save(struct positioner *p, char *filename);
+int positioner_peak(int frontend_fd, struct positioner *p, fe_sec_tone_mode_t tone, unsigned int dwell, unsigned int repeat, int *offset);
+
+#endif
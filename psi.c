@@ -0,0 +1,319 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/dvb/dmx.h>
+
+#include "psi.h"
+#include "utils.h"
+
+static int psi_filter_open(char *demux, unsigned int pid, unsigned int table_id, int program) {
+
+	int fd = open(demux, O_RDWR | O_NONBLOCK);
+	if (fd == -1) {
+		perror("Error while opening the demux");
+		return -1;
+	}
+
+	struct dmx_sct_filter_params filter = {0};
+	filter.pid = pid;
+	filter.filter.filter[0] = table_id;
+	filter.filter.mask[0] = 0xff;
+	if (program >= 0) {
+		// Bytes 1 and 2 of the filter match the table id extension
+		filter.filter.filter[1] = program >> 8;
+		filter.filter.mask[1] = 0xff;
+		filter.filter.filter[2] = program & 0xff;
+		filter.filter.mask[2] = 0xff;
+	}
+	filter.flags = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
+
+	if (ioctl(fd, DMX_SET_FILTER, &filter)) {
+		perror("Error while setting demux filter");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static unsigned int psi_section_len(unsigned char *buf, int len) {
+
+	if (len < 12)
+		return 0;
+
+	unsigned int section_len = ((buf[1] & 0x0f) << 8) | buf[2];
+	if (section_len + 3 > len || section_len < 9)
+		return 0;
+
+	// Don't include the CRC
+	return section_len + 3 - 4;
+}
+
+static int psi_parse_pat(unsigned char *buf, int len, struct psi_info *info) {
+
+	unsigned int end = psi_section_len(buf, len);
+	if (!end)
+		return -1;
+
+	unsigned int pos;
+	for (pos = 8; pos + 4 <= end; pos += 4) {
+		unsigned int number = (buf[pos] << 8) | buf[pos + 1];
+		unsigned int pid = ((buf[pos + 2] & 0x1f) << 8) | buf[pos + 3];
+		if (!number) // NIT
+			continue;
+		if (info->program_count >= PSI_MAX_PROGRAMS)
+			break;
+		struct psi_program *prog = &info->programs[info->program_count++];
+		prog->number = number;
+		prog->pmt_pid = pid;
+	}
+
+	info->has_pat = 1;
+
+	return 0;
+}
+
+static int psi_parse_pmt(unsigned char *buf, int len, struct psi_program *prog) {
+
+	unsigned int end = psi_section_len(buf, len);
+	if (!end)
+		return -1;
+
+	unsigned int pos = 12 + (((buf[10] & 0x0f) << 8) | buf[11]);
+	while (pos + 5 <= end) {
+		unsigned int pid = ((buf[pos + 1] & 0x1f) << 8) | buf[pos + 2];
+		unsigned int es_info_len = ((buf[pos + 3] & 0x0f) << 8) | buf[pos + 4];
+
+		prog->es_count++;
+		// Very low PIDs up to the defaults of most contribution encoders
+		if (pid <= 0x102)
+			prog->low_pid_count++;
+
+		pos += 5 + es_info_len;
+	}
+
+	prog->has_pmt = 1;
+
+	return 0;
+}
+
+static int psi_parse_sdt(unsigned char *buf, int len, struct psi_info *info, unsigned char *seen) {
+
+	unsigned int end = psi_section_len(buf, len);
+	if (!end)
+		return -1;
+
+	unsigned int section = buf[6], last_section = buf[7];
+	if (seen[section])
+		goto done;
+	seen[section] = 1;
+
+	unsigned int pos = 11;
+	while (pos + 5 <= end) {
+		unsigned int desc_len = ((buf[pos + 3] & 0x0f) << 8) | buf[pos + 4];
+		unsigned int desc = pos + 5, desc_end = desc + desc_len;
+		if (desc_end > end)
+			break;
+
+		info->sdt_services++;
+
+		// Look for a service descriptor with a name
+		while (desc + 2 <= desc_end) {
+			unsigned int tag = buf[desc], tag_len = buf[desc + 1];
+			if (desc + 2 + tag_len > desc_end)
+				break; // Truncated descriptor
+			if (tag == 0x48 && tag_len >= 3) {
+				unsigned int provider_len = buf[desc + 3];
+				if (provider_len + 4 < tag_len + 2 && buf[desc + 4 + provider_len] > 0) {
+					info->named_services++;
+					break;
+				}
+			}
+			desc += 2 + tag_len;
+		}
+
+		pos = desc_end;
+	}
+
+done:
+	info->has_sdt = 1;
+
+	// Complete once all the sections were received
+	unsigned int i;
+	for (i = 0; i <= last_section; i++) {
+		if (!seen[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+static unsigned int psi_elapsed(struct timespec *start) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+int psi_probe(char *demux, unsigned int budget, struct psi_info *info) {
+
+	memset(info, 0, sizeof(struct psi_info));
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int pat_fd = psi_filter_open(demux, PSI_PID_PAT, PSI_TABLE_PAT, -1);
+	if (pat_fd == -1)
+		return -1;
+
+	int sdt_fd = psi_filter_open(demux, PSI_PID_SDT, PSI_TABLE_SDT, -1);
+	if (sdt_fd == -1) {
+		close(pat_fd);
+		return -1;
+	}
+
+	int pmt_fds[PSI_MAX_PROGRAMS];
+	unsigned int i;
+	for (i = 0; i < PSI_MAX_PROGRAMS; i++)
+		pmt_fds[i] = -1;
+
+	unsigned char sdt_seen[256] = { 0 };
+	unsigned char buf[PSI_SECTION_LEN];
+	unsigned int elapsed;
+
+	while ((elapsed = psi_elapsed(&start)) < budget) {
+
+		struct pollfd pfds[PSI_MAX_PROGRAMS + 2];
+		int *fds[PSI_MAX_PROGRAMS + 2];
+		unsigned int count = 0;
+
+		if (pat_fd != -1) {
+			fds[count] = &pat_fd;
+			pfds[count++].fd = pat_fd;
+		}
+		if (sdt_fd != -1) {
+			fds[count] = &sdt_fd;
+			pfds[count++].fd = sdt_fd;
+		}
+		for (i = 0; i < info->program_count; i++) {
+			if (pmt_fds[i] == -1)
+				continue;
+			fds[count] = &pmt_fds[i];
+			pfds[count++].fd = pmt_fds[i];
+		}
+
+		if (!count) // Got everything
+			break;
+
+		for (i = 0; i < count; i++)
+			pfds[i].events = POLLIN;
+
+		int res = poll(pfds, count, budget - elapsed);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("Error while polling the demux");
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (!(pfds[i].revents & (POLLIN | POLLERR)))
+				continue;
+
+			int *fd = fds[i];
+			int len = read(*fd, buf, sizeof(buf));
+			if (len <= 0) // CRC or overflow error, wait for the next one
+				continue;
+
+			int done = 1;
+			if (fd == &pat_fd) {
+				if (psi_parse_pat(buf, len, info))
+					continue;
+				// Now we know which PMTs to look for
+				unsigned int j;
+				for (j = 0; j < info->program_count; j++)
+					pmt_fds[j] = psi_filter_open(demux, info->programs[j].pmt_pid, PSI_TABLE_PMT, info->programs[j].number);
+			} else if (fd == &sdt_fd) {
+				done = psi_parse_sdt(buf, len, info, sdt_seen);
+				if (done < 0)
+					continue;
+			} else {
+				if (psi_parse_pmt(buf, len, &info->programs[fd - pmt_fds]))
+					continue;
+			}
+
+			if (done) {
+				close(*fd);
+				*fd = -1;
+			}
+		}
+	}
+
+	if (pat_fd != -1)
+		close(pat_fd);
+	if (sdt_fd != -1)
+		close(sdt_fd);
+	for (i = 0; i < PSI_MAX_PROGRAMS; i++) {
+		if (pmt_fds[i] != -1)
+			close(pmt_fds[i]);
+	}
+
+	dvb_debug("PSI probe done in %u ms : %u programs, %s, %u named services\n", psi_elapsed(&start), info->program_count, (info->has_sdt ? "SDT" : "no SDT"), info->named_services);
+
+	psi_is_feed(info);
+
+	return 0;
+}
+
+int psi_is_feed(struct psi_info *info) {
+
+	// Without a PAT we can't tell anything
+	info->feed_score = 0;
+	if (!info->has_pat)
+		return 0;
+
+	// Feeds usually don't bother describing their services
+	if (!info->has_sdt)
+		info->feed_score += 2;
+	else if (!info->named_services)
+		info->feed_score++;
+
+	if (info->program_count <= 2)
+		info->feed_score++;
+
+	unsigned int i;
+	for (i = 0; i < info->program_count; i++) {
+		if (info->programs[i].low_pid_count) {
+			info->feed_score++;
+			break;
+		}
+	}
+
+	return (info->feed_score >= PSI_FEED_SCORE);
+}
@@ -0,0 +1,58 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __PSI_H__
+#define __PSI_H__
+
+#define PSI_MAX_PROGRAMS	32
+#define PSI_SECTION_LEN		4096
+
+#define PSI_PID_PAT		0x0
+#define PSI_PID_SDT		0x11
+
+#define PSI_TABLE_PAT		0x00
+#define PSI_TABLE_PMT		0x02
+#define PSI_TABLE_SDT		0x42
+
+#define PSI_FEED_SCORE		3	// Minimum score for a mux to look like a feed
+
+struct psi_program {
+	unsigned int number;
+	unsigned int pmt_pid;
+	int has_pmt;
+	unsigned int es_count;
+	unsigned int low_pid_count; // Elementary streams on PIDs typical of encoder defaults
+};
+
+struct psi_info {
+	int has_pat;
+	int has_sdt;
+	unsigned int program_count;
+	struct psi_program programs[PSI_MAX_PROGRAMS];
+	unsigned int sdt_services; // Services described in the SDT
+	unsigned int named_services; // Services with a name in the SDT
+	unsigned int feed_score;
+};
+
+int psi_probe(char *demux, unsigned int budget, struct psi_info *info);
+int psi_is_feed(struct psi_info *info);
+
+#endif
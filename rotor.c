@@ -11,20 +11,36 @@
 #include <getopt.h>
 #include <limits.h>
 #include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "diseqc.h"
+#include "frontend.h"
+#include "lnb.h"
+#include "positioner.h"
+#include "usals.h"
 
 #define PID_FULL_TS 0x2000
 
+static volatile sig_atomic_t interrupted = 0;
+
 void sighandler(int signum) {
 
 	if (signum == SIGINT) {
-		// Send SIGCONT to wake up sleep();
-		raise(SIGCONT);
+		// Wakes up rotor_wait()
+		interrupted = 1;
 		printf("Signal received.\n");
 		return;
 	}
 
 }
 
+static void rotor_wait(double secs) {
+
+	struct timespec ts = { (time_t) secs, (long) ((secs - (time_t) secs) * 1000000000.0) };
+	while (nanosleep(&ts, &ts) && errno == EINTR && !interrupted);
+}
+
 void print_usage(char *app) {
 
 	printf("Usage : %s <options> command\n"
@@ -34,6 +50,15 @@ void print_usage(char *app) {
 		" -f, --frontend=X       Frontend to use\n"
 		" -v, --voltage=<13|18>  Select bus voltage\n"
 		" -t, --timeout=X        Timeout when moving\n"
+		" -w, --wait=X           Extra time to let the rotor power up in ms, default none\n"
+		" -r, --repeat=X         Repeat the command X times for cascaded or unreliable devices\n"
+		" -S, --speed=X          Rotor speed in degrees per second, default 1.5\n"
+		" -F, --from=XX.X<e|w>   Current orientation of the rotor, used to wait only as long as needed\n"
+		" -T, --transponder=F,P,S Transponder of the target satellite at F Mhz, polarity h or v, S kSym/s.\n"
+		"                        Moves are done as soon as it locks steadily, the polarity sets the voltage\n"
+		" -l, --lnb=X            LNB type used to tune the transponder, see feedhunter\n"
+		" -d, --dwell=X          Time to average the SNR over at each step when peaking in ms, default 500\n"
+		" -s, --state=X          Keep track of the rotor position in file X, moves to where it already is are skipped\n"
 		"\n"
 		"Commands are :\n"
 		" limits_off : Disable the rotor soft limits\n"
@@ -45,6 +70,7 @@ void print_usage(char *app) {
 		" goto_sat X : Go to stored satellite X\n"
 		" store_sat X : Store current orientation as satellite X\n"
 		" goto_x XX.X<e|w> : Go to orientation XX.X either east or west\n"
+		" peak [X] : Step around to maximize the SNR of the reference transponder, then store as satellite X\n"
 		"\n"
 		, app);
 
@@ -60,6 +86,16 @@ int main(int argc, char *argv[]) {
 	unsigned int timeout = 180;
 
 	enum fe_sec_voltage voltage = SEC_VOLTAGE_18;
+	unsigned int power_up = 0;
+	unsigned int repeat = 0;
+	double speed = POSITIONER_SPEED;
+	char *from = NULL;
+	unsigned int ref_freq = 0, ref_rate = 0;
+	char ref_pol = 0;
+	enum lnb_type lnb = lnb_type_universal;
+	unsigned int dwell = POSITIONER_DWELL;
+	char *state = NULL;
+	int speed_set = 0;
 
 	while (1) {
 
@@ -68,10 +104,19 @@ int main(int argc, char *argv[]) {
 			{ "frontend", 1, 0, 'f' },
 			{ "timeout", 1, 0, 't' },
 			{ "voltage", 1, 0, 'v' },
+			{ "wait", 1, 0, 'w' },
+			{ "repeat", 1, 0, 'r' },
+			{ "speed", 1, 0, 'S' },
+			{ "from", 1, 0, 'F' },
+			{ "transponder", 1, 0, 'T' },
+			{ "lnb", 1, 0, 'l' },
+			{ "dwell", 1, 0, 'd' },
+			{ "state", 1, 0, 's' },
+			{ 0, 0, 0, 0 },
 
 		};
 
-		char *args = "a:f:t:v:";
+		char *args = "a:f:t:v:w:r:S:F:T:l:d:s:";
 
 		int c = getopt_long(argc, argv, args, long_options, NULL);
 
@@ -111,6 +156,55 @@ int main(int argc, char *argv[]) {
 					return 1;
 				}
 				break;
+			case 'w':
+				if (sscanf(optarg, "%u", &power_up) != 1) {
+					printf("Invalid power up time \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'r':
+				if (sscanf(optarg, "%u", &repeat) != 1) {
+					printf("Invalid repeat count \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'S':
+				if (sscanf(optarg, "%lf", &speed) != 1 || speed <= 0.0) {
+					printf("Invalid speed \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				speed_set = 1;
+				break;
+			case 'F':
+				from = optarg;
+				break;
+			case 'T':
+				if (sscanf(optarg, "%u,%c,%u", &ref_freq, &ref_pol, &ref_rate) != 3 || (ref_pol != 'h' && ref_pol != 'v') || !ref_freq || !ref_rate) {
+					printf("Invalid transponder \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'l':
+				if (lnb_get_type(optarg, &lnb)) {
+					printf("Invalid LNB \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				state = optarg;
+				break;
+			case 'd':
+				if (sscanf(optarg, "%u", &dwell) != 1 || !dwell) {
+					printf("Invalid dwell time \"%s\"\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
 			default:
 				print_usage(argv[0]);
 				return 1;
@@ -123,31 +217,50 @@ int main(int argc, char *argv[]) {
 		print_usage(argv[0]);
 		return 1;
 	}
+	struct positioner model;
+	positioner_init(&model, speed);
+	// Held until we exit, closing the descriptor drops it
+	if (state && positioner_lock(state) == -1)
+		return 1;
+	if (state && positioner_load(&model, state))
+		return 1;
+	if (speed_set)
+		model.speed = speed;
+	if (from) {
+		double angle;
+		if (positioner_parse_angle(from, &angle)) {
+			printf("Invalid orientation \"%s\"\n", from);
+			print_usage(argv[0]);
+			return 1;
+		}
+		positioner_moved(&model, angle, POSITIONER_CONF_TIMED);
+	}
+
 	char *action = argv[optind];
-	struct dvb_diseqc_master_cmd *cmd = NULL;
+	double distance = 0.0; // Angle to travel when known
+	double target = 0.0;
+	int target_known = 0;
+	int peak = 0, store = -1;
+
+	// How the command changes the rotor position
+	int goto_slot = -1, steps_moved = 0, lost = 0;
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len = 0;
 	unsigned int cmd_timeout = 0; // Default no timeout
 	int do_stop = 0;
 
-	static struct dvb_diseqc_master_cmd stop_cmd = { { 0xe0, 0x31, 0x60, 0x00, 0x00, 0x00 }, 3 };
 	if (!strcmp(action, "stop")) {
-		cmd = &stop_cmd;
+		len = diseqc_rotor(msg, diseqc_rotor_stop, 0);
+		lost = 1; // It may have been moving
 	} else if (!strcmp(action, "limits_off")) {
-		static struct dvb_diseqc_master_cmd limits_off_cmd = { { 0xe0, 0x31, 0x63, 0x00, 0x00, 0x00 }, 3 };
-		cmd = &limits_off_cmd;
+		len = diseqc_rotor(msg, diseqc_rotor_limits_off, 0);
 	} else if (!strcmp(action, "limit_set_east")) {
-		static struct dvb_diseqc_master_cmd limit_set_east_cmd = { { 0xe0, 0x31, 0x66, 0x00, 0x00, 0x00 }, 3 };
-		cmd = &limit_set_east_cmd;
+		len = diseqc_rotor(msg, diseqc_rotor_limit_east, 0);
 	} else if (!strcmp(action, "limit_set_west")) {
-		static struct dvb_diseqc_master_cmd limit_set_west_cmd = { { 0xe0, 0x31, 0x67, 0x00, 0x00, 0x00 }, 3 };
-		cmd = &limit_set_west_cmd;
+		len = diseqc_rotor(msg, diseqc_rotor_limit_west, 0);
 	} else if (!strcmp(action, "go_east") || !strcmp(action, "go_west")) {
-		if (!strcmp(action, "go_east")) {
-	 		static struct dvb_diseqc_master_cmd go_east_cmd = { { 0xe0, 0x31, 0x68, 0x00, 0x00, 0x00 }, 4 };
-			cmd = &go_east_cmd;
-		} else {
-		 	static struct dvb_diseqc_master_cmd go_west_cmd = { { 0xe0, 0x31, 0x69, 0x00, 0x00, 0x00 }, 4 };
-			cmd = &go_west_cmd;
-		}
+		enum diseqc_rotor_cmd drive = (!strcmp(action, "go_east") ? diseqc_rotor_drive_east : diseqc_rotor_drive_west);
+		unsigned char arg = 0;
 
 		cmd_timeout = timeout;
 		do_stop = 1; // Force the rotor to stop
@@ -160,16 +273,19 @@ int main(int argc, char *argv[]) {
 					print_usage(argv[0]);
 					return 1;
 				}
-				cmd->msg[3] = timeout;
+				arg = timeout;
+				lost = 1;
 			} else if (!strcmp(argv[optind + 1], "step")) {
 				unsigned char steps;
-				if (sscanf(argv[optind + 2], "%hhu", &steps) != 1 || (!steps && steps > 0x7F)) {
+				if (sscanf(argv[optind + 2], "%hhu", &steps) != 1 || !steps || steps > 0x7F) {
 					printf("Invalid number of steps provided \"%s\"\n", argv[optind + 2]);
 					print_usage(argv[0]);
 					return 1;
 				}
-				cmd->msg[3] = steps | 0x80;
-				cmd_timeout = steps * 30;
+				// Steps are sent as a negative number
+				arg = 0x100 - steps;
+				distance = steps * POSITIONER_STEP;
+				steps_moved = (drive == diseqc_rotor_drive_east ? steps : -steps);
 			} else {
 				printf("Invalid argument \"%s\"\n", argv[optind + 1]);
 				print_usage(argv[0]);
@@ -180,8 +296,12 @@ int main(int argc, char *argv[]) {
 			printf("Incomplete command \"%s %s\"\n", action, argv[optind + 1]);
 			print_usage(argv[0]);
 			return 1;
+		} else {
+			lost = 1;
 		}
 
+		len = diseqc_rotor(msg, drive, arg);
+
 	} else if (!strcmp(action, "store_sat")) {
 		++optind;
 		if (optind >= argc) {
@@ -195,9 +315,8 @@ int main(int argc, char *argv[]) {
 			print_usage(argv[0]);
 			return 1;
 		}
-		static struct dvb_diseqc_master_cmd store_sat_cmd = { { 0xe0, 0x31, 0x6A, 0x00, 0x00, 0x00 }, 4 };
-		store_sat_cmd.msg[3] = pos;
-		cmd = &store_sat_cmd;
+		len = diseqc_rotor(msg, diseqc_rotor_store, pos);
+		store = pos;
 	} else if (!strcmp(action, "goto_sat")) {
 		++optind;
 		if (optind >= argc) {
@@ -211,10 +330,14 @@ int main(int argc, char *argv[]) {
 			print_usage(argv[0]);
 			return 1;
 		}
-		static struct dvb_diseqc_master_cmd goto_sat_cmd = { { 0xe0, 0x31, 0x6B, 0x0, 0x00, 0x00 }, 4 };
-		goto_sat_cmd.msg[3] = pos;
-		cmd = &goto_sat_cmd;
+		len = diseqc_rotor(msg, diseqc_rotor_goto, pos);
 		cmd_timeout = timeout;
+		goto_slot = pos;
+
+		// Without the angle of the slot, assume it is at the end of the arc
+		target = POSITIONER_MAX_ANGLE;
+		target_known = !positioner_get_slot(&model, pos, &target);
+		distance = positioner_distance(&model, target);
 	} else if (!strcmp(action, "goto_x")) {
 		++optind;
 		if (optind >= argc) {
@@ -222,42 +345,34 @@ int main(int argc, char *argv[]) {
 			print_usage(argv[0]);
 			return 1;
 		}
-		double angle;
-		if (sscanf(argv[optind], "%lf", &angle) != 1) {
-			printf("Invalid orientation provided \"%s\"\n", argv[optind]);
+		// Same limits as the daemon and the planner
+		if (positioner_parse_angle(argv[optind], &target)) {
+			printf("Invalid orientation \"%s\", expected XX.X followed by e or w, at most %.0f degrees\n", argv[optind], POSITIONER_MAX_ANGLE);
 			print_usage(argv[0]);
 			return 1;
 		}
-		char *dir = argv[optind] + strlen(argv[optind]) - 1;
-		if (*dir != 'e' && *dir != 'w') {
-			printf("Invalid direction \"%c\"\n", *dir);
-			print_usage(argv[0]);
-			return 1;
+
+		len = diseqc_rotor(msg, diseqc_rotor_goto_x, usals_goto_x(target));
+		cmd_timeout = timeout;
+		distance = positioner_distance(&model, target);
+		target_known = 1;
+	} else if (!strcmp(action, "peak")) {
+		++optind;
+		if (optind < argc) {
+			unsigned char pos;
+			if (sscanf(argv[optind], "%hhu", &pos) != 1) {
+				printf("Invalid position \"%s\"\n", argv[optind]);
+				print_usage(argv[0]);
+				return 1;
+			}
+			store = pos;
 		}
-		if (angle > 90.0) {
-			printf("Angle out of range (0..90) : %f\n", angle);
+		if (!ref_freq) {
+			printf("Peaking needs a reference transponder\n");
 			print_usage(argv[0]);
 			return 1;
 		}
-
-		static struct dvb_diseqc_master_cmd goto_x_cmd = { { 0xe0, 0x31, 0x6E, 0x00, 0x00, 0x00 }, 5 };
-		cmd = &goto_x_cmd;
-
-	
-		if (*dir == 'e') {
-			// east
-			cmd->msg[3] = 0xE0;
-		}
-
-
-		cmd->msg[3] += (unsigned char) (angle / 16.0);
-		// Get the modulo 16
-		cmd->msg[4] += ((unsigned char) (((angle / 16.0) - (int) (angle / 16.0)) * 16)) << 4;
-
-		unsigned char decimal[10] = { 0x00, 0x2, 0x3, 0x5, 0x6, 0x8, 0xA, 0xB, 0xD, 0xE };
-		angle -= (int) angle;
-		cmd->msg[4] += decimal[(unsigned char) (angle * 10)];
-
+		peak = 1;
 		cmd_timeout = timeout;
 	} else {
 		printf("Invalid command provided\n");
@@ -266,69 +381,157 @@ int main(int argc, char *argv[]) {
 	}
 	
 
+	// Pretune a transponder of the target satellite and stop waiting once it locks
+	unsigned int ifreq = 0, hiband = 0;
+	if (ref_freq) {
+		if (do_stop || !cmd_timeout) {
+			printf("The reference transponder is only used with goto_sat, goto_x and peak\n");
+			return 1;
+		}
+		if (lnb_get_parameters(lnb, ref_freq * 1000, &ifreq, &hiband)) {
+			printf("Transponder out of the LNB range\n");
+			return 1;
+		}
+		voltage = (ref_pol == 'v' ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18);
+	}
+
+	if (!peak && ((goto_slot >= 0 && positioner_is_at_slot(&model, goto_slot)) || (goto_slot < 0 && target_known && positioner_is_at(&model, target)))) {
+		printf("The rotor is already there, nothing to do\n");
+		return 0;
+	}
+
 	char frontend_str[NAME_MAX];
 	snprintf(frontend_str, NAME_MAX - 1, "/dev/dvb/adapter%u/frontend%u", adapter, frontend);
 	
 	printf("Opening frontend %s\n", frontend_str);
-	int frontend_fd = open(frontend_str, O_RDWR);
-
-	if (frontend_fd == -1) {
-		printf("Error while opening frontend : %s\n", strerror(errno));
-		goto err;
-	}
+	struct dvb_frontend_info fe_info;
+	int frontend_fd = frontend_open(frontend_str, &fe_info);
 
-	if (ioctl(frontend_fd, FE_SET_TONE, SEC_TONE_OFF)) {
-		printf("Error while turning tone off : %s\n", strerror(errno));
+	if (frontend_fd == -1)
 		goto err;
-	}
 
+	// The sequence enforces the bus quiet times, only wait longer for slow positioners
 	printf("Setting voltage to %uv\n", (voltage == SEC_VOLTAGE_13 ? 13 : 18));
-	if (ioctl(frontend_fd, FE_SET_VOLTAGE, voltage)) {
-		printf("Error while setting voltage : %s\n", strerror(errno));
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	diseqc_seq_voltage(&seq, voltage);
+	if (power_up)
+		diseqc_seq_wait(&seq, power_up);
+	if (len && diseqc_seq_msg(&seq, msg, len, repeat))
 		goto err;
+	if (ref_freq)
+		diseqc_seq_tone(&seq, (hiband ? SEC_TONE_ON : SEC_TONE_OFF));
+
+	if (len) {
+		printf("Sending DiSEqC command : ");
+		int i;
+		for (i = 0; i < len; i++)
+			printf("0x%02X ", msg[i]);
+		printf("\n");
 	}
-
-	printf("Waiting for the rotor to initialize ...\n");
-	sleep(1);
-
-	printf("Sending DiSEqC command : ");
-	int i;
-	for (i = 0; i < cmd->msg_len; i++)
-		printf("0x%02X ", cmd->msg[i]);
-	printf("\n");
 	
-		
-	if (ioctl(frontend_fd, FE_DISEQC_SEND_MASTER_CMD, cmd)) {
-		printf("Error while sending DiSEqC command : %s\n", strerror(errno));
+	if (diseqc_seq_run(frontend_fd, &seq))
 		goto err;
-	}
-	
 
-	if (cmd_timeout) {
-		printf("Waiting for the command to execute (%u secs) ...\n", cmd_timeout);
+	if (ref_freq) {
+		printf("Waiting for a steady lock on %u Mhz %c (up to %u secs) ...\n", ref_freq, ref_pol, cmd_timeout);
+		double elapsed = 0.0;
+		int res = positioner_wait_lock(frontend_fd, ifreq, ref_rate * 1000, cmd_timeout, &elapsed);
+		if (res < 0)
+			goto err;
+		if (res) {
+			printf("No steady lock on the reference transponder after %.1f secs\n", elapsed);
+			goto err;
+		}
+		printf("Move done in %.1f secs\n", elapsed);
+
+		// That was the actual travel time
+		if (model.known && target_known)
+			positioner_calibrate(&model, distance, elapsed);
+
+		if (peak) {
+			int offset = 0;
+			if (positioner_peak(frontend_fd, &model, (hiband ? SEC_TONE_ON : SEC_TONE_OFF), dwell, repeat, &offset))
+				goto err;
+			printf("Peak found %d step(s) %s\n", (offset < 0 ? -offset : offset), (offset < 0 ? "west" : "east"));
+		}
+
+		if (peak && store >= 0) {
+			printf("Storing the position as satellite %u\n", store);
+			len = diseqc_rotor(msg, diseqc_rotor_store, store);
+			diseqc_seq_init(&seq);
+			diseqc_seq_tone(&seq, SEC_TONE_OFF);
+			diseqc_seq_msg(&seq, msg, len, repeat);
+			if (diseqc_seq_run(frontend_fd, &seq))
+				goto err;
+		}
+
+	} else {
+		// Only wait as long as the move should take
+		double wait = cmd_timeout;
+		if (distance > 0.0) {
+			wait = positioner_travel_time(&model, distance);
+			if (cmd_timeout && wait > cmd_timeout)
+				wait = cmd_timeout;
+		}
+
+		if (wait > 0.0) {
+			printf("Waiting for the command to execute (%.1f secs) ...\n", wait);
+			if (do_stop) {
+				// ignore SIGINT so the wait can be interrupted safely
+				signal(SIGINT, sighandler);
+			}
+			rotor_wait(wait);
+		}
+
 		if (do_stop) {
-			// ignore SIGINT so sleep can be interrupted safely
-			signal(SIGINT, sighandler);
+			printf("Stopping rotor\n");
+			len = diseqc_rotor(msg, diseqc_rotor_stop, 0);
+			if (diseqc_send(frontend_fd, msg, len, repeat))
+				goto err;
 		}
-		sleep(cmd_timeout);
 	}
 
-	if (do_stop) {
-		printf("Stopping rotor\n");
-		if (ioctl(frontend_fd, FE_DISEQC_SEND_MASTER_CMD, &stop_cmd)) {
-			printf("Error while sending DiSEqC command : %s\n", strerror(errno));
-			goto err;
-		}
+	frontend_close(frontend_fd);
+
+	// Keep track of where the rotor is for the next runs
+	unsigned int confidence = (ref_freq ? POSITIONER_CONF_LOCKED : POSITIONER_CONF_TIMED);
+	if (lost || interrupted) {
+		positioner_lost(&model);
+	} else if (goto_slot >= 0) {
+		positioner_moved_slot(&model, goto_slot, confidence);
+	} else if (target_known) {
+		positioner_moved(&model, target, confidence);
+	} else if (steps_moved) {
+		confidence = positioner_confidence(&model);
+		if (model.known)
+			positioner_moved(&model, model.angle + steps_moved * POSITIONER_STEP, (confidence < POSITIONER_CONF_STEPS ? confidence : POSITIONER_CONF_STEPS));
+		else
+			positioner_lost(&model);
+	} else if (peak && model.known) {
+		positioner_moved(&model, model.angle, POSITIONER_CONF_LOCKED);
 	}
 
-	close(frontend_fd);
+	if (store >= 0)
+		positioner_store_slot(&model, store);
+
+	if (state && positioner_save(&model, state))
+		return 1;
 
 	return 0;
 
 err:
-	if (frontend_fd != -1)
-		close(frontend_fd);
+	if (frontend_fd == -1)
+		return 1;
+
+	frontend_close(frontend_fd);
+
+	// Whatever was sent, the position is not reliable anymore
+	if (state) {
+		positioner_lost(&model);
+		positioner_save(&model, state);
+	}
 
 	return 1;
 }
-
@@ -19,69 +19,1667 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/time.h>
 
 #include "scan.h"
 #include "frontend.h"
 #include "lnb.h"
 #include "utils.h"
 
-int scan(int frontend_fd, unsigned int timeout, unsigned int start_freq, unsigned int end_freq, unsigned int step) {
+static unsigned int scan_bandwidth(unsigned int symbol_rate) {
+	// Occupied bandwidth in kHz
+	return symbol_rate / 1000 * (100 + SCAN_ROLLOFF) / 100;
+}
+
+static void scan_lock(struct scan_params *p) {
+	if (p->lock)
+		pthread_mutex_lock(p->lock);
+}
+
+static void scan_unlock(struct scan_params *p) {
+	if (p->lock)
+		pthread_mutex_unlock(p->lock);
+}
+
+static int scan_set(int frontend_fd, struct scan_params *p, unsigned int freq, int polarity) {
+
+	unsigned int ifreq = 0, hiband = 0;
+	if (lnb_get_parameters(p->lnb, freq, &ifreq, &hiband)) {
+		printf("Error while getting LNB parameters\n");
+		return -1;
+	}
+
+	dvb_debug("Tuning to %u Mhz, %u MSym/s, %s Polarity ...\n", freq / 1000, p->symbol_rate / 1000, (polarity ? "V" : "H"));
+	uint64_t times[4];
+	times[0] = (p->latency ? latency_now() : 0);
+
+	p->tune_freq = ifreq;
+	if (p->unicable) {
+		// The band and polarity selection all go in one command on the shared bus
+		if (unicable_tune(p->unicable, frontend_fd, ifreq, hiband, polarity, &p->tune_freq))
+			return -1;
+		times[1] = times[2] = (p->latency ? latency_now() : 0);
+	} else if (p->switch_port) {
+		// The switch command carries the polarity and the band as well, it
+		// takes tens of ms so only send it when one of them changes
+		if (!p->switch_sent || p->switch_polarity != polarity || p->switch_hiband != hiband) {
+			p->switch_sent = 0;
+			if (diseqc_switch(frontend_fd, p->switch_port, polarity, hiband, p->switch_repeat))
+				return -1;
+			p->switch_sent = 1;
+			p->switch_polarity = polarity;
+			p->switch_hiband = hiband;
+		}
+		times[1] = times[2] = (p->latency ? latency_now() : 0);
+	} else {
+		// 13V is vertical polarity and 18V is horizontal
+		if (frontend_set_voltage(frontend_fd, (polarity ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18)))
+			return -1;
+		times[1] = (p->latency ? latency_now() : 0);
+
+		if (frontend_set_tone(frontend_fd, (hiband ? SEC_TONE_ON : SEC_TONE_OFF)))
+			return -1;
+		times[2] = (p->latency ? latency_now() : 0);
+	}
+
+	if (p->mode == scan_mode_blind) {
+		if (frontend_tune_dvb_s_auto(frontend_fd, p->tune_freq, p->symbol_rate, p->dvb_s2))
+			return -1;
+	} else if (frontend_tune_dvb_s(frontend_fd, p->tune_freq, p->symbol_rate)) {
+		return -1;
+	}
+
+	if (p->latency) {
+		times[3] = latency_now();
+		scan_lock(p);
+		latency_record(p->latency, latency_phase_voltage, times[1] - times[0]);
+		latency_record(p->latency, latency_phase_tone, times[2] - times[1]);
+		latency_record(p->latency, latency_phase_tune, times[3] - times[2]);
+		scan_unlock(p);
+	}
+
+	return 0;
+}
+
+static int scan_wait(int frontend_fd, struct scan_params *p, fe_status_t *status) {
+
+	if (!p->latency)
+		return frontend_get_status(frontend_fd, p->timeout, status);
+
+	unsigned int first[FRONTEND_STATUS_BITS];
+	if (frontend_get_status_timed(frontend_fd, p->timeout, status, first))
+		return -1;
+
+	scan_lock(p);
+	int i;
+	for (i = 0; i < FRONTEND_STATUS_BITS; i++) {
+		if (first[i] != FRONTEND_STATUS_NEVER)
+			latency_record(p->latency, latency_phase_signal + i, first[i]);
+	}
+	scan_unlock(p);
+
+	return 0;
+}
+
+static int scan_attempt(int frontend_fd, struct scan_params *p, unsigned int freq, int polarity, unsigned int hiband, fe_status_t *status) {
+
+	// Unwind the scan, the caller saves the progress
+	if (scan_stopped(p))
+		return -1;
+
+	p->attempts++;
+
+	if (!p->output)
+		return scan_wait(frontend_fd, p, status);
+
+	struct output_record rec = { 0 };
+	gettimeofday(&rec.time, NULL);
+
+	if (scan_wait(frontend_fd, p, status))
+		return -1;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	rec.hiband = hiband;
+	rec.freq = freq;
+	rec.polarity = polarity;
+	rec.symbol_rate = p->symbol_rate;
+	rec.status = *status;
+	rec.tune_time = (now.tv_sec - rec.time.tv_sec) * 1000 + (now.tv_usec - rec.time.tv_usec) / 1000;
+	if (frontend_get_signal(frontend_fd, &rec.strength, &rec.snr))
+		return -1;
+
+	return output_record(p->output, &rec);
+}
+
+static int scan_tune(int frontend_fd, struct scan_params *p, unsigned int freq, int polarity, fe_status_t *status) {
+
+	unsigned int ifreq = 0, hiband = 0;
+	if (lnb_get_parameters(p->lnb, freq, &ifreq, &hiband)) {
+		printf("Error while getting LNB parameters\n");
+		return -1;
+	}
+
+	if (scan_set(frontend_fd, p, freq, polarity))
+		return -1;
+
+	return scan_attempt(frontend_fd, p, freq, polarity, hiband, status);
+}
+
+static int scan_probe(int frontend_fd, struct scan_params *p, unsigned int freq, int polarity, fe_status_t *status) {
+
+	unsigned int ifreq = 0, hiband = 0;
+	if (lnb_get_parameters(p->lnb, freq, &ifreq, &hiband)) {
+		printf("Error while getting LNB parameters\n");
+		return -1;
+	}
+
+	// Try the symbol rates in order, stop at the first lock
+	struct scan_rate *order = p->rates[hiband];
+	fe_status_t best_status = 0;
+	unsigned int i, best = 0;
+	for (i = 0; i < p->rate_count; i++) {
+		p->symbol_rate = order[i].symbol_rate;
+		if (scan_tune(frontend_fd, p, freq, polarity, status))
+			return -1;
+
+		if (*status & FE_HAS_LOCK)
+			return 0;
+
+		if (*status > best_status) {
+			best_status = *status;
+			best = i;
+		}
+
+		// Nothing there at all, other symbol rates won't help
+		if (!(*status & (FE_HAS_SIGNAL | FE_HAS_CARRIER)))
+			break;
+	}
+
+	// Report the symbol rate that got the furthest
+	p->symbol_rate = order[best].symbol_rate;
+	*status = best_status;
+
+	return 0;
+}
+
+static unsigned int scan_min_rate(struct scan_params *p) {
+
+	unsigned int i, min = p->symbol_rates[0];
+	for (i = 1; i < p->rate_count; i++) {
+		if (p->symbol_rates[i] < min)
+			min = p->symbol_rates[i];
+	}
+
+	return min;
+}
+
+static int scan_rate_hit(struct scan_params *p, unsigned int freq, int polarity) {
+
+	// Only new transponders count, rescans would inflate the known ones
+	if (p->db) {
+		scan_lock(p);
+		struct tpdb_transponder *tp = tpdb_find(p->db, p->sat, freq, polarity, scan_bandwidth(p->symbol_rate) / 2);
+		scan_unlock(p);
+		if (tp)
+			return 0;
+	}
+
+	// Cable only has one list
+	unsigned int ifreq = 0, hiband = 0;
+	if (p->type == FE_QPSK && lnb_get_parameters(p->lnb, freq, &ifreq, &hiband)) {
+		printf("Error while getting LNB parameters\n");
+		return -1;
+	}
+
+	struct scan_rate *order = p->rates[hiband];
+	unsigned int i;
+	for (i = 0; i < p->rate_count && order[i].symbol_rate != p->symbol_rate; i++);
+	if (i >= p->rate_count)
+		return 0;
+
+	// Keep the most successful symbol rates first
+	order[i].hits++;
+	for (; i > 0 && order[i].hits > order[i - 1].hits; i--) {
+		struct scan_rate tmp = order[i - 1];
+		order[i - 1] = order[i];
+		order[i] = tmp;
+	}
+
+	if (!p->db)
+		return 0;
+
+	scan_lock(p);
+	int res = tpdb_rate_hit(p->db, p->sat, hiband, p->symbol_rate, 1);
+	scan_unlock(p);
+
+	return res;
+}
+
+void scan_result_print(struct scan_result *res) {
+
+	if (res->delivery_system == SYS_DVBC_ANNEX_A || res->delivery_system == SYS_DVBT) {
+		printf("Found channel at %u Mhz, %s %s", res->freq / 1000, frontend_delivery_system_str(res->delivery_system), frontend_modulation_str(res->modulation));
+		if (res->symbol_rate)
+			printf(", %u kSym/s", res->symbol_rate / 1000);
+		if (res->services || res->feed)
+			printf(", %u services%s", res->services, (res->feed ? ", feed" : ""));
+		printf("\n");
+		return;
+	}
+
+	printf("Found transponder at %u Mhz, %u kSym/s, %s Polarity", res->freq / 1000, res->symbol_rate / 1000, (res->polarity ? "V" : "H"));
+	if (res->delivery_system != SYS_UNDEFINED)
+		printf(", %s %s %s", frontend_delivery_system_str(res->delivery_system), frontend_modulation_str(res->modulation), frontend_fec_str(res->fec));
+	if (res->services || res->feed)
+		printf(", %u services%s", res->services, (res->feed ? ", feed" : ""));
+	printf("\n");
+}
+
+static int scan_found(int frontend_fd, struct scan_params *p, unsigned int freq, int polarity, struct frontend_tuning *tuning) {
+
+	if (scan_rate_hit(p, freq, polarity))
+		return -1;
+
+	struct scan_result *results = realloc(p->results, sizeof(struct scan_result) * (p->result_count + 1));
+	if (!results) {
+		perror("Not enough memory");
+		return -1;
+	}
+	p->results = results;
+
+	struct scan_result *res = &p->results[p->result_count++];
+	memset(res, 0, sizeof(struct scan_result));
+	res->freq = freq;
+	res->polarity = polarity;
+	res->symbol_rate = p->symbol_rate;
+	if (tuning) {
+		res->delivery_system = tuning->delivery_system;
+		res->modulation = tuning->modulation;
+		res->fec = tuning->fec;
+		res->rolloff = tuning->rolloff;
+	}
+
+	// Refining may have left the frontend on the edge of the transponder
+	fe_status_t status;
+	if (frontend_read_status(frontend_fd, &status))
+		return -1;
+	if (!(status & FE_HAS_LOCK) && p->type == FE_QPSK && scan_tune(frontend_fd, p, freq, polarity, &status))
+		return -1;
+
+	if (frontend_get_signal(frontend_fd, &res->strength, &res->snr))
+		return -1;
+
+	// The demux only sees the transponder the frontend is on, so the probe
+	// can't overlap the next tuning of this frontend. With several
+	// frontends the other workers keep going meanwhile.
+	if (p->classify && p->demux && (status & FE_HAS_LOCK)) {
+		struct psi_info info;
+		uint64_t start = (p->latency ? latency_now() : 0);
+		int probed = psi_probe(p->demux, p->classify, &info);
+		if (p->latency) {
+			uint64_t now = latency_now();
+			scan_lock(p);
+			latency_record(p->latency, latency_phase_probe, now - start);
+			scan_unlock(p);
+		}
+		if (!probed) {
+			res->services = info.program_count;
+			res->feed = psi_is_feed(&info);
+		}
+	}
+
+	p->found++;
+	if (!p->quiet) {
+		if (!dvb_get_verbose())
+			printf("\r");
+		scan_result_print(res);
+	}
+
+	if (!p->db)
+		return 0;
+
+	scan_lock(p);
+	struct tpdb_transponder *tp = tpdb_update(p->db, p->sat, freq, polarity, p->symbol_rate, scan_bandwidth(p->symbol_rate) / 2);
+	if (tp) {
+		tp->strength = res->strength;
+		tp->snr = res->snr;
+		if (p->classify)
+			tp->services = res->services;
+	}
+	scan_unlock(p);
+
+	return (tp ? 0 : -1);
+}
+
+static unsigned int scan_skip(struct scan_params *p, int polarity, unsigned int freq) {
+
+	// Don't sweep again transponders we already found during this scan
+	unsigned int i;
+	for (i = 0; i < p->result_count; i++) {
+		struct scan_result *res = &p->results[i];
+		unsigned int bw = scan_bandwidth(res->symbol_rate);
+		if (res->polarity != polarity || freq + bw / 2 < res->freq || freq > res->freq + bw / 2)
+			continue;
+		return res->freq + bw / 2 + p->step;
+	}
+
+	return freq;
+}
+
+static void scan_sweep_progress(struct scan_params *p, int polarity, unsigned int freq) {
+
+	p->swept = freq;
+
+	if (p->quiet)
+		return;
+
+	unsigned int range = p->end_freq - p->start_freq;
+	scan_progress(polarity * range + freq - p->start_freq, 2 * range);
+}
+
+static int scan_linear(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	unsigned int cur_freq = start;
+
+	while (cur_freq <= end) {
+
+		scan_sweep_progress(p, polarity, cur_freq);
+
+		unsigned int next = scan_skip(p, polarity, cur_freq);
+		if (next != cur_freq) {
+			// Stay on the step grid
+			cur_freq = next + (p->step - (next - start) % p->step) % p->step;
+			continue;
+		}
+
+		fe_status_t status;
+		if (scan_probe(frontend_fd, p, cur_freq, polarity, &status))
+			return -1;
+
+		if ((status & FE_HAS_LOCK) && scan_found(frontend_fd, p, cur_freq, polarity, NULL))
+			return -1;
+
+		cur_freq += p->step;
+	}
+	
+	return 0;
+}
+
+static int scan_edge(int frontend_fd, struct scan_params *p, int polarity, unsigned int in, unsigned int out, unsigned int tolerance, unsigned int *edge) {
+
+	// Bisect between a locked frequency and an unlocked one
+	fe_status_t status;
+	if (scan_tune(frontend_fd, p, out, polarity, &status))
+		return -1;
+
+	if (status & FE_HAS_LOCK) {
+		// Wider than expected, don't look further
+		*edge = out;
+		return 0;
+	}
+
+	while ((in > out ? in - out : out - in) > tolerance) {
+		unsigned int mid = in / 2 + out / 2;
+		if (scan_tune(frontend_fd, p, mid, polarity, &status))
+			return -1;
+		if (status & FE_HAS_LOCK)
+			in = mid;
+		else
+			out = mid;
+	}
+
+	*edge = in;
+	return 0;
+}
+
+static int scan_refine(int frontend_fd, struct scan_params *p, int polarity, unsigned int freq, fe_status_t status, unsigned int coarse, int above, unsigned int *center, unsigned int *upper) {
+
+	unsigned int bw = scan_bandwidth(p->symbol_rate);
+	unsigned int tolerance = bw / 16;
+	if (tolerance < p->step)
+		tolerance = p->step;
+
+	if (!(status & FE_HAS_LOCK)) {
+		// Only a carrier, look for a lock nearby. The symbol rate that got
+		// the carrier isn't necessarily the right one, try them all.
+		// When sweeping up, the previous step already looked below.
+		int around[] = { coarse / 2, -(int)coarse / 2, coarse / 4, -(int)coarse / 4 };
+		int up[] = { coarse / 4, coarse / 2, coarse * 3 / 4 };
+		int *offsets = (above ? up : around);
+		unsigned int i, count = (above ? sizeof(up) : sizeof(around)) / sizeof(int);
+		for (i = 0; i < count; i++) {
+			if (scan_probe(frontend_fd, p, freq + offsets[i], polarity, &status))
+				return -1;
+			if (status & FE_HAS_LOCK)
+				break;
+		}
+		if (!(status & FE_HAS_LOCK))
+			return 0;
+		freq += offsets[i];
+	}
+
+	unsigned int low, high;
+	if (scan_edge(frontend_fd, p, polarity, freq, freq - bw / 2, tolerance, &low))
+		return -1;
+	if (scan_edge(frontend_fd, p, polarity, freq, freq + bw / 2, tolerance, &high))
+		return -1;
+
+	*center = (low + high) / 2;
+	*center = (*center + p->step / 2) / p->step * p->step;
+	if (upper)
+		*upper = high;
+
+	return 1;
+}
+
+static int scan_adaptive(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	// Steps must be small enough for the narrowest transponders
+	unsigned int coarse = scan_bandwidth(scan_min_rate(p)) / SCAN_COARSE_DIV;
+	if (coarse < p->step)
+		coarse = p->step;
+
+	unsigned int cur_freq = start;
+
+	while (cur_freq <= end) {
+
+		scan_sweep_progress(p, polarity, cur_freq);
+
+		unsigned int next = scan_skip(p, polarity, cur_freq);
+		if (next != cur_freq) {
+			cur_freq = next;
+			continue;
+		}
+
+		fe_status_t status;
+		if (scan_probe(frontend_fd, p, cur_freq, polarity, &status))
+			return -1;
+
+		if (!(status & (FE_HAS_CARRIER | FE_HAS_LOCK))) {
+			cur_freq += coarse;
+			continue;
+		}
+
+		unsigned int center = 0, upper = 0;
+		int res = scan_refine(frontend_fd, p, polarity, cur_freq, status, coarse, cur_freq != start, &center, &upper);
+		if (res < 0)
+			return -1;
+
+		if (!res) {
+			cur_freq += coarse;
+			continue;
+		}
+
+		if (scan_found(frontend_fd, p, center, polarity, NULL))
+			return -1;
+
+		// Skip the bandwidth occupied by this transponder
+		next = center + scan_bandwidth(p->symbol_rate) / 2;
+		if (next <= upper)
+			next = upper + p->step;
+		if (next < cur_freq + coarse)
+			next = cur_freq + coarse;
+		cur_freq = next;
+	}
+
+	return 0;
+}
+
+struct scan_sample {
+	unsigned int freq;
+	unsigned int strength, snr;
+};
+
+static int scan_value_compare(const void *a, const void *b) {
+
+	unsigned int va = *(const unsigned int *) a, vb = *(const unsigned int *) b;
+	return (va < vb ? -1 : (va > vb));
+}
+
+static void scan_profile_write(struct scan_params *p, int polarity, unsigned int start, unsigned int end, struct scan_sample *samples, unsigned int count) {
+
+	if (!p->profile)
+		return;
+
+	scan_lock(p);
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		if (samples[i].freq < start || samples[i].freq > end)
+			continue;
+		fprintf(p->profile, "%s,%s,%u,%u,%u\n", (p->sat ? p->sat : ""), (polarity ? "V" : "H"), samples[i].freq, samples[i].strength, samples[i].snr);
+	}
+	fflush(p->profile);
+	scan_unlock(p);
+}
+
+static int scan_peak(int frontend_fd, struct scan_params *p, int polarity, unsigned int freq) {
+
+	fe_status_t status;
+	if (scan_probe(frontend_fd, p, freq, polarity, &status))
+		return -1;
+
+	if (status & FE_HAS_LOCK)
+		return scan_found(frontend_fd, p, freq, polarity, NULL);
+
+	if (!(status & FE_HAS_CARRIER))
+		return 0;
+
+	// Our estimate of the center is off, look around
+	unsigned int coarse = scan_bandwidth(p->symbol_rate) / SCAN_COARSE_DIV;
+	unsigned int center = 0;
+	int res = scan_refine(frontend_fd, p, polarity, freq, status, coarse, 0, &center, NULL);
+	if (res <= 0)
+		return res;
+
+	return scan_found(frontend_fd, p, center, polarity, NULL);
+}
+
+static int scan_presweep(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	// Sample half a bandwidth past each end so transponders on the edges get a full window
+	unsigned int half = scan_bandwidth(scan_min_rate(p)) / p->step / 2;
+	unsigned int lnb_min, lnb_max;
+	if (lnb_get_limits(p->lnb, &lnb_min, &lnb_max)) {
+		printf("Error while getting LNB limits\n");
+		return -1;
+	}
+	unsigned int first = start, last = end;
+	while (first - p->step >= lnb_min && start - first < half * p->step)
+		first -= p->step;
+	while (last + p->step <= lnb_max && last - end < half * p->step)
+		last += p->step;
+
+	unsigned int count = (last - first) / p->step + 1;
+	struct scan_sample *samples = calloc(count, sizeof(struct scan_sample));
+	unsigned int *smooth = calloc(count, sizeof(unsigned int));
+	unsigned int *sorted = calloc(count, sizeof(unsigned int));
+	if (!samples || !smooth || !sorted) {
+		perror("Not enough memory");
+		goto err;
+	}
+
+	// Only read the signal strength at each step
+	p->symbol_rate = p->rates[0][0].symbol_rate;
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		samples[i].freq = first + i * p->step;
+		scan_sweep_progress(p, polarity, samples[i].freq);
+
+		if (scan_set(frontend_fd, p, samples[i].freq, polarity))
+			goto err;
+		p->probes++;
+
+		usleep(p->dwell * 1000);
+
+		if (frontend_get_signal(frontend_fd, &samples[i].strength, &samples[i].snr))
+			goto err;
+	}
+
+	scan_profile_write(p, polarity, start, end, samples, count);
+
+	// Average over the occupied bandwidth so a transponder peaks at its center
+	unsigned long long sum = 0;
+	unsigned int low = 0, high = 0; // Window is [low, high)
+	for (i = 0; i < count; i++) {
+		while (high < count && high <= i + half)
+			sum += samples[high++].strength;
+		while (low + half < i)
+			sum -= samples[low++].strength;
+		// Missing samples past the ends count as no signal
+		smooth[i] = sum / (2 * half + 1);
+	}
+
+	// Transponders can fill most of a short range, take the 10th percentile as noise floor
+	memcpy(sorted, smooth, sizeof(unsigned int) * count);
+	qsort(sorted, count, sizeof(unsigned int), scan_value_compare);
+	unsigned int floor = sorted[count / 10], max = sorted[count - 1];
+	unsigned int threshold = floor + (max - floor) / SCAN_PEAK_RATIO;
+
+	dvb_debug("Pre-sweep %u - %u Mhz : noise floor %u, max %u\n", start / 1000, end / 1000, floor, max);
+
+	// Sampling alone doesn't cover anything, the peaks are checked going up
+	p->swept = start;
+	for (i = 0; i < count && max > floor; i++) {
+		p->swept = samples[i].freq;
+		if (smooth[i] <= threshold || samples[i].freq < start || samples[i].freq > end)
+			continue;
+
+		// Only keep the highest point within the bandwidth
+		unsigned int j, from = (i > half ? i - half : 0), to = (i + half < count ? i + half : count - 1);
+		for (j = from; j <= to; j++) {
+			if (smooth[j] > smooth[i] || (j < i && smooth[j] == smooth[i]))
+				break;
+		}
+		if (j <= to)
+			continue;
+
+		if (scan_skip(p, polarity, samples[i].freq) != samples[i].freq)
+			continue;
+
+		dvb_debug("Signal peak at %u Mhz\n", samples[i].freq / 1000);
+		if (scan_peak(frontend_fd, p, polarity, samples[i].freq))
+			goto err;
+	}
+
+	free(samples);
+	free(smooth);
+	free(sorted);
+	return 0;
+
+err:
+	free(samples);
+	free(smooth);
+	free(sorted);
+	return -1;
+}
+
+static int scan_blind(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	unsigned int coarse = scan_bandwidth(scan_min_rate(p)) / SCAN_COARSE_DIV;
+	if (coarse < p->step)
+		coarse = p->step;
+
+	unsigned int cur_freq = start;
+
+	while (cur_freq <= end) {
+
+		scan_sweep_progress(p, polarity, cur_freq);
+
+		unsigned int next = scan_skip(p, polarity, cur_freq);
+		if (next != cur_freq) {
+			cur_freq = next;
+			continue;
+		}
+
+		fe_status_t status;
+		if (scan_probe(frontend_fd, p, cur_freq, polarity, &status))
+			return -1;
+
+		if (!(status & FE_HAS_LOCK)) {
+			cur_freq += coarse;
+			continue;
+		}
+
+		// Find out what we actually locked on
+		unsigned int freq = cur_freq;
+		struct frontend_tuning tuning = { 0 };
+		if (!frontend_get_tuning(frontend_fd, &tuning)) {
+			unsigned int ifreq = 0, hiband = 0;
+			if (lnb_get_parameters(p->lnb, cur_freq, &ifreq, &hiband)) {
+				printf("Error while getting LNB parameters\n");
+				return -1;
+			}
+			if (p->unicable)
+				tuning.frequency = unicable_get_ifreq(p->unicable, ifreq, p->tune_freq, tuning.frequency);
+			if (lnb_get_frequency(p->lnb, tuning.frequency, hiband, &freq)) {
+				printf("Error while getting LNB parameters\n");
+				return -1;
+			}
+			if (tuning.symbol_rate)
+				p->symbol_rate = tuning.symbol_rate;
+			dvb_debug("Locked %d kHz away from %u Mhz\n", (int) freq - (int) cur_freq, cur_freq / 1000);
+		}
+
+		if (scan_found(frontend_fd, p, freq, polarity, &tuning))
+			return -1;
+
+		// Jump straight past the transponder
+		next = freq + scan_bandwidth(p->symbol_rate) / 2 + coarse / 2;
+		if (next < cur_freq + coarse)
+			next = cur_freq + coarse;
+		cur_freq = next;
+	}
+
+	return 0;
+}
+
+static int scan_sweep(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	if (p->mode == scan_mode_blind)
+		return scan_blind(frontend_fd, p, polarity, start, end);
+
+	if (p->mode == scan_mode_presweep)
+		return scan_presweep(frontend_fd, p, polarity, start, end);
+
+	if (p->mode == scan_mode_adaptive) {
+		dvb_debug("Adaptive search from %u Mhz to %u Mhz\n", start / 1000, end / 1000);
+		return scan_adaptive(frontend_fd, p, polarity, start, end);
+	}
+
+	return scan_linear(frontend_fd, p, polarity, start, end);
+}
+
+static int scan_verify(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	// Check the known transponders first
+	struct tpdb *db = p->db;
+	unsigned int i;
+
+	for (i = 0; ; i++) {
+
+		// The database may be modified by other scanners
+		scan_lock(p);
+		if (i >= db->tp_count) {
+			scan_unlock(p);
+			break;
+		}
+		struct tpdb_transponder tp = db->tps[i];
+		scan_unlock(p);
+
+		if (strcmp(tp.sat, p->sat) || tp.freq < start || tp.freq > end)
+			continue;
+		if ((polarity >= 0 && tp.polarity != polarity) || tp.last_seen >= p->started)
+			continue;
+
+		unsigned int j;
+		for (j = 0; j < p->rate_count && p->symbol_rates[j] != tp.symbol_rate; j++);
+		if (j >= p->rate_count)
+			continue;
+		p->symbol_rate = tp.symbol_rate;
+
+		fe_status_t status;
+		if (scan_tune(frontend_fd, p, tp.freq, tp.polarity, &status))
+			return -1;
+
+		scan_lock(p);
+		db->tps[i].last_check = time(NULL);
+		scan_unlock(p);
+
+		if (!(status & FE_HAS_LOCK)) {
+			dvb_debug("Known transponder at %u Mhz, %s Polarity did not lock\n", tp.freq / 1000, (tp.polarity ? "V" : "H"));
+			continue;
+		}
+
+		p->verified++;
+		if (scan_found(frontend_fd, p, tp.freq, tp.polarity, NULL))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int scan_sweep_region(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	p->swept = start;
+	int res = scan_sweep(frontend_fd, p, polarity, start, end);
+	if (!res)
+		p->swept = end + p->step;
 
-	unsigned int cur_freq = start_freq;
-	unsigned int sample_rate = 27500000;
+	// Remember when the regions were swept, only the ones covered from one
+	// end to the other. Sweeps follow the step grid, starting or ending
+	// less than a step away from the edge of a region is enough.
+	int err = 0;
+	unsigned int from = (start >= p->step ? start - p->step + 1 : 0);
+	unsigned int region = from + (TPDB_REGION_SIZE - from % TPDB_REGION_SIZE) % TPDB_REGION_SIZE;
+	scan_lock(p);
+	for (; region + TPDB_REGION_SIZE <= p->swept && !err; region += TPDB_REGION_SIZE)
+		err = tpdb_region_set(p->db, p->sat, polarity, region, p->started);
+	scan_unlock(p);
 
-	printf("Scanning from %u Mhz to %u Mhz with %u Mhz steps ...\n", start_freq / 1000, end_freq / 1000, step / 1000);
+	return (res || err ? -1 : 0);
+}
 
-	int polarity = 0;
-	int polarity_try = 0;
+// Cable and terrestrial : only try the centers of the usual channel rasters
 
-	while (cur_freq <= end_freq) {
+struct scan_raster {
+	unsigned int first, last, spacing; // Channel centers in kHz
+	fe_bandwidth_t bandwidth;
+};
 
+static struct scan_raster scan_rasters_dvb_c[] = {
+	{ 114000, 858000, 8000, BANDWIDTH_8_MHZ }, // 8 Mhz raster used by most cable networks
+	{ 0 },
+};
 
-		scan_progress(cur_freq - start_freq, end_freq - start_freq);
+static struct scan_raster scan_rasters_dvb_t[] = {
+	{ 177500, 226500, 7000, BANDWIDTH_7_MHZ }, // VHF band III, channels 5 to 12
+	{ 474000, 858000, 8000, BANDWIDTH_8_MHZ }, // UHF, channels 21 to 69
+	{ 0 },
+};
 
-		unsigned int ifreq = 0, hiband = 0;
-		if (lnb_get_parameters(lnb_type_univeral, cur_freq, &ifreq, &hiband)) {
-			printf("Error while getting LNB parameters\n");
-			return -1;
+static int scan_channel_tune(int frontend_fd, struct scan_params *p, unsigned int freq, fe_bandwidth_t bandwidth, fe_status_t *status) {
+
+	dvb_debug("Tuning to %u Mhz, %s ...\n", freq / 1000, frontend_modulation_str(p->modulation));
+
+	uint64_t start = (p->latency ? latency_now() : 0);
+
+	// The API wants Hz for cable and terrestrial
+	int res;
+	if (p->type == FE_QAM)
+		res = frontend_tune_dvb_c(frontend_fd, freq * 1000, p->symbol_rate, p->modulation);
+	else
+		res = frontend_tune_dvb_t(frontend_fd, freq * 1000, p->modulation, bandwidth, TRANSMISSION_MODE_AUTO, FEC_AUTO, GUARD_INTERVAL_AUTO);
+	if (res)
+		return -1;
+
+	if (p->latency) {
+		uint64_t now = latency_now();
+		scan_lock(p);
+		latency_record(p->latency, latency_phase_tune, now - start);
+		scan_unlock(p);
+	}
+
+	return scan_attempt(frontend_fd, p, freq, 0, 0, status);
+}
+
+static int scan_channel(int frontend_fd, struct scan_params *p, unsigned int freq, fe_bandwidth_t bandwidth, fe_status_t *status) {
+
+	// Try the most likely modulations first and the symbol rates for each of them
+	unsigned int rate_count = (p->type == FE_QAM ? p->rate_count : 1);
+	unsigned int i, j;
+	for (i = 0; i < p->modulation_count; i++) {
+		p->modulation = p->modulations[i];
+		for (j = 0; j < rate_count; j++) {
+			p->symbol_rate = p->rates[0][j].symbol_rate;
+			if (scan_channel_tune(frontend_fd, p, freq, bandwidth, status))
+				return -1;
+
+			if (*status & FE_HAS_LOCK) {
+				// Move the modulation in front for the next channels
+				for (; i > 0; i--)
+					p->modulations[i] = p->modulations[i - 1];
+				p->modulations[0] = p->modulation;
+				return 0;
+			}
+
+			// Nothing there at all, other parameters won't help
+			if (!(*status & (FE_HAS_SIGNAL | FE_HAS_CARRIER)))
+				return 0;
 		}
+	}
+
+	return 0;
+}
 
+static int scan_raster(int frontend_fd, struct scan_params *p, unsigned int start, unsigned int end) {
 
-		dvb_debug("Tuning to %u Mhz, %u MSym/s, %s Polarity ...\n", cur_freq / 1000, sample_rate / 1000, (polarity ? "V" : "H"));
-		// 13V is vertical polarity and 18V is horizontal
-		if (frontend_set_voltage(frontend_fd, (polarity ? SEC_VOLTAGE_13 : SEC_VOLTAGE_18)))
-			return -1;
+	struct scan_raster *raster = (p->type == FE_QAM ? scan_rasters_dvb_c : scan_rasters_dvb_t);
 
-		if (frontend_set_tone(frontend_fd, (hiband ? SEC_TONE_ON : SEC_TONE_OFF)))
-			return -1;
+	for (; raster->spacing; raster++) {
+		unsigned int freq;
+		for (freq = raster->first; freq <= raster->last; freq += raster->spacing) {
+			if (freq < start || freq > end)
+				continue;
 
-		if (frontend_tune_dvb_s(frontend_fd, ifreq, sample_rate))
-			return -1;
+			if (!p->quiet)
+				scan_progress(freq - p->start_freq, p->end_freq - p->start_freq);
 
-		fe_status_t status;
-		if (frontend_get_status(frontend_fd, timeout,  &status))
-			return -1;
+			fe_status_t status;
+			if (scan_channel(frontend_fd, p, freq, raster->bandwidth, &status))
+				return -1;
+
+			if (!(status & FE_HAS_LOCK))
+				continue;
+
+			struct frontend_tuning tuning = { 0 };
+			tuning.delivery_system = (p->type == FE_QAM ? SYS_DVBC_ANNEX_A : SYS_DVBT);
+			tuning.modulation = p->modulation;
+			tuning.fec = FEC_AUTO;
+
+			// Find out what the frontend detected by itself
+			struct frontend_tuning detected;
+			if (p->modulation == QAM_AUTO && !frontend_get_tuning(frontend_fd, &detected)) {
+				tuning.modulation = detected.modulation;
+				tuning.fec = detected.fec;
+			}
+
+			if (p->type != FE_QAM)
+				p->symbol_rate = 0;
+
+			if (scan_found(frontend_fd, p, freq, 0, &tuning))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int scan_range(int frontend_fd, struct scan_params *p, int polarity, unsigned int start, unsigned int end) {
+
+	if (p->type != FE_QPSK)
+		return scan_raster(frontend_fd, p, start, end);
+
+	if (!p->db)
+		return scan_sweep(frontend_fd, p, polarity, start, end);
+
+	// Only sweep the regions that are stale, merging adjacent ones
+	unsigned int region = start - start % TPDB_REGION_SIZE;
+	unsigned int sweep_start = 0;
+	int sweeping = 0;
+
+	for (; region <= end; region += TPDB_REGION_SIZE) {
+		scan_lock(p);
+		time_t last_swept = tpdb_region_get(p->db, p->sat, polarity, region);
+		scan_unlock(p);
+		int stale = (last_swept + p->stale <= p->started);
+
+		if (stale && !sweeping) {
+			sweep_start = (region < start ? start : region);
+			sweeping = 1;
+		} else if (!stale && sweeping) {
+			if (scan_sweep_region(frontend_fd, p, polarity, sweep_start, region - 1))
+				return -1;
+			sweeping = 0;
+		}
+	}
+
+	if (sweeping)
+		return scan_sweep_region(frontend_fd, p, polarity, sweep_start, end);
+
+	return 0;
+}
+
+void scan_reset(struct scan_params *params) {
+
+	params->started = time(NULL);
+	params->attempts = 0;
+	params->probes = 0;
+	params->found = 0;
+	params->verified = 0;
+	params->results = NULL;
+	params->result_count = 0;
+	params->switch_sent = 0;
+
+	if (!params->rate_count) {
+		params->symbol_rates[0] = params->symbol_rate;
+		params->rate_count = 1;
+	}
+
+	// Start with the symbol rates that were the most successful
+	int hiband;
+	for (hiband = 0; hiband < 2; hiband++) {
+		struct scan_rate *order = params->rates[hiband];
+		unsigned int i, j;
+		for (i = 0; i < params->rate_count; i++) {
+			struct scan_rate rate = { params->symbol_rates[i], 0 };
+			if (params->db)
+				rate.hits = tpdb_rate_get(params->db, params->sat, hiband, rate.symbol_rate);
+			for (j = i; j > 0 && order[j - 1].hits < rate.hits; j--)
+				order[j] = order[j - 1];
+			order[j] = rate;
+		}
+	}
+	params->symbol_rate = params->rates[0][0].symbol_rate;
+
+	// Most common modulations first
+	fe_modulation_t dvb_c[] = { QAM_256, QAM_64, QAM_128 };
+	fe_modulation_t dvb_t[] = { QAM_64, QAM_16, QPSK };
+	if (params->qam_auto) {
+		params->modulations[0] = QAM_AUTO;
+		params->modulation_count = 1;
+	} else if (params->type == FE_QAM) {
+		memcpy(params->modulations, dvb_c, sizeof(dvb_c));
+		params->modulation_count = sizeof(dvb_c) / sizeof(*dvb_c);
+	} else {
+		memcpy(params->modulations, dvb_t, sizeof(dvb_t));
+		params->modulation_count = sizeof(dvb_t) / sizeof(*dvb_t);
+	}
+
+	if (params->profile)
+		fprintf(params->profile, "satellite,polarity,frequency,strength,snr\n");
+}
+
+int scan_task(int frontend_fd, struct scan_params *params, int polarity, unsigned int start, unsigned int end) {
+
+	// Known transponders first, then whatever is stale
+	if (params->db && scan_verify(frontend_fd, params, polarity, start, end))
+		return -1;
+
+	return scan_range(frontend_fd, params, polarity, start, end);
+}
+
+// The range is split in units of the same polarity and band, scanned in order
+// by scan() or distributed between frontends by scan_parallel()
+
+int scan_units(struct scan_params *params, struct scan_unit **units) {
 
-		if (status & FE_HAS_LOCK) {
-			// TODO write down we locked
-			// Try next frequency with same polarity
-			cur_freq += step;
-		} else if (polarity_try >= 1) {
-			// Go to next frequency and reset polarity
-			polarity = 0;
-			polarity_try = 0;
-			cur_freq += step;
+	unsigned int switch_freq = 0;
+	if (params->type == FE_QPSK && lnb_get_switch(params->lnb, &switch_freq)) {
+		printf("Error while getting LNB parameters\n");
+		return -1;
+	}
+
+	// Split by polarity, band and frequency chunks
+	int count = 0;
+	int polarity, polarities = (params->type == FE_QPSK ? 2 : 1);
+	for (polarity = 0; polarity < polarities; polarity++) {
+		unsigned int start = params->start_freq;
+		while (start <= params->end_freq) {
+			unsigned int end = start - start % SCAN_UNIT_SIZE + SCAN_UNIT_SIZE - 1;
+			if (start <= switch_freq && end > switch_freq)
+				end = switch_freq;
+			if (end > params->end_freq)
+				end = params->end_freq;
+
+			struct scan_unit *new_units = realloc(*units, sizeof(struct scan_unit) * (count + 1));
+			if (!new_units) {
+				perror("Not enough memory");
+				return -1;
+			}
+			*units = new_units;
+			(*units)[count].index = count;
+			(*units)[count].polarity = polarity;
+			(*units)[count].start = start;
+			(*units)[count].end = end;
+			count++;
+
+			start = end + 1;
+		}
+	}
+
+	return count;
+}
+
+// Checkpoints : the units done so far and what was found in them, saved
+// regularly so an interrupted scan can resume where it stopped
+
+struct scan_checkpoint {
+	unsigned char *done; // One per unit
+	unsigned int unit_count;
+	struct scan_result *results;
+	unsigned int result_count;
+	unsigned int attempts, probes;
+	time_t saved;
+};
+
+// What a scanner already reported to the checkpoint
+struct scan_checkpoint_mark {
+	unsigned int results, attempts, probes;
+};
+
+static int scan_checkpoint_add(struct scan_checkpoint *cp, struct scan_result *results, unsigned int count) {
+
+	if (!count)
+		return 0;
+
+	struct scan_result *new_results = realloc(cp->results, sizeof(struct scan_result) * (cp->result_count + count));
+	if (!new_results) {
+		perror("Not enough memory");
+		return -1;
+	}
+	cp->results = new_results;
+	memcpy(cp->results + cp->result_count, results, sizeof(struct scan_result) * count);
+	cp->result_count += count;
+
+	return 0;
+}
+
+static int scan_checkpoint_load(struct scan_params *params, struct scan_checkpoint *cp) {
+
+	FILE *f = fopen(params->checkpoint, "r");
+	if (!f) {
+		if (errno == ENOENT) // Nothing to resume
+			return 0;
+		perror("Error while opening the checkpoint");
+		return -1;
+	}
+
+	char line[256];
+	unsigned int line_num = 0;
+	int matching = 0;
+	while (fgets(line, sizeof(line), f)) {
+		line_num++;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (line[0] == 'P') {
+			unsigned int type, mode, start, end, step, rate_count;
+			if (sscanf(line, "P %u %u %u %u %u %u", &type, &mode, &start, &end, &step, &rate_count) != 6)
+				goto invalid;
+			if (type != params->type || mode != params->mode || start != params->start_freq || end != params->end_freq || step != params->step || rate_count != params->rate_count) {
+				printf("Checkpoint %s was made with different parameters, starting over\n", params->checkpoint);
+				fclose(f);
+				return 0;
+			}
+			matching = 1;
+			continue;
+		}
+
+		if (!matching)
+			goto invalid;
+
+		if (line[0] == 'C') {
+			if (sscanf(line, "C %u %u", &cp->attempts, &cp->probes) != 2)
+				goto invalid;
+		} else if (line[0] == 'U') {
+			unsigned int index;
+			if (sscanf(line, "U %u", &index) != 1 || index >= cp->unit_count)
+				goto invalid;
+			cp->done[index] = 1;
+		} else if (line[0] == 'F') {
+			struct scan_result res = { 0 };
+			char pol;
+			if (sscanf(line, "F %u %c %u %u %u %u %u %u %u %u %d", &res.freq, &pol, &res.symbol_rate, &res.strength, &res.snr,
+				&res.delivery_system, &res.modulation, &res.fec, &res.rolloff, &res.services, &res.feed) != 11)
+				goto invalid;
+			res.polarity = (pol == 'V');
+			if (scan_checkpoint_add(cp, &res, 1)) {
+				fclose(f);
+				return -1;
+			}
 		} else {
-			// Switch polarity
-			polarity = !polarity;
-			polarity_try++;
+			goto invalid;
 		}
+	}
+
+	fclose(f);
+	return 0;
+
+invalid:
+	printf("Invalid line %u in checkpoint %s\n", line_num, params->checkpoint);
+	fclose(f);
+	return -1;
+}
+
+static int scan_checkpoint_save(struct scan_params *params, struct scan_checkpoint *cp) {
 
+	char tmp[PATH_MAX];
+	snprintf(tmp, PATH_MAX - 1, "%s.tmp", params->checkpoint);
+
+	FILE *f = fopen(tmp, "w");
+	if (!f) {
+		perror("Error while opening the checkpoint for writing");
+		return -1;
 	}
-	
+
+	fprintf(f, "# feedhunter checkpoint\n");
+	fprintf(f, "P %u %u %u %u %u %u\n", params->type, params->mode, params->start_freq, params->end_freq, params->step, params->rate_count);
+	fprintf(f, "C %u %u\n", cp->attempts, cp->probes);
+
+	unsigned int i;
+	for (i = 0; i < cp->unit_count; i++) {
+		if (cp->done[i])
+			fprintf(f, "U %u\n", i);
+	}
+
+	for (i = 0; i < cp->result_count; i++) {
+		struct scan_result *res = &cp->results[i];
+		fprintf(f, "F %u %c %u %u %u %u %u %u %u %u %d\n", res->freq, (res->polarity ? 'V' : 'H'), res->symbol_rate, res->strength, res->snr,
+			res->delivery_system, res->modulation, res->fec, res->rolloff, res->services, res->feed);
+	}
+
+	if (fclose(f)) {
+		perror("Error while writing the checkpoint");
+		return -1;
+	}
+
+	// Atomically replace the previous one
+	if (rename(tmp, params->checkpoint)) {
+		perror("Error while renaming the checkpoint");
+		return -1;
+	}
+
+	cp->saved = time(NULL);
+
+	return 0;
+}
+
+static int scan_checkpoint_init(struct scan_params *params, struct scan_checkpoint *cp, struct scan_unit *units, int *unit_count) {
+
+	memset(cp, 0, sizeof(struct scan_checkpoint));
+	cp->unit_count = *unit_count;
+	cp->saved = time(NULL);
+
+	if (!params->checkpoint)
+		return 0;
+
+	cp->done = calloc(cp->unit_count ? cp->unit_count : 1, sizeof(unsigned char));
+	if (!cp->done) {
+		perror("Not enough memory");
+		return -1;
+	}
+
+	if (scan_checkpoint_load(params, cp))
+		return -1;
+
+	// Only keep the units left to do
+	int i, count = 0;
+	for (i = 0; i < *unit_count; i++) {
+		if (!cp->done[units[i].index])
+			units[count++] = units[i];
+	}
+
+	if (count != *unit_count)
+		printf("Resuming from %s : %u of %u units done, %u transponders found in %u tuning attempts\n", params->checkpoint, *unit_count - count, *unit_count, cp->result_count, cp->attempts);
+	*unit_count = count;
+
+	return 0;
+}
+
+static void scan_checkpoint_resume(struct scan_checkpoint *cp, struct scan_params *p, struct scan_checkpoint_mark *mark) {
+
+	// Results found before are known so they won't be tuned again
+	p->results = NULL;
+	p->result_count = 0;
+	if (cp->result_count) {
+		p->results = malloc(sizeof(struct scan_result) * cp->result_count);
+		if (p->results) {
+			memcpy(p->results, cp->results, sizeof(struct scan_result) * cp->result_count);
+			p->result_count = cp->result_count;
+		}
+	}
+	p->found = p->result_count;
+
+	mark->results = p->result_count;
+	mark->attempts = p->attempts;
+	mark->probes = p->probes;
+}
+
+static int scan_checkpoint_unit(struct scan_checkpoint *cp, struct scan_params *p, struct scan_checkpoint_mark *mark, struct scan_unit *unit) {
+
+	if (!cp->done)
+		return 0;
+
+	cp->done[unit->index] = 1;
+
+	if (scan_checkpoint_add(cp, p->results + mark->results, p->result_count - mark->results))
+		return -1;
+	cp->attempts += p->attempts - mark->attempts;
+	cp->probes += p->probes - mark->probes;
+
+	mark->results = p->result_count;
+	mark->attempts = p->attempts;
+	mark->probes = p->probes;
+
+	if (time(NULL) - cp->saved < SCAN_CHECKPOINT_INTERVAL)
+		return 0;
+
+	return scan_checkpoint_save(p, cp);
+}
+
+static int scan_checkpoint_done(struct scan_params *params, struct scan_checkpoint *cp, int res) {
+
+	if (cp->done) {
+		if (scan_stopped(params) || res) {
+			// Keep what was done for next time
+			if (!scan_checkpoint_save(params, cp))
+				printf("Progress saved in %s\n", params->checkpoint);
+			else
+				res = -1;
+		} else if (unlink(params->checkpoint) && errno != ENOENT) {
+			perror("Error while removing the checkpoint");
+			res = -1;
+		}
+	}
+
+	free(cp->done);
+	free(cp->results);
+
+	return res;
+}
+
+static void scan_summary(struct scan_params *params) {
+
+	printf("Scan %s : %u transponders found in %u tuning attempts", (scan_stopped(params) ? "interrupted" : "done"), params->found, params->attempts);
+	if (params->probes)
+		printf(" and %u signal probes", params->probes);
+	printf("\n");
+}
+
+int scan(int frontend_fd, struct scan_params *params) {
+
+	// Programs using the library may not want anything printed
+	if (!params->quiet) {
+		if (params->type == FE_QPSK)
+			printf("Scanning from %u Mhz to %u Mhz with %u Mhz steps ...\n", params->start_freq / 1000, params->end_freq / 1000, params->step / 1000);
+		else
+			printf("Scanning the channels from %u Mhz to %u Mhz ...\n", params->start_freq / 1000, params->end_freq / 1000);
+	}
+
+	scan_reset(params);
+
+	struct scan_unit *units = NULL;
+	int unit_count = scan_units(params, &units);
+	if (unit_count < 0)
+		return -1;
+
+	struct scan_checkpoint cp;
+	if (scan_checkpoint_init(params, &cp, units, &unit_count)) {
+		free(cp.done);
+		free(cp.results);
+		free(units);
+		return -1;
+	}
+
+	struct scan_checkpoint_mark mark;
+	params->attempts = cp.attempts;
+	params->probes = cp.probes;
+	scan_checkpoint_resume(&cp, params, &mark);
+
+	int res = 0;
+
+	if (params->db) {
+		res = scan_verify(frontend_fd, params, -1, params->start_freq, params->end_freq);
+		if (!params->quiet)
+			printf("%u known transponders verified\n", params->verified);
+	}
+
+	// Units are in polarity and frequency order
+	int i;
+	for (i = 0; i < unit_count && !res; i++) {
+		res = scan_range(frontend_fd, params, units[i].polarity, units[i].start, units[i].end);
+		if (!res)
+			res = scan_checkpoint_unit(&cp, params, &mark, &units[i]);
+	}
+
+	if (scan_stopped(params))
+		res = 0;
+
+	if (!params->quiet) {
+		if (!dvb_get_verbose())
+			printf("\n");
+		scan_summary(params);
+	}
+
+	res = scan_checkpoint_done(params, &cp, res);
+	free(units);
+
+	return res;
+}
+
+// Parallel scanning : the range is split in units which are distributed
+// between the workers. Idle workers steal units from the busiest one.
+
+struct scan_pool;
+
+struct scan_worker {
+	pthread_t thread;
+	int frontend_fd;
+	struct scan_params params;
+	struct scan_pool *pool;
+
+	pthread_mutex_t lock; // Protects the units
+	struct scan_unit *units;
+	unsigned int head, tail;
+
+	struct scan_checkpoint_mark mark;
+	int res;
+};
+
+struct scan_pool {
+	struct scan_worker *workers;
+	unsigned int count;
+
+	pthread_mutex_t lock; // Protects the database and the fields below
+	pthread_cond_t cond;
+	struct scan_checkpoint *checkpoint;
+	unsigned int units_done, units_total;
+	unsigned int finished;
+	int abort;
+};
+
+static int scan_unit_get(struct scan_worker *w, struct scan_unit *unit) {
+
+	// Process our own units in order first
+	pthread_mutex_lock(&w->lock);
+	if (w->head < w->tail) {
+		*unit = w->units[w->head++];
+		pthread_mutex_unlock(&w->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	// Steal from the end of the queue of the most loaded worker
+	struct scan_pool *pool = w->pool;
+	while (1) {
+		struct scan_worker *victim = NULL;
+		unsigned int i, max = 0;
+		for (i = 0; i < pool->count; i++) {
+			struct scan_worker *cur = &pool->workers[i];
+			pthread_mutex_lock(&cur->lock);
+			unsigned int left = cur->tail - cur->head;
+			pthread_mutex_unlock(&cur->lock);
+			if (left > max) {
+				max = left;
+				victim = cur;
+			}
+		}
+
+		if (!victim)
+			return 0;
+
+		pthread_mutex_lock(&victim->lock);
+		if (victim->head < victim->tail) {
+			*unit = victim->units[--victim->tail];
+			pthread_mutex_unlock(&victim->lock);
+			dvb_debug("Frontend %d stole unit %u - %u Mhz\n", w->frontend_fd, unit->start / 1000, unit->end / 1000);
+			return 1;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+}
+
+static int scan_pool_aborted(struct scan_pool *pool) {
+
+	// Written by the other workers under the lock
+	pthread_mutex_lock(&pool->lock);
+	int abort = pool->abort;
+	pthread_mutex_unlock(&pool->lock);
+
+	return abort;
+}
+
+static void *scan_worker_thread(void *arg) {
+
+	struct scan_worker *w = arg;
+	struct scan_pool *pool = w->pool;
+	struct scan_params *p = &w->params;
+
+	struct scan_unit unit;
+	while (!scan_pool_aborted(pool) && scan_unit_get(w, &unit)) {
+
+		if (scan_task(w->frontend_fd, p, unit.polarity, unit.start, unit.end))
+			w->res = -1;
+
+		pthread_mutex_lock(&pool->lock);
+		pool->units_done++;
+		if (!w->res && scan_checkpoint_unit(pool->checkpoint, p, &w->mark, &unit))
+			w->res = -1;
+		if (w->res)
+			pool->abort = 1;
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->finished++;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static int scan_result_compare(const void *a, const void *b) {
+
+	const struct scan_result *ra = a, *rb = b;
+
+	if (ra->polarity != rb->polarity)
+		return ra->polarity - rb->polarity;
+	if (ra->freq != rb->freq)
+		return (ra->freq < rb->freq ? -1 : 1);
+	return 0;
+}
+
+static int scan_merge(struct scan_pool *pool, struct scan_params *params) {
+
+	unsigned int i, total = 0;
+	for (i = 0; i < pool->count; i++)
+		total += pool->workers[i].params.result_count;
+
+	params->results = malloc(sizeof(struct scan_result) * (total ? total : 1));
+	if (!params->results) {
+		perror("Not enough memory");
+		return -1;
+	}
+
+	for (i = 0; i < pool->count; i++) {
+		struct scan_params *p = &pool->workers[i].params;
+		memcpy(params->results + params->result_count, p->results, sizeof(struct scan_result) * p->result_count);
+		params->result_count += p->result_count;
+		params->attempts += p->attempts;
+		params->probes += p->probes;
+		params->verified += p->verified;
+	}
+
+	qsort(params->results, params->result_count, sizeof(struct scan_result), scan_result_compare);
+
+	// Transponders across two units may have been found twice
+	unsigned int j = 0;
+	for (i = 0; i < params->result_count; i++) {
+		struct scan_result *res = &params->results[i];
+		struct scan_result *prev = (j ? &params->results[j - 1] : NULL);
+		if (prev && res->polarity == prev->polarity && res->freq <= prev->freq + scan_bandwidth(prev->symbol_rate) / 2)
+			continue;
+		params->results[j++] = *res;
+	}
+	params->result_count = j;
+	params->found = j;
+
+	// The workers are quiet, print the merged list once
+	for (i = 0; i < params->result_count && !params->quiet; i++)
+		scan_result_print(&params->results[i]);
+
 	return 0;
 }
 
+int scan_parallel(int *frontend_fds, char **demux_devs, unsigned int count, struct scan_params *params) {
+
+	if (count == 1) {
+		params->demux = demux_devs[0];
+		return scan(frontend_fds[0], params);
+	}
+
+	if (!params->quiet) {
+		if (params->type == FE_QPSK)
+			printf("Scanning from %u Mhz to %u Mhz with %u Mhz steps on %u frontends ...\n", params->start_freq / 1000, params->end_freq / 1000, params->step / 1000, count);
+		else
+			printf("Scanning the channels from %u Mhz to %u Mhz on %u frontends ...\n", params->start_freq / 1000, params->end_freq / 1000, count);
+	}
+
+	scan_reset(params);
+
+	struct scan_unit *units = NULL;
+	int unit_count = scan_units(params, &units);
+	if (unit_count < 0)
+		return -1;
+
+	struct scan_pool pool = {0};
+	pool.count = count;
+	pool.workers = calloc(count, sizeof(struct scan_worker));
+	if (!pool.workers) {
+		perror("Not enough memory");
+		free(units);
+		return -1;
+	}
+
+	struct scan_checkpoint cp;
+	if (scan_checkpoint_init(params, &cp, units, &unit_count)) {
+		free(cp.done);
+		free(cp.results);
+		free(pool.workers);
+		free(units);
+		return -1;
+	}
+	pool.checkpoint = &cp;
+	pool.units_total = unit_count;
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	// Give each worker a contiguous block to limit polarity and band switches
+	unsigned int i, started = 0;
+	for (i = 0; i < count; i++) {
+		struct scan_worker *w = &pool.workers[i];
+		w->frontend_fd = frontend_fds[i];
+		w->pool = &pool;
+		w->params = *params;
+		w->params.demux = demux_devs[i];
+		w->params.quiet = 1;
+		w->params.lock = &pool.lock;
+		scan_checkpoint_resume(&cp, &w->params, &w->mark);
+		w->units = units;
+		w->head = unit_count * i / count;
+		w->tail = unit_count * (i + 1) / count;
+		pthread_mutex_init(&w->lock, NULL);
+
+		if (pthread_create(&w->thread, NULL, scan_worker_thread, w)) {
+			perror("Error while creating scan thread");
+			pthread_mutex_lock(&pool.lock);
+			pool.abort = 1;
+			pool.finished += count - i;
+			pthread_mutex_unlock(&pool.lock);
+			break;
+		}
+		started++;
+	}
+
+	// Workers only count their own attempts, they are added when merging
+	params->attempts = cp.attempts;
+	params->probes = cp.probes;
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.finished < count) {
+		if (!params->quiet)
+			scan_progress(pool.units_done, pool.units_total);
+		pthread_cond_wait(&pool.cond, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	int res = (started < count ? -1 : 0);
+	for (i = 0; i < started; i++) {
+		pthread_join(pool.workers[i].thread, NULL);
+		if (pool.workers[i].res)
+			res = -1;
+	}
+
+	if (!params->quiet && !dvb_get_verbose())
+		printf("\n");
+
+	// Keep what was found before the interruption
+	if (scan_stopped(params))
+		res = 0;
+
+	if (!res)
+		res = scan_merge(&pool, params);
+
+	if (!params->quiet)
+		scan_summary(params);
+
+	res = scan_checkpoint_done(params, &cp, res);
+
+	for (i = 0; i < count; i++) {
+		scan_cleanup(&pool.workers[i].params);
+		pthread_mutex_destroy(&pool.workers[i].lock);
+	}
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.cond);
+	free(pool.workers);
+	free(units);
+
+	return res;
+}
+
+int scan_stopped(struct scan_params *params) {
+
+	return (params->stop && *params->stop);
+}
+
+void scan_cleanup(struct scan_params *params) {
+
+	free(params->results);
+	params->results = NULL;
+	params->result_count = 0;
+}
+
 
 int scan_progress(unsigned int cur, unsigned int max) {
 
@@ -103,4 +1701,6 @@ int scan_progress(unsigned int cur, unsigned int max) {
 	printf("] %0.2f%%", progress);
 
 	fflush(NULL);
+
+	return 0;
 }
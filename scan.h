@@ -23,7 +23,147 @@
 #ifndef __SCAN_H__
 #define __SCAN_H__
 
-int scan(int frontend_fd, unsigned int timeout, unsigned int start_freq, unsigned int end_freq, unsigned int step);
+#include <stdio.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "diseqc.h"
+#include "frontend.h"
+#include "latency.h"
+#include "lnb.h"
+#include "output.h"
+#include "psi.h"
+#include "tpdb.h"
+#include "unicable.h"
+
+#define SCAN_ROLLOFF		35	// DVB-S roll-off factor in percent
+#define SCAN_COARSE_DIV		2	// Coarse steps per occupied bandwidth in adaptive mode
+#define SCAN_UNIT_SIZE		100000	// Size of the work units when scanning with multiple frontends in kHz
+#define SCAN_MAX_RATES		16	// Maximum number of symbol rates to try
+#define SCAN_PEAK_RATIO		4	// Peaks must rise above the noise floor by 1/X of the maximum
+#define SCAN_MAX_MODULATIONS	4	// Maximum number of modulations to try on cable and terrestrial channels
+#define SCAN_CHECKPOINT_INTERVAL	60	// Minimum time between two checkpoints in seconds
+
+enum scan_mode {
+	scan_mode_linear,	// Try every step on both polarities
+	scan_mode_adaptive,	// Coarse steps, refine around hits and skip locked transponders
+	scan_mode_presweep,	// Signal strength profile first, then only try to lock on peaks
+	scan_mode_blind,	// Let the driver find the parameters and skip past what it reports
+};
+
+struct scan_result {
+	unsigned int freq; // kHz
+	int polarity;
+	unsigned int symbol_rate; // Sym/s
+	unsigned int strength, snr;
+
+	// Only known in blind mode, SYS_UNDEFINED otherwise
+	unsigned int delivery_system;
+	unsigned int modulation, fec, rolloff;
+
+	// Only known when classifying
+	unsigned int services;
+	int feed;
+};
+
+// Part of the range of the same polarity and band
+struct scan_unit {
+	unsigned int index;
+	int polarity;
+	unsigned int start, end; // kHz
+};
+
+struct scan_rate {
+	unsigned int symbol_rate; // Sym/s
+	unsigned int hits;
+};
+
+struct scan_params {
+	fe_type_t type; // FE_QPSK sweeps the LNB range, FE_QAM and FE_OFDM the usual channel rasters
+	enum lnb_type lnb;
+	enum scan_mode mode;
+	unsigned int timeout; // Tuning timeout in seconds
+	unsigned int start_freq, end_freq, step; // kHz
+	unsigned int symbol_rates[SCAN_MAX_RATES]; // Sym/s
+	unsigned int rate_count;
+	unsigned int dwell; // Time to wait before reading the signal strength in pre-sweep mode in ms
+	FILE *profile; // Optional CSV output of the pre-sweep power profile
+	int dvb_s2; // The frontend can do DVB-S2
+	int qam_auto; // The frontend can detect the modulation by itself
+
+	// Optional transponder database
+	struct tpdb *db;
+	char *sat; // Satellite name used as database key
+	unsigned int stale; // Sweep regions not swept for that many seconds
+
+	// Read the PSI tables after each lock to tell feeds from regular muxes
+	char *demux;
+	unsigned int classify; // Time budget in ms, 0 to disable
+
+	// Optional record of every tuning attempt
+	struct output *output;
+
+	// Optional timing of each tuning phase
+	struct latency *latency;
+
+	// Optional file to save the progress to and resume from
+	char *checkpoint;
+
+	// Optional single cable distribution shared by all the frontends
+	struct unicable *unicable;
+
+	// Optional flag that stops the scan when set, from a signal handler for instance
+	volatile sig_atomic_t *stop;
+
+	// Optional committed DiSEqC switch in front of the LNB
+	unsigned int switch_port; // 1 to 4, 0 without switch
+	unsigned int switch_repeat; // Number of times the command is repeated
+
+	// Filled by scan()
+	time_t started;
+	unsigned int attempts;
+	unsigned int probes;
+	unsigned int found;
+	unsigned int verified;
+	struct scan_result *results;
+	unsigned int result_count;
+
+	// Frequency given to the frontend for the current attempt in kHz
+	unsigned int tune_freq;
+
+	// Everything below was covered by the current sweep in kHz
+	unsigned int swept;
+
+	// What the DiSEqC switch was last set to by this frontend
+	int switch_sent;
+	int switch_polarity;
+	unsigned int switch_hiband;
+
+	// Symbol rate of the current attempt and try order for each band
+	unsigned int symbol_rate;
+	struct scan_rate rates[2][SCAN_MAX_RATES];
+
+	// Modulation of the current attempt and try order on cable and terrestrial
+	fe_modulation_t modulation;
+	fe_modulation_t modulations[SCAN_MAX_MODULATIONS];
+	unsigned int modulation_count;
+
+	// Only print errors, set on the parallel workers and by library users
+	int quiet;
+
+	// Used internally when multiple frontends are scanning
+	pthread_mutex_t *lock;
+};
+
+void scan_reset(struct scan_params *params);
+int scan_units(struct scan_params *params, struct scan_unit **units);
+int scan_task(int frontend_fd, struct scan_params *params, int polarity, unsigned int start, unsigned int end);
+void scan_result_print(struct scan_result *res);
+int scan(int frontend_fd, struct scan_params *params);
+int scan_parallel(int *frontend_fds, char **demux_devs, unsigned int count, struct scan_params *params);
+void scan_cleanup(struct scan_params *params);
+int scan_stopped(struct scan_params *params);
 int scan_progress(unsigned int cur, unsigned int max);
 
 #endif
@@ -0,0 +1,151 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "capture.h"
+#include "demux_sim.h"
+
+#define CAPTURE_TEST_MARKER_PID	0x1FFF
+
+static int failed = 0;
+
+static void check(int cond, char *what) {
+
+	printf("%s : %s\n", (cond ? "PASS" : "FAIL"), what);
+	if (!cond)
+		failed = 1;
+}
+
+static int capture_test_list(struct capture *c, char *expected) {
+
+	char list[256];
+	capture_pid_list(c, list, sizeof(list));
+	printf("PIDs : %s\n", list);
+	return !strcmp(list, expected);
+}
+
+// Only the PIDs that changed get their filter touched
+static void capture_test_set_pids(struct capture *c) {
+
+	struct demux_sim_stats *stats = demux_sim_get_stats();
+
+	check(!capture_open(c, 0, 0, "18, 0,17"), "open the capture");
+	check(capture_test_list(c, "0,17,18") && demux_sim_filter_count() == 3, "one filter per PID");
+
+	demux_sim_reset();
+	check(capture_set_pids(c, "17,18,100") == 2, "two filters changed");
+	check(stats->opens == 1 && stats->closes == 1, "the filters kept keep running");
+	check(!demux_sim_filtering(0) && demux_sim_filtering(100), "filters swapped");
+
+	demux_sim_reset();
+	check(capture_set_pids(c, "100\n18\n17\n") == 0 && !stats->opens && !stats->closes, "same list changes nothing");
+	check(capture_set_pids(c, "17,bogus") == -1 && capture_test_list(c, "17,18,100"), "unparseable list changes nothing");
+	check(capture_set_pids(c, "") == -1 && demux_sim_filter_count() == 3, "empty list changes nothing");
+}
+
+// A filter failing half way leaves what was done, the PID list tells what it is
+static void capture_test_partial(struct capture *c) {
+
+	demux_sim_reset();
+	demux_sim_fail(300);
+	check(capture_set_pids(c, "17,200,300") == -1, "failed filter reported");
+	check(capture_test_list(c, "17,200") && demux_sim_filter_count() == 2, "PID list matches the filters left");
+	check(demux_sim_filtering(200) && !demux_sim_filtering(300), "filters before the failure applied");
+
+	demux_sim_reset();
+	check(capture_set_pids(c, "17,200,300") == 1 && capture_test_list(c, "17,200,300"), "retry completes the change");
+}
+
+// The marker text splits over as many packets as needed and comes back whole
+static void capture_test_marker(struct capture *c) {
+
+	char list[256];
+	size_t len = 0;
+	unsigned int i;
+	for (i = 0; i < 40; i++)
+		len += snprintf(list + len, sizeof(list) - len, (i ? ",%u" : "%u"), 1000 + i);
+	check(capture_set_pids(c, list) > 0 && c->pid_count == 40, "long PID list");
+
+	char text[sizeof(list) + 32];
+	len = snprintf(text, sizeof(text), "DVB2PCAP PIDS ");
+	len += capture_pid_list(c, text + len, sizeof(text) - len - 1);
+	text[len++] = '\n';
+
+	unsigned char pkts[4][CAPTURE_TS_LEN];
+	unsigned int count = 0;
+	size_t pos;
+	for (pos = 0; pos < len && count < 4; count++)
+		pos += capture_text_packet(pkts[count], CAPTURE_TEST_MARKER_PID, 14 + count, text + pos, len - pos);
+	check(count == (len + CAPTURE_TS_LEN - 5) / (CAPTURE_TS_LEN - 4), "marker split over whole packets");
+
+	char decoded[sizeof(text)];
+	int headers = 1, stuffed = 1;
+	for (i = 0, pos = 0; i < count; i++) {
+		unsigned char *pkt = pkts[i];
+		if (pkt[0] != 0x47 || (((pkt[1] & 0x1f) << 8) | pkt[2]) != CAPTURE_TEST_MARKER_PID || pkt[3] != (0x10 | ((14 + i) & 0xf)))
+			headers = 0;
+		size_t chunk = (len - pos > CAPTURE_TS_LEN - 4 ? CAPTURE_TS_LEN - 4 : len - pos);
+		memcpy(decoded + pos, pkt + 4, chunk);
+		pos += chunk;
+		size_t j;
+		for (j = 4 + chunk; j < CAPTURE_TS_LEN; j++) {
+			if (pkt[j] != 0xff)
+				stuffed = 0;
+		}
+	}
+	check(headers, "marker headers with a wrapping continuity counter");
+	check(stuffed, "marker packets stuffed with 0xff");
+	check(pos == len && !memcmp(decoded, text, len), "marker text comes back whole");
+}
+
+// Reads only return whole packets, the rest waits for the next one
+static void capture_test_read(struct capture *c) {
+
+	unsigned char stream[3 * CAPTURE_TS_LEN];
+	unsigned int i;
+	for (i = 0; i < sizeof(stream); i++)
+		stream[i] = (i % CAPTURE_TS_LEN ? i & 0xff : 0x47);
+
+	unsigned char buff[4 * CAPTURE_TS_LEN];
+	demux_sim_feed(stream, CAPTURE_TS_LEN + 100);
+	check(capture_read(c, buff, sizeof(buff)) == CAPTURE_TS_LEN && !memcmp(buff, stream, CAPTURE_TS_LEN), "whole packet read");
+
+	demux_sim_feed(stream + CAPTURE_TS_LEN + 100, 2 * CAPTURE_TS_LEN - 100);
+	check(capture_read(c, buff, sizeof(buff)) == 2 * CAPTURE_TS_LEN && !memcmp(buff, stream + CAPTURE_TS_LEN, 2 * CAPTURE_TS_LEN), "split packet completed by the next read");
+	check(capture_read(c, buff, CAPTURE_TS_LEN - 1) == -1, "buffer smaller than a packet refused");
+}
+
+int main(int argc, char **argv) {
+
+	struct capture c;
+	capture_test_set_pids(&c);
+	capture_test_partial(&c);
+	capture_test_marker(&c);
+	capture_test_read(&c);
+
+	capture_close(&c);
+	check(demux_sim_filter_count() == 0, "every filter closed");
+
+	return failed;
+}
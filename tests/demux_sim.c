@@ -0,0 +1,134 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "demux.h"
+#include "demux_sim.h"
+
+struct demux_sim_filter {
+	int used;
+	uint16_t pid;
+};
+
+static struct demux_sim_filter filters[DEMUX_SIM_MAX_FILTERS];
+static struct demux_sim_stats stats;
+static int fail_pid = -1;
+static int dvr_pipe[2] = { -1, -1 };
+
+void demux_sim_fail(int pid) {
+
+	fail_pid = pid;
+}
+
+int demux_sim_filtering(uint16_t pid) {
+
+	unsigned int i;
+	for (i = 0; i < DEMUX_SIM_MAX_FILTERS; i++) {
+		if (filters[i].used && filters[i].pid == pid)
+			return 1;
+	}
+
+	return 0;
+}
+
+unsigned int demux_sim_filter_count() {
+
+	unsigned int i, count = 0;
+	for (i = 0; i < DEMUX_SIM_MAX_FILTERS; i++)
+		count += filters[i].used;
+
+	return count;
+}
+
+ssize_t demux_sim_feed(unsigned char *data, size_t len) {
+
+	if (dvr_pipe[1] == -1)
+		return -1;
+
+	return write(dvr_pipe[1], data, len);
+}
+
+struct demux_sim_stats *demux_sim_get_stats() {
+
+	return &stats;
+}
+
+void demux_sim_reset() {
+
+	memset(&stats, 0, sizeof(struct demux_sim_stats));
+	fail_pid = -1;
+}
+
+int demux_open_filter(unsigned int adapter, unsigned int demux, uint16_t pid) {
+
+	if (pid == fail_pid) {
+		printf("Simulated demux filter failure on PID %hu\n", pid);
+		return -1;
+	}
+
+	int i;
+	for (i = 0; i < DEMUX_SIM_MAX_FILTERS && filters[i].used; i++);
+	if (i >= DEMUX_SIM_MAX_FILTERS) {
+		printf("Too many simulated demux filters\n");
+		return -1;
+	}
+
+	filters[i].used = 1;
+	filters[i].pid = pid;
+	stats.opens++;
+
+	return DEMUX_SIM_FD_BASE + i;
+}
+
+int demux_open_dvr(unsigned int adapter, unsigned int demux) {
+
+	if (dvr_pipe[0] != -1) {
+		printf("Simulated DVR already open\n");
+		return -1;
+	}
+
+	if (pipe(dvr_pipe)) {
+		perror("Error while creating the simulated DVR");
+		return -1;
+	}
+
+	return dvr_pipe[0];
+}
+
+int demux_close(int fd) {
+
+	int i = fd - DEMUX_SIM_FD_BASE;
+	if (i >= 0 && i < DEMUX_SIM_MAX_FILTERS && filters[i].used) {
+		filters[i].used = 0;
+		stats.closes++;
+		return 0;
+	}
+
+	if (fd == dvr_pipe[0]) {
+		close(dvr_pipe[1]);
+		dvr_pipe[0] = dvr_pipe[1] = -1;
+	}
+
+	return close(fd);
+}
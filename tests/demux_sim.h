@@ -0,0 +1,46 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __DEMUX_SIM_H__
+#define __DEMUX_SIM_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Simulated demux replacing demux.c in the tests. Filters only record
+// their PID, the DVR is a pipe fed with demux_sim_feed().
+
+#define DEMUX_SIM_MAX_FILTERS	64
+#define DEMUX_SIM_FD_BASE	2000	// Keeps the fake descriptors away from real ones and the frontends
+
+struct demux_sim_stats {
+	unsigned int opens, closes;
+};
+
+void demux_sim_fail(int pid);
+int demux_sim_filtering(uint16_t pid);
+unsigned int demux_sim_filter_count();
+ssize_t demux_sim_feed(unsigned char *data, size_t len);
+struct demux_sim_stats *demux_sim_get_stats();
+void demux_sim_reset();
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Runs the daemon built against the simulated frontends and talks to it
+// through its socket like a client would
+
+#define DVBGYVERD_TEST_DAEMON	"tests/dvbgyverd_sim"
+#define DVBGYVERD_TEST_START	5000	// Time for the daemon to create its socket in ms
+
+struct dvbgyverd_test_client {
+	int fd;
+	FILE *in;
+};
+
+static int failed = 0;
+
+static void check(int cond, char *what) {
+
+	printf("%s : %s\n", (cond ? "PASS" : "FAIL"), what);
+	if (!cond)
+		failed = 1;
+}
+
+static int dvbgyverd_test_connect(char *path, struct dvbgyverd_test_client *c) {
+
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (c->fd == -1)
+		return -1;
+
+	if (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		close(c->fd);
+		return -1;
+	}
+
+	c->in = fdopen(c->fd, "r");
+
+	return 0;
+}
+
+static void dvbgyverd_test_close(struct dvbgyverd_test_client *c) {
+
+	fclose(c->in);
+}
+
+static void dvbgyverd_test_send(struct dvbgyverd_test_client *c, char *cmd) {
+
+	if (write(c->fd, cmd, strlen(cmd)) != strlen(cmd))
+		perror("Error while sending the command");
+}
+
+// Skip the data lines, return the final ok or error one
+static char *dvbgyverd_test_reply(struct dvbgyverd_test_client *c, char *reply, size_t len) {
+
+	while (fgets(reply, len, c->in)) {
+		if (!strncmp(reply, "ok", 2) || !strncmp(reply, "error", 5))
+			return reply;
+	}
+
+	strcpy(reply, "closed\n");
+
+	return reply;
+}
+
+static char *dvbgyverd_test_cmd(struct dvbgyverd_test_client *c, char *cmd, char *reply, size_t len) {
+
+	dvbgyverd_test_send(c, cmd);
+
+	return dvbgyverd_test_reply(c, reply, len);
+}
+
+static pid_t dvbgyverd_test_start(char *daemon, char *path, char *dir) {
+
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == -1)
+		return -1;
+
+	if (!pid) {
+		freopen("/dev/null", "w", stdout);
+		execl(daemon, daemon, "-a", "0,1", "-s", path, "-o", dir, "-S", "50", NULL);
+		perror("Error while starting the daemon");
+		exit(1);
+	}
+
+	// The socket only accepts clients once the daemon listens on it
+	unsigned int waited;
+	for (waited = 0; waited < DVBGYVERD_TEST_START; waited += 50) {
+		struct dvbgyverd_test_client c;
+		if (!dvbgyverd_test_connect(path, &c)) {
+			dvbgyverd_test_close(&c);
+			return pid;
+		}
+		usleep(50000);
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	return -1;
+}
+
+static void dvbgyverd_test_commands(struct dvbgyverd_test_client *c) {
+
+	char reply[256];
+
+	dvbgyverd_test_cmd(c, "list\n", reply, sizeof(reply));
+	check(!strcmp(reply, "ok 2\n"), "list both frontends");
+
+	dvbgyverd_test_cmd(c, "tune 0 10743 h 22000\n", reply, sizeof(reply));
+	check(!strncmp(reply, "ok lock ", 8), "tune to a transponder");
+
+	dvbgyverd_test_cmd(c, "status 0\n", reply, sizeof(reply));
+	check(!strncmp(reply, "ok lock ", 8) && strstr(reply, " 10743 h 22000\n"), "status of a tuned frontend");
+
+	dvbgyverd_test_cmd(c, "tune 1 10743 v 22000\n", reply, sizeof(reply));
+	check(!strcmp(reply, "error No lock\n"), "no lock on the wrong polarity");
+
+	dvbgyverd_test_cmd(c, "capture 0 0 1 ../escape.ts\n", reply, sizeof(reply));
+	check(!strcmp(reply, "error Invalid file name\n"), "capture outside the output directory refused");
+
+	dvbgyverd_test_cmd(c, "capture 0 0 1 /etc/passwd\n", reply, sizeof(reply));
+	check(!strcmp(reply, "error Invalid file name\n"), "capture to an absolute path refused");
+
+	dvbgyverd_test_cmd(c, "rotor 0 goto_x 19.2x\n", reply, sizeof(reply));
+	check(!strcmp(reply, "error Invalid orientation\n"), "invalid rotor orientation refused");
+}
+
+static void dvbgyverd_test_rotor(char *path, struct dvbgyverd_test_client *c) {
+
+	char reply[256];
+	struct dvbgyverd_test_client other;
+	if (dvbgyverd_test_connect(path, &other)) {
+		check(0, "second client");
+		return;
+	}
+
+	// The move takes a few seconds, the other frontend must wait for it
+	dvbgyverd_test_send(c, "rotor 0 goto_x 19.2e\n");
+	usleep(300000);
+	dvbgyverd_test_cmd(&other, "status 1\n", reply, sizeof(reply));
+	check(!strncmp(reply, "ok ", 3), "status of the other frontend");
+
+	struct pollfd pfd = { c->fd, POLLIN, 0 };
+	check(poll(&pfd, 1, 0) == 1, "the other frontend waited for the rotor");
+
+	dvbgyverd_test_reply(c, reply, sizeof(reply));
+	check(!strncmp(reply, "ok ", 3) && atof(reply + 3) > 1.0, "rotor move");
+
+	dvbgyverd_test_cmd(c, "status 0\n", reply, sizeof(reply));
+	check(!strncmp(reply, "ok ", 3) && !strstr(reply, "10743"), "frontends are not tuned anymore after a move");
+
+	dvbgyverd_test_cmd(c, "rotor 0 goto_x 19.2e\n", reply, sizeof(reply));
+	check(!strcmp(reply, "ok 0.0\n"), "no move when already there");
+
+	dvbgyverd_test_close(&other);
+}
+
+static int dvbgyverd_test_as_nobody(char *path) {
+
+	fflush(stdout);
+	pid_t pid = fork();
+	if (!pid) {
+		struct dvbgyverd_test_client c;
+		char reply[256];
+		if (setgid(65534) || setuid(65534))
+			exit(2);
+		if (dvbgyverd_test_connect(path, &c))
+			exit(0);
+		dvbgyverd_test_cmd(&c, "list\n", reply, sizeof(reply));
+		exit(strcmp(reply, "closed\n") ? 1 : 0);
+	}
+
+	int status = -1;
+	waitpid(pid, &status, 0);
+
+	return (WIFEXITED(status) && !WEXITSTATUS(status));
+}
+
+static void dvbgyverd_test_permissions(char *dir, char *path) {
+
+	struct stat st;
+	check(!stat(path, &st) && (st.st_mode & 0777) == 0660, "socket only open to its owner and group");
+
+	if (geteuid())
+		return;
+
+	chmod(dir, 0711);
+	check(dvbgyverd_test_as_nobody(path), "other users can't connect");
+
+	// Even with a world writable socket the daemon turns them away
+	chmod(path, 0666);
+	check(dvbgyverd_test_as_nobody(path), "other users are refused by the daemon");
+	chmod(path, 0660);
+	chmod(dir, 0700);
+}
+
+int main(int argc, char **argv) {
+
+	char *daemon = (argc > 1 ? argv[1] : DVBGYVERD_TEST_DAEMON);
+
+	char dir[] = "/tmp/dvbgyverd_test.XXXXXX";
+	if (!mkdtemp(dir)) {
+		perror("Error while creating the test directory");
+		return 1;
+	}
+	char path[sizeof(dir) + 16];
+	snprintf(path, sizeof(path), "%s/sock", dir);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	pid_t pid = dvbgyverd_test_start(daemon, path, dir);
+	check(pid != -1, "daemon started");
+	if (pid == -1) {
+		rmdir(dir);
+		return 1;
+	}
+
+	struct dvbgyverd_test_client c;
+	if (dvbgyverd_test_connect(path, &c)) {
+		check(0, "connect to the daemon");
+	} else {
+		dvbgyverd_test_permissions(dir, path);
+		dvbgyverd_test_commands(&c);
+		dvbgyverd_test_rotor(path, &c);
+		dvbgyverd_test_close(&c);
+	}
+
+	kill(pid, SIGTERM);
+	int status = -1;
+	waitpid(pid, &status, 0);
+	check(WIFEXITED(status) && !WEXITSTATUS(status), "daemon shut down cleanly");
+
+	struct stat st;
+	check(stat(path, &st) && errno == ENOENT, "socket removed on shutdown");
+	rmdir(dir);
+
+	return failed;
+}
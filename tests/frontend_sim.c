@@ -0,0 +1,401 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "frontend.h"
+#include "frontend_sim.h"
+
+struct frontend_sim {
+	int used;
+	fe_sec_voltage_t voltage;
+	fe_sec_tone_mode_t tone;
+	unsigned int freq; // kHz, 0 when not tuned to a satellite
+	unsigned int symbol_rate; // Sym/s
+	int blind; // Tuned with the parameters left to the driver
+	struct frontend_sim_stats stats;
+};
+
+static struct frontend_sim_tp sim_default_tps[] = {
+	{ 10743000, 0, 22000000 },
+	{ 10773000, 1, 22000000 },
+	{ 10803000, 1, 22000000 },
+	{ 10847000, 1, 22000000 },
+	{ 10876000, 0, 7200000 },
+	{ 11170000, 0, 27500000 },
+	{ 11597000, 1, 22000000 },
+	{ 11627000, 1, 22000000 },
+	{ 11720000, 0, 27500000 },
+	{ 11778000, 1, 27500000 },
+	{ 12012000, 1, 27500000 },
+	{ 12110000, 0, 27500000 },
+	{ 12207000, 1, 27500000 },
+	{ 12363000, 0, 30000000 },
+	{ 12522000, 1, 27500000 },
+	{ 12699000, 0, 27500000 },
+};
+
+static struct frontend_sim_tp sim_tps[FRONTEND_SIM_MAX_TPS];
+static unsigned int sim_tp_count = 0;
+static int sim_loaded = 0;
+
+static struct frontend_sim sims[FRONTEND_SIM_MAX_FRONTENDS];
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int frontend_sim_load(char *filename) {
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		perror("Error while opening the simulation script");
+		return -1;
+	}
+
+	sim_tp_count = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		unsigned int freq, rate;
+		char pol;
+		if (line[0] == '#' || sscanf(line, "%u %c %u", &freq, &pol, &rate) != 3)
+			continue;
+		if (sim_tp_count >= FRONTEND_SIM_MAX_TPS || (pol != 'h' && pol != 'v')) {
+			printf("Invalid simulation script line : %s", line);
+			fclose(f);
+			return -1;
+		}
+		struct frontend_sim_tp *tp = &sim_tps[sim_tp_count++];
+		tp->freq = freq * 1000;
+		tp->polarity = (pol == 'v');
+		tp->symbol_rate = rate * 1000;
+	}
+
+	fclose(f);
+	sim_loaded = 1;
+
+	return 0;
+}
+
+static void frontend_sim_init() {
+
+	if (sim_loaded)
+		return;
+
+	char *script = getenv("DVBGYVER_SIM");
+	if (script && !frontend_sim_load(script))
+		return;
+
+	memcpy(sim_tps, sim_default_tps, sizeof(sim_default_tps));
+	sim_tp_count = sizeof(sim_default_tps) / sizeof(sim_default_tps[0]);
+	sim_loaded = 1;
+}
+
+unsigned int frontend_sim_get_tps(struct frontend_sim_tp **tps) {
+
+	frontend_sim_init();
+	*tps = sim_tps;
+	return sim_tp_count;
+}
+
+static struct frontend_sim *frontend_sim_get(int frontend_fd) {
+
+	int i = frontend_fd - FRONTEND_SIM_FD_BASE;
+	if (i < 0 || i >= FRONTEND_SIM_MAX_FRONTENDS || !sims[i].used)
+		return NULL;
+
+	return &sims[i];
+}
+
+struct frontend_sim_stats *frontend_sim_get_stats(int frontend_fd) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	return (s ? &s->stats : NULL);
+}
+
+void frontend_sim_reset() {
+
+	unsigned int i;
+	for (i = 0; i < FRONTEND_SIM_MAX_FRONTENDS; i++)
+		memset(&sims[i].stats, 0, sizeof(struct frontend_sim_stats));
+}
+
+// Closest transponder on the current polarity
+static struct frontend_sim_tp *frontend_sim_nearest(struct frontend_sim *s, unsigned int *distance) {
+
+	struct frontend_sim_tp *best = NULL;
+	unsigned int i;
+	for (i = 0; i < sim_tp_count; i++) {
+		struct frontend_sim_tp *tp = &sim_tps[i];
+		if (tp->polarity != (s->voltage == SEC_VOLTAGE_13))
+			continue;
+		unsigned int d = (tp->freq > s->freq ? tp->freq - s->freq : s->freq - tp->freq);
+		if (!best || d < *distance) {
+			best = tp;
+			*distance = d;
+		}
+	}
+
+	return best;
+}
+
+static fe_status_t frontend_sim_status(struct frontend_sim *s) {
+
+	if (!s->freq || s->voltage == SEC_VOLTAGE_OFF)
+		return 0;
+
+	unsigned int d = 0;
+	struct frontend_sim_tp *tp = frontend_sim_nearest(s, &d);
+	if (!tp)
+		return 0;
+
+	// Lock a fifth of the symbol rate around the center, with a 2% symbol rate error at most
+	unsigned int rate_error = (tp->symbol_rate > s->symbol_rate ? tp->symbol_rate - s->symbol_rate : s->symbol_rate - tp->symbol_rate);
+	if (d <= tp->symbol_rate / 5000 && (s->blind || rate_error <= tp->symbol_rate / 50))
+		return FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK;
+
+	// Energy over the whole occupied bandwidth
+	if (d <= tp->symbol_rate / 1000 * 135 / 200)
+		return FE_HAS_SIGNAL | FE_HAS_CARRIER;
+
+	return 0;
+}
+
+int frontend_open(char *frontend, struct dvb_frontend_info *fe_info) {
+
+	frontend_sim_init();
+
+	pthread_mutex_lock(&sim_lock);
+	int i;
+	for (i = 0; i < FRONTEND_SIM_MAX_FRONTENDS && sims[i].used; i++);
+	if (i >= FRONTEND_SIM_MAX_FRONTENDS) {
+		pthread_mutex_unlock(&sim_lock);
+		printf("Too many simulated frontends\n");
+		return -1;
+	}
+	memset(&sims[i], 0, sizeof(struct frontend_sim));
+	sims[i].used = 1;
+	sims[i].voltage = SEC_VOLTAGE_OFF;
+	pthread_mutex_unlock(&sim_lock);
+
+	memset(fe_info, 0, sizeof(struct dvb_frontend_info));
+	snprintf(fe_info->name, sizeof(fe_info->name), "Simulated DVB-S %u", i);
+	fe_info->type = FE_QPSK;
+	fe_info->frequency_min = 950000;
+	fe_info->frequency_max = 2150000;
+	fe_info->frequency_stepsize = 1000;
+	fe_info->symbol_rate_min = 1000000;
+	fe_info->symbol_rate_max = 45000000;
+	fe_info->caps = FE_CAN_QPSK | FE_CAN_FEC_AUTO | FE_CAN_2G_MODULATION;
+
+	return FRONTEND_SIM_FD_BASE + i;
+}
+
+void frontend_print_info(struct dvb_frontend_info *fe_info) {
+
+	printf("Frontend info :\n  Name                : %s\n", fe_info->name);
+}
+
+int frontend_tune_dvb_s(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+
+	s->freq = ifreq + (s->tone == SEC_TONE_ON ? FRONTEND_SIM_LO_HIGH : FRONTEND_SIM_LO_LOW);
+	s->symbol_rate = symbol_rate;
+	s->blind = 0;
+	s->stats.tunes++;
+
+	return 0;
+}
+
+int frontend_tune_dvb_s_auto(int frontend_fd, unsigned int ifreq, unsigned int symbol_rate, int dvb_s2) {
+
+	if (frontend_tune_dvb_s(frontend_fd, ifreq, symbol_rate))
+		return -1;
+
+	frontend_sim_get(frontend_fd)->blind = 1;
+
+	return 0;
+}
+
+int frontend_get_tuning(int frontend_fd, struct frontend_tuning *tuning) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s || !(frontend_sim_status(s) & FE_HAS_LOCK))
+		return -1;
+
+	unsigned int d;
+	struct frontend_sim_tp *tp = frontend_sim_nearest(s, &d);
+	tuning->delivery_system = SYS_DVBS2;
+	tuning->frequency = tp->freq - (s->tone == SEC_TONE_ON ? FRONTEND_SIM_LO_HIGH : FRONTEND_SIM_LO_LOW);
+	tuning->symbol_rate = tp->symbol_rate;
+	tuning->modulation = PSK_8;
+	tuning->fec = FEC_3_4;
+	tuning->rolloff = ROLLOFF_35;
+
+	return 0;
+}
+
+char *frontend_delivery_system_str(unsigned int delivery_system) {
+
+	return (delivery_system == SYS_DVBS2 ? "DVB-S2" : "DVB-S");
+}
+
+char *frontend_modulation_str(unsigned int modulation) {
+
+	return (modulation == PSK_8 ? "8PSK" : "QPSK");
+}
+
+char *frontend_fec_str(unsigned int fec) {
+
+	return (fec == FEC_3_4 ? "3/4" : "auto");
+}
+
+int frontend_tune_dvb_c(int frontend_fd, unsigned int freq, unsigned int symbol_rate, fe_modulation_t modulation) {
+
+	// Only satellites are simulated, nothing ever locks
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+	s->freq = 0;
+	s->stats.tunes++;
+
+	return 0;
+}
+
+int frontend_tune_dvb_t(int frontend_fd, unsigned int freq, fe_modulation_t modulation, fe_bandwidth_t bandwidth, fe_transmit_mode_t transmit_mode, fe_code_rate_t code_rate, fe_guard_interval_t guard_interval) {
+
+	return frontend_tune_dvb_c(frontend_fd, freq, 0, modulation);
+}
+
+int frontend_get_status(int frontend_fd, unsigned int timeout, fe_status_t *status) {
+
+	return frontend_get_status_timed(frontend_fd, timeout, status, NULL);
+}
+
+int frontend_get_status_timed(int frontend_fd, unsigned int timeout, fe_status_t *status, unsigned int *first) {
+
+	// Settles almost right away, the tests count attempts rather than time
+	usleep(FRONTEND_SIM_STATUS_DELAY);
+	if (frontend_read_status(frontend_fd, status))
+		return -1;
+
+	if (first) {
+		int i;
+		for (i = 0; i < FRONTEND_STATUS_BITS; i++)
+			first[i] = ((*status & (1 << i)) ? 0 : FRONTEND_STATUS_NEVER);
+	}
+
+	return 0;
+}
+
+int frontend_read_status(int frontend_fd, fe_status_t *status) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+
+	*status = frontend_sim_status(s);
+
+	return 0;
+}
+
+int frontend_get_signal(int frontend_fd, unsigned int *strength, unsigned int *snr) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+
+	// Noise floor plus a triangle over the occupied bandwidth of the nearest transponder
+	*strength = 0x2000;
+	*snr = 0;
+
+	unsigned int d = 0;
+	struct frontend_sim_tp *tp = (s->freq ? frontend_sim_nearest(s, &d) : NULL);
+	if (!tp)
+		return 0;
+
+	unsigned int half_bw = tp->symbol_rate / 1000 * 135 / 200;
+	if (d < half_bw)
+		*strength += (unsigned int) (0x8000ULL * (half_bw - d) / half_bw);
+	if (frontend_sim_status(s) & FE_HAS_LOCK)
+		*snr = 0x9000;
+
+	return 0;
+}
+
+int frontend_set_voltage(int frontend_fd, fe_sec_voltage_t v) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+
+	s->voltage = v;
+	s->stats.voltage_changes++;
+
+	return 0;
+}
+
+int frontend_set_tone(int frontend_fd, fe_sec_tone_mode_t t) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+
+	s->tone = t;
+	s->stats.tone_changes++;
+
+	return 0;
+}
+
+int frontend_send_diseqc(int frontend_fd, unsigned char *msg, unsigned int len) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s || len > sizeof(s->stats.last_diseqc))
+		return -1;
+
+	memcpy(s->stats.last_diseqc, msg, len);
+	s->stats.last_diseqc_len = len;
+	s->stats.diseqc_msgs++;
+
+	return 0;
+}
+
+int frontend_send_burst(int frontend_fd, fe_sec_mini_cmd_t b) {
+
+	return (frontend_sim_get(frontend_fd) ? 0 : -1);
+}
+
+int frontend_close(int frontend_fd) {
+
+	struct frontend_sim *s = frontend_sim_get(frontend_fd);
+	if (!s)
+		return -1;
+
+	pthread_mutex_lock(&sim_lock);
+	s->used = 0;
+	pthread_mutex_unlock(&sim_lock);
+
+	return 0;
+}
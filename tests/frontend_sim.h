@@ -0,0 +1,57 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __FRONTEND_SIM_H__
+#define __FRONTEND_SIM_H__
+
+// Simulated satellite frontends replacing frontend.c in the tests. The
+// transponders come from a script with one "<freq Mhz> <h|v> <kSym/s>"
+// line each, given with frontend_sim_load() or the DVBGYVER_SIM
+// environment variable, a built-in list is used otherwise.
+
+#define FRONTEND_SIM_MAX_FRONTENDS	16
+#define FRONTEND_SIM_MAX_TPS		256
+#define FRONTEND_SIM_LO_LOW		9750000	// Universal LNB, kHz
+#define FRONTEND_SIM_LO_HIGH		10600000
+#define FRONTEND_SIM_FD_BASE		1000	// Keeps the fake descriptors away from real ones
+#define FRONTEND_SIM_STATUS_DELAY	100	// Time taken by a status read in us, lets parallel scans interleave
+
+struct frontend_sim_tp {
+	unsigned int freq; // kHz
+	int polarity; // 1 for vertical
+	unsigned int symbol_rate; // Sym/s
+};
+
+struct frontend_sim_stats {
+	unsigned int tunes;
+	unsigned int voltage_changes, tone_changes;
+	unsigned int diseqc_msgs;
+	unsigned char last_diseqc[6];
+	unsigned int last_diseqc_len;
+};
+
+int frontend_sim_load(char *filename);
+unsigned int frontend_sim_get_tps(struct frontend_sim_tp **tps);
+struct frontend_sim_stats *frontend_sim_get_stats(int frontend_fd);
+void frontend_sim_reset();
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+
+#define PIPELINE_TEST_BUFFERS	300	// Buffers pushed by the reader in each run
+#define PIPELINE_TEST_SLOW	1000	// Time a slow consumer spends on each buffer in us
+
+static int failed = 0;
+
+static void check(int cond, char *what) {
+
+	printf("%s : %s\n", (cond ? "PASS" : "FAIL"), what);
+	if (!cond)
+		failed = 1;
+}
+
+struct pipeline_test_consumer {
+	useconds_t delay;
+	unsigned long next; // Sequence number expected next
+	unsigned long received, missed; // Buffers, missed ones are the gaps in the sequence
+};
+
+static int pipeline_test_process(struct pipeline_buffer *buff, void *priv) {
+
+	struct pipeline_test_consumer *t = priv;
+	if (buff->seq > t->next)
+		t->missed += buff->seq - t->next;
+	t->next = buff->seq + 1;
+	t->received++;
+
+	if (t->delay)
+		usleep(t->delay);
+
+	return 0;
+}
+
+// Wait for the consumers to catch up then count the buffers back in the pool
+static unsigned int pipeline_test_free(struct pipeline *p) {
+
+	while (1) {
+		pthread_mutex_lock(&p->lock);
+		unsigned int i, busy = 0;
+		for (i = 0; i < p->consumer_count; i++)
+			busy += p->consumers[i].len;
+		if (!busy)
+			break;
+		pthread_mutex_unlock(&p->lock);
+		usleep(1000);
+	}
+
+	unsigned int count = 0;
+	struct pipeline_buffer *buff;
+	for (buff = p->free; buff; buff = buff->next)
+		count++;
+	pthread_mutex_unlock(&p->lock);
+
+	return count;
+}
+
+static void pipeline_test_run(enum pipeline_policy slow_policy, char *name) {
+
+	printf("Slow consumer %s when full :\n", name);
+
+	struct pipeline_test_consumer slow = {0}, fast = {0};
+	slow.delay = PIPELINE_TEST_SLOW;
+	enum pipeline_policy fast_policy = (slow_policy == pipeline_policy_drop ? pipeline_policy_block : pipeline_policy_drop);
+
+	struct pipeline p;
+	pipeline_init(&p);
+	pipeline_add(&p, "slow", slow_policy, pipeline_test_process, &slow);
+	pipeline_add(&p, "fast", fast_policy, pipeline_test_process, &fast);
+	if (pipeline_start(&p)) {
+		check(0, "pipeline started");
+		return;
+	}
+
+	unsigned int pool = p.consumer_count * PIPELINE_QUEUE_SIZE + 2;
+
+	unsigned int i;
+	for (i = 0; i < PIPELINE_TEST_BUFFERS; i++) {
+		struct pipeline_buffer *buff = pipeline_get(&p);
+		memset(buff->data, 0x47, sizeof(buff->data));
+		buff->len = sizeof(buff->data);
+		pipeline_push(&p, buff);
+	}
+
+	// Nothing to hand out, it goes back to the pool without a sequence number
+	struct pipeline_buffer *buff = pipeline_get(&p);
+	pipeline_push(&p, buff);
+	check(p.seq == PIPELINE_TEST_BUFFERS, "empty buffer skipped");
+
+	check(pipeline_test_free(&p) == pool, "every buffer back in the pool");
+
+	struct pipeline_consumer *c_slow = &p.consumers[0], *c_fast = &p.consumers[1];
+	pipeline_print_stats(&p);
+
+	unsigned long slow_missed = slow.missed + PIPELINE_TEST_BUFFERS - slow.next;
+	unsigned long fast_missed = fast.missed + PIPELINE_TEST_BUFFERS - fast.next;
+	printf("slow : %lu received, %lu missed\nfast : %lu received, %lu missed\n", slow.received, slow_missed, fast.received, fast_missed);
+
+	check(slow.received + slow_missed == PIPELINE_TEST_BUFFERS && fast.received + fast_missed == PIPELINE_TEST_BUFFERS, "every buffer received or missed");
+	check(c_slow->dropped == slow_missed * PIPELINE_BUFF_PKTS && c_fast->dropped == fast_missed * PIPELINE_BUFF_PKTS, "sequence gaps match the dropped packets");
+	check(c_slow->buffers == slow.received && c_fast->buffers == fast.received, "processed buffers counted");
+
+	if (slow_policy == pipeline_policy_drop) {
+		check(c_slow->dropped > 0 && !c_slow->stalls, "slow consumer drops and never stalls the reader");
+		check(!fast_missed && fast.received == PIPELINE_TEST_BUFFERS, "blocking consumer misses nothing");
+	} else {
+		check(c_slow->stalls > 0 && !slow_missed, "slow consumer stalls the reader and misses nothing");
+		check(!c_fast->stalls, "dropping consumer never stalls the reader");
+	}
+
+	pipeline_stop(&p);
+}
+
+int main(int argc, char **argv) {
+
+	pipeline_test_run(pipeline_policy_drop, "dropping");
+	pipeline_test_run(pipeline_policy_block, "blocking");
+
+	return failed;
+}
@@ -0,0 +1,352 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <math.h>
+
+#include "dvbgyver.h"
+#include "diseqc.h"
+#include "frontend_sim.h"
+#include "scan.h"
+#include "tpdb.h"
+#include "usals.h"
+
+static int failed = 0;
+
+static void check(int cond, char *what) {
+
+	printf("%s : %s\n", (cond ? "PASS" : "FAIL"), what);
+	if (!cond)
+		failed = 1;
+}
+
+static void scan_test_params(struct scan_params *p, enum scan_mode mode) {
+
+	memset(p, 0, sizeof(struct scan_params));
+	p->type = FE_QPSK;
+	p->lnb = lnb_type_universal;
+	p->mode = mode;
+	p->timeout = 1;
+	p->start_freq = 10700000;
+	p->end_freq = 12750000;
+	p->step = 1000;
+	p->symbol_rates[0] = 27500000;
+	p->symbol_rates[1] = 22000000;
+	p->symbol_rates[2] = 30000000;
+	p->symbol_rates[3] = 7200000;
+	p->rate_count = 4;
+	p->dvb_s2 = 1;
+	p->quiet = 1;
+}
+
+// Every simulated transponder must be in the results, close enough to its center
+static unsigned int scan_test_matched(struct scan_params *p) {
+
+	struct frontend_sim_tp *tps;
+	unsigned int tp_count = frontend_sim_get_tps(&tps);
+
+	unsigned int i, j, matched = 0;
+	for (i = 0; i < tp_count; i++) {
+		for (j = 0; j < p->result_count; j++) {
+			struct scan_result *res = &p->results[j];
+			unsigned int d = (res->freq > tps[i].freq ? res->freq - tps[i].freq : tps[i].freq - res->freq);
+			if (res->polarity == tps[i].polarity && res->symbol_rate == tps[i].symbol_rate && d <= tps[i].symbol_rate / 5000) {
+				matched++;
+				break;
+			}
+		}
+		if (j == p->result_count)
+			printf("Missed %u Mhz, %s, %u kSym/s\n", tps[i].freq / 1000, (tps[i].polarity ? "V" : "H"), tps[i].symbol_rate / 1000);
+	}
+
+	return matched;
+}
+
+static int scan_test_run(enum scan_mode mode, struct scan_params *p) {
+
+	struct dvb_frontend_info fe_info;
+	int fd = frontend_open("sim", &fe_info);
+	if (fd == -1)
+		return -1;
+
+	scan_test_params(p, mode);
+	int res = scan(fd, p);
+	frontend_close(fd);
+
+	return res;
+}
+
+// Adaptive and linear sweeps of the same band must agree on what they find
+static void scan_test_adaptive() {
+
+	struct frontend_sim_tp *tps;
+	unsigned int tp_count = frontend_sim_get_tps(&tps);
+
+	struct scan_params linear, adaptive;
+	check(!scan_test_run(scan_mode_linear, &linear), "linear scan");
+	check(!scan_test_run(scan_mode_adaptive, &adaptive), "adaptive scan");
+
+	unsigned int linear_matched = scan_test_matched(&linear);
+	unsigned int adaptive_matched = scan_test_matched(&adaptive);
+	printf("Linear : %u attempts, %u found, %u of %u transponders matched\n", linear.attempts, linear.found, linear_matched, tp_count);
+	printf("Adaptive : %u attempts, %u found, %u of %u transponders matched\n", adaptive.attempts, adaptive.found, adaptive_matched, tp_count);
+
+	check(linear_matched == tp_count, "linear scan finds every transponder");
+	check(adaptive_matched == tp_count, "adaptive scan finds every transponder");
+	check(adaptive.found == linear.found, "adaptive and linear scans find as many transponders");
+	// The narrowest carrier has to be hit at least twice, with the band
+	// plan above that alone limits the gain to about 5x
+	printf("Adaptive scan needs %.1fx fewer attempts\n", (double) linear.attempts / adaptive.attempts);
+	check(adaptive.attempts * 29 < linear.attempts * 10, "adaptive scan needs 2.9x fewer attempts");
+
+	scan_cleanup(&linear);
+	scan_cleanup(&adaptive);
+}
+
+// Several frontends sharing the band must find the same transponders as one
+static void scan_test_parallel(unsigned int count) {
+
+	struct frontend_sim_tp *tps;
+	unsigned int tp_count = frontend_sim_get_tps(&tps);
+
+	int fds[FRONTEND_SIM_MAX_FRONTENDS];
+	char *demux_devs[FRONTEND_SIM_MAX_FRONTENDS] = { NULL };
+	struct dvb_frontend_info fe_info;
+	unsigned int i;
+	for (i = 0; i < count; i++)
+		fds[i] = frontend_open("sim", &fe_info);
+
+	frontend_sim_reset();
+
+	struct scan_params p;
+	scan_test_params(&p, scan_mode_adaptive);
+	char what[64];
+	snprintf(what, sizeof(what), "parallel scan on %u frontends", count);
+	check(!scan_parallel(fds, demux_devs, count, &p), what);
+
+	unsigned int matched = scan_test_matched(&p), idle = 0;
+	for (i = 0; i < count; i++) {
+		if (!frontend_sim_get_stats(fds[i])->tunes)
+			idle++;
+		frontend_close(fds[i]);
+	}
+	printf("%u frontends : %u attempts, %u found, %u of %u transponders matched\n", count, p.attempts, p.found, matched, tp_count);
+
+	check(matched == tp_count && p.result_count == tp_count, "parallel scan finds every transponder once");
+	check(!idle, "every frontend takes part in the scan");
+
+	scan_cleanup(&p);
+}
+
+// The switch only needs a command when the polarity or the band changes
+static void scan_test_switch() {
+
+	struct dvb_frontend_info fe_info;
+	int fd = frontend_open("sim", &fe_info);
+
+	struct scan_params p;
+	scan_test_params(&p, scan_mode_adaptive);
+	p.switch_port = 2;
+	check(!scan(fd, &p), "scan behind a DiSEqC switch");
+
+	struct frontend_sim_stats *stats = frontend_sim_get_stats(fd);
+	printf("Switch : %u attempts, %u DiSEqC messages, last %02x %02x %02x %02x\n", p.attempts, stats->diseqc_msgs,
+		stats->last_diseqc[0], stats->last_diseqc[1], stats->last_diseqc[2], stats->last_diseqc[3]);
+	// Four polarity and band pairs, plus the refinements across the band edge
+	check(stats->diseqc_msgs >= 4 && stats->diseqc_msgs <= 8, "switch commands only on polarity or band changes");
+	check(scan_test_matched(&p) == p.result_count && p.found == 16, "scan behind a switch finds every transponder");
+
+	frontend_close(fd);
+	scan_cleanup(&p);
+}
+
+static void scan_test_found(struct dvbgyver_transponder *tp, void *priv) {
+
+	unsigned int *count = priv;
+	(*count)++;
+}
+
+// Same scan through the public API, stopping one handle leaves the others alone
+static void scan_test_api() {
+
+	struct dvbgyver *dg = dvbgyver_open(0, 0, "universal", 1);
+	struct dvbgyver *other = dvbgyver_open(1, 0, "universal", 1);
+	check(dg && other, "open through the API");
+	if (!dg || !other)
+		return;
+
+	check(dvbgyver_tune(dg, 10743000, 0, 22000000) == 1, "tune through the API");
+	check(dvbgyver_tune(dg, 10743000, 1, 22000000) == 0, "no lock on the other polarity");
+
+	unsigned int rates[] = { 27500000, 22000000, 30000000, 7200000 };
+	unsigned int count = 0;
+	dvbgyver_stop(other);
+	int found = dvbgyver_scan(dg, 0, 0, rates, 4, scan_test_found, &count);
+	printf("API : %d found, %u reported\n", found, count);
+	check(found == 16 && count == 16, "scan through the API");
+
+	dvbgyver_stop(dg);
+	found = dvbgyver_scan(dg, 0, 0, rates, 4, NULL, NULL);
+	check(found == 0, "a stopped handle ends its scan right away");
+	found = dvbgyver_scan(dg, 0, 0, rates, 4, NULL, NULL);
+	check(found == 16, "the stop only applies to one scan");
+
+	dvbgyver_close(dg);
+	dvbgyver_close(other);
+}
+
+// The handle hides its descriptor, find the frontend the last command went to
+static struct frontend_sim_stats *scan_test_diseqc_stats() {
+
+	int i;
+	for (i = 0; i < FRONTEND_SIM_MAX_FRONTENDS; i++) {
+		struct frontend_sim_stats *stats = frontend_sim_get_stats(FRONTEND_SIM_FD_BASE + i);
+		if (stats && stats->diseqc_msgs)
+			return stats;
+	}
+
+	return NULL;
+}
+
+// Switch, positioner and USALS through the public API
+static void scan_test_api_diseqc() {
+
+	struct dvbgyver *dg = dvbgyver_open(0, 0, "universal", 1);
+	check(dg != NULL, "open for DiSEqC through the API");
+	if (!dg)
+		return;
+
+	frontend_sim_reset();
+	check(dvbgyver_set_switch(dg, 5, 0) == -1, "switch port out of range refused");
+	check(dvbgyver_set_switch(dg, 2, 0) == 0 && dvbgyver_tune(dg, 11778000, 1, 27500000) == 1, "tune behind a switch through the API");
+	struct frontend_sim_stats *stats = scan_test_diseqc_stats();
+	unsigned char msg[DISEQC_MAX_MSG];
+	unsigned int len = diseqc_committed(msg, 2, 1, 1);
+	check(stats && stats->last_diseqc_len == len && !memcmp(stats->last_diseqc, msg, len), "switch command sent by the tune");
+	dvbgyver_set_switch(dg, 0, 0);
+
+	struct dvbgyver_site *site = dvbgyver_site_open(4.35, 50.85);
+	check(site != NULL, "site through the API");
+	if (site) {
+		double angle = 0.0;
+		int res = dvbgyver_site_angle(site, 19.2, &angle);
+		check(!res && fabs(angle - usals(4.35, 50.85, 19.2)) < 0.001, "site angle matches usals()");
+		check(dvbgyver_site_angle(site, -120.0, &angle) == -1, "satellite below the horizon refused");
+
+		frontend_sim_reset();
+		dvbgyver_site_angle(site, 19.2, &angle);
+		check(dvbgyver_rotor_goto_x(dg, angle) == 0, "goto_x through the API");
+		stats = scan_test_diseqc_stats();
+		len = diseqc_rotor(msg, diseqc_rotor_goto_x, usals_goto_x(angle));
+		check(stats && stats->last_diseqc_len == len && !memcmp(stats->last_diseqc, msg, len), "goto_x command sent");
+		dvbgyver_site_close(site);
+	}
+	check(dvbgyver_rotor_goto_x(dg, 90.0) == -1, "goto_x beyond the rotor limits refused");
+
+	frontend_sim_reset();
+	check(dvbgyver_rotor_step(dg, -3) == 0, "step through the API");
+	stats = scan_test_diseqc_stats();
+	len = diseqc_rotor(msg, diseqc_rotor_drive_west, 0x100 - 3);
+	check(stats && stats->last_diseqc_len == len && !memcmp(stats->last_diseqc, msg, len), "west steps sent as a negative number");
+	check(dvbgyver_rotor_step(dg, 0) == -1 && dvbgyver_rotor_goto(dg, 256) == -1, "invalid step count and slot refused");
+
+	dvbgyver_close(dg);
+}
+
+static volatile sig_atomic_t scan_test_stopped = 0;
+
+static void *scan_test_stopper(void *arg) {
+
+	usleep(30000);
+	scan_test_stopped = 1;
+
+	return NULL;
+}
+
+// Only the sweep regions covered from one end to the other are remembered
+static void scan_test_regions() {
+
+	struct dvb_frontend_info fe_info;
+	int fd = frontend_open("sim", &fe_info);
+
+	struct tpdb db;
+	tpdb_open(&db, "scan_test.tpdb");
+
+	struct scan_params p;
+	scan_test_params(&p, scan_mode_adaptive);
+	p.db = &db;
+	p.sat = "19.2E";
+	p.start_freq = 10720000;
+	p.end_freq = 10899000;
+	check(!scan(fd, &p), "scan starting inside a region");
+	check(!tpdb_region_get(&db, p.sat, 0, 10700000), "partly swept region not remembered");
+	check(tpdb_region_get(&db, p.sat, 0, 10750000) == p.started && tpdb_region_get(&db, p.sat, 1, 10850000) == p.started, "swept regions remembered");
+	scan_cleanup(&p);
+	tpdb_close(&db);
+
+	// Stopped in the middle of the horizontal sweep
+	tpdb_open(&db, "scan_test.tpdb");
+	scan_test_params(&p, scan_mode_adaptive);
+	p.db = &db;
+	p.sat = "19.2E";
+	p.stop = &scan_test_stopped;
+	pthread_t thread;
+	pthread_create(&thread, NULL, scan_test_stopper, NULL);
+	scan(fd, &p);
+	pthread_join(thread, NULL);
+
+	unsigned int region, swept = 0, holes = 0, vertical = 0;
+	for (region = 10700000; region < 12750000; region += TPDB_REGION_SIZE) {
+		if (tpdb_region_get(&db, p.sat, 0, region)) {
+			swept++;
+			if (region + TPDB_REGION_SIZE > p.swept || region != 10700000 + (swept - 1) * TPDB_REGION_SIZE)
+				holes++;
+		}
+		if (tpdb_region_get(&db, p.sat, 1, region))
+			vertical++;
+	}
+	printf("Stopped at %u Mhz, %u regions remembered\n", p.swept / 1000, swept);
+	check(swept < (12750000 - 10700000) / TPDB_REGION_SIZE && !holes && !vertical, "interrupted sweep only remembers what it covered");
+	scan_cleanup(&p);
+	tpdb_close(&db);
+
+	frontend_close(fd);
+}
+
+int main(int argc, char **argv) {
+
+	if (argc > 1 && frontend_sim_load(argv[1]))
+		return 1;
+
+	scan_test_adaptive();
+	scan_test_parallel(1);
+	scan_test_parallel(4);
+	scan_test_switch();
+	scan_test_api();
+	scan_test_api_diseqc();
+	scan_test_regions();
+
+	return failed;
+}
@@ -0,0 +1,103 @@
+/*
+ *  dvbgyver: A suite of tools for DVB 
+ *  Copyright (C) 2012 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include <stdio.h>
+#include <math.h>
+
+#include "usals.h"
+
+#define USALS_TEST_TOLERANCE	0.001	// Degrees, GotoX itself only has a resolution of 1/16 degree
+#define USALS_TEST_STEP		0.0137	// Orbital positions checked, not aligned on the table
+
+static int failed = 0;
+
+static void check(int cond, char *what) {
+
+	printf("%s : %s\n", (cond ? "PASS" : "FAIL"), what);
+	if (!cond)
+		failed = 1;
+}
+
+// Interpolating in the table must give the computed angles everywhere on the visible arc
+static void usals_test_table(double lon, double lat) {
+
+	struct usals_site site;
+	usals_site_init(&site, lon, lat);
+
+	struct usals_table table;
+	char what[128];
+	snprintf(what, sizeof(what), "table for %.1f %.1f", lon, lat);
+	check(!usals_table_init(&table, &site, USALS_TABLE_STEP), what);
+	if (!table.angles)
+		return;
+
+	static double pos[20000], angles[20000];
+	unsigned int count = 0, missing = 0;
+	double d;
+	for (d = -table.arc + USALS_TEST_STEP; d < table.arc && count < 20000; d += USALS_TEST_STEP)
+		pos[count++] = lon + d;
+	usals_angles(&site, pos, angles, count);
+
+	double max = 0.0;
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		double angle;
+		if (usals_table_angle(&table, pos[i], &angle)) {
+			missing++;
+			continue;
+		}
+		if (fabs(angle - angles[i]) > max)
+			max = fabs(angle - angles[i]);
+	}
+	printf("Site %.1f %.1f : visible arc of %.2f degrees each way, %u entries, %u positions checked, largest error %.6f degrees\n",
+		lon, lat, table.arc, table.count, count, max);
+	snprintf(what, sizeof(what), "table within %.3f degrees of usals_angles() for %.1f %.1f", USALS_TEST_TOLERANCE, lon, lat);
+	check(!missing && max <= USALS_TEST_TOLERANCE, what);
+
+	// Behind the site and just past the horizon on both sides
+	double angle;
+	snprintf(what, sizeof(what), "positions below the horizon refused for %.1f %.1f", lon, lat);
+	check(usals_table_angle(&table, lon + 180.0, &angle) && usals_table_angle(&table, lon + table.arc + 0.01, &angle) &&
+		usals_table_angle(&table, lon - table.arc - 0.01, &angle), what);
+
+	// Longitudes are taken modulo 360
+	double wrapped;
+	snprintf(what, sizeof(what), "wrapped longitudes for %.1f %.1f", lon, lat);
+	check(!usals_table_angle(&table, lon + 10.0, &angle) && !usals_table_angle(&table, lon + 10.0 - 360.0, &wrapped) && fabs(angle - wrapped) < 1e-9, what);
+
+	usals_table_cleanup(&table);
+}
+
+int main(int argc, char **argv) {
+
+	usals_test_table(4.4, 50.8);
+	usals_test_table(-73.9, 40.7);
+	usals_test_table(151.2, -33.9);
+	usals_test_table(170.0, 65.0);
+
+	// Nothing is visible that close to the poles
+	struct usals_site site;
+	struct usals_table table;
+	usals_site_init(&site, 0.0, 85.0);
+	check(usals_table_init(&table, &site, USALS_TABLE_STEP) == -1, "no table near the poles");
+
+	return failed;
+}
@@ -0,0 +1,324 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "tpdb.h"
+
+// The database is a text file with one record per line :
+// T <sat> <freq> <H|V> <symbol_rate> <last_seen> <last_check> <strength> <snr> <services>
+// R <sat> <H|V> <region start> <last_swept>
+// S <sat> <L|H band> <symbol_rate> <hits>
+
+int tpdb_open(struct tpdb *db, char *filename) {
+
+	memset(db, 0, sizeof(struct tpdb));
+	db->filename = filename;
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		if (errno == ENOENT)
+			return 0; // New database
+		perror("Error while opening the transponder database");
+		return -1;
+	}
+
+	char line[256];
+	unsigned int line_num = 0;
+	while (fgets(line, sizeof(line), f)) {
+		line_num++;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		char sat[TPDB_SAT_LEN], pol;
+		unsigned int freq;
+		long long t1, t2;
+
+		if (line[0] == 'T') {
+			struct tpdb_transponder tp = {0};
+			if (sscanf(line, "T %15s %u %c %u %lld %lld %u %u %u", sat, &freq, &pol, &tp.symbol_rate, &t1, &t2, &tp.strength, &tp.snr, &tp.services) != 9)
+				goto invalid;
+			struct tpdb_transponder *tps = realloc(db->tps, sizeof(struct tpdb_transponder) * (db->tp_count + 1));
+			if (!tps) {
+				perror("Not enough memory");
+				goto err;
+			}
+			db->tps = tps;
+			strcpy(tp.sat, sat);
+			tp.freq = freq;
+			tp.polarity = (pol == 'V');
+			tp.last_seen = t1;
+			tp.last_check = t2;
+			db->tps[db->tp_count++] = tp;
+
+		} else if (line[0] == 'R') {
+			if (sscanf(line, "R %15s %c %u %lld", sat, &pol, &freq, &t1) != 4)
+				goto invalid;
+			if (tpdb_region_set(db, sat, (pol == 'V'), freq, t1))
+				goto err;
+		} else if (line[0] == 'S') {
+			unsigned int hits;
+			if (sscanf(line, "S %15s %c %u %u", sat, &pol, &freq, &hits) != 4)
+				goto invalid;
+			if (tpdb_rate_hit(db, sat, (pol == 'H'), freq, hits))
+				goto err;
+		} else {
+			goto invalid;
+		}
+		continue;
+
+invalid:
+		printf("Invalid line %u in transponder database %s, ignoring\n", line_num, filename);
+	}
+
+	fclose(f);
+
+	return 0;
+
+err:
+	fclose(f);
+	tpdb_close(db);
+	return -1;
+}
+
+static int tpdb_compare(const void *a, const void *b) {
+
+	const struct tpdb_transponder *tpa = a, *tpb = b;
+
+	int res = strcmp(tpa->sat, tpb->sat);
+	if (res)
+		return res;
+	if (tpa->polarity != tpb->polarity)
+		return tpa->polarity - tpb->polarity;
+	if (tpa->freq != tpb->freq)
+		return (tpa->freq < tpb->freq ? -1 : 1);
+	return 0;
+}
+
+int tpdb_save(struct tpdb *db) {
+
+	char tmp[PATH_MAX];
+	snprintf(tmp, PATH_MAX - 1, "%s.tmp", db->filename);
+
+	FILE *f = fopen(tmp, "w");
+	if (!f) {
+		perror("Error while opening the transponder database for writing");
+		return -1;
+	}
+
+	qsort(db->tps, db->tp_count, sizeof(struct tpdb_transponder), tpdb_compare);
+
+	fprintf(f, "# dvbgyver transponder database\n");
+
+	unsigned int i;
+	for (i = 0; i < db->tp_count; i++) {
+		struct tpdb_transponder *tp = &db->tps[i];
+		fprintf(f, "T %s %u %c %u %lld %lld %u %u %u\n", tp->sat, tp->freq, (tp->polarity ? 'V' : 'H'), tp->symbol_rate, (long long) tp->last_seen, (long long) tp->last_check, tp->strength, tp->snr, tp->services);
+	}
+
+	for (i = 0; i < db->region_count; i++) {
+		struct tpdb_region *r = &db->regions[i];
+		fprintf(f, "R %s %c %u %lld\n", r->sat, (r->polarity ? 'V' : 'H'), r->start, (long long) r->last_swept);
+	}
+
+	for (i = 0; i < db->rate_count; i++) {
+		struct tpdb_rate *r = &db->rates[i];
+		fprintf(f, "S %s %c %u %u\n", r->sat, (r->hiband ? 'H' : 'L'), r->symbol_rate, r->hits);
+	}
+
+	if (fclose(f)) {
+		perror("Error while writing the transponder database");
+		return -1;
+	}
+
+	// Atomically replace the previous version
+	if (rename(tmp, db->filename)) {
+		perror("Error while renaming the transponder database");
+		return -1;
+	}
+
+	return 0;
+}
+
+int tpdb_copy(struct tpdb *dst, struct tpdb *src) {
+
+	// Lets a slow save run from a copy while the original keeps changing
+	memset(dst, 0, sizeof(struct tpdb));
+	dst->filename = src->filename;
+
+	dst->tps = malloc(sizeof(struct tpdb_transponder) * (src->tp_count ? src->tp_count : 1));
+	dst->regions = malloc(sizeof(struct tpdb_region) * (src->region_count ? src->region_count : 1));
+	dst->rates = malloc(sizeof(struct tpdb_rate) * (src->rate_count ? src->rate_count : 1));
+	if (!dst->tps || !dst->regions || !dst->rates) {
+		perror("Not enough memory");
+		tpdb_close(dst);
+		return -1;
+	}
+
+	memcpy(dst->tps, src->tps, sizeof(struct tpdb_transponder) * src->tp_count);
+	dst->tp_count = src->tp_count;
+	memcpy(dst->regions, src->regions, sizeof(struct tpdb_region) * src->region_count);
+	dst->region_count = src->region_count;
+	memcpy(dst->rates, src->rates, sizeof(struct tpdb_rate) * src->rate_count);
+	dst->rate_count = src->rate_count;
+
+	return 0;
+}
+
+void tpdb_close(struct tpdb *db) {
+
+	free(db->tps);
+	free(db->regions);
+	free(db->rates);
+	memset(db, 0, sizeof(struct tpdb));
+}
+
+struct tpdb_transponder *tpdb_find(struct tpdb *db, char *sat, unsigned int freq, int polarity, unsigned int tolerance) {
+
+	struct tpdb_transponder *best = NULL;
+	unsigned int best_diff = tolerance + 1;
+
+	unsigned int i;
+	for (i = 0; i < db->tp_count; i++) {
+		struct tpdb_transponder *tp = &db->tps[i];
+		if (tp->polarity != polarity || strcmp(tp->sat, sat))
+			continue;
+		unsigned int diff = (tp->freq > freq ? tp->freq - freq : freq - tp->freq);
+		if (diff < best_diff) {
+			best = tp;
+			best_diff = diff;
+		}
+	}
+
+	return best;
+}
+
+struct tpdb_transponder *tpdb_update(struct tpdb *db, char *sat, unsigned int freq, int polarity, unsigned int symbol_rate, unsigned int tolerance) {
+
+	struct tpdb_transponder *tp = tpdb_find(db, sat, freq, polarity, tolerance);
+	if (!tp) {
+		struct tpdb_transponder *tps = realloc(db->tps, sizeof(struct tpdb_transponder) * (db->tp_count + 1));
+		if (!tps) {
+			perror("Not enough memory");
+			return NULL;
+		}
+		db->tps = tps;
+		tp = &db->tps[db->tp_count++];
+		memset(tp, 0, sizeof(struct tpdb_transponder));
+		strncpy(tp->sat, sat, TPDB_SAT_LEN - 1);
+		tp->polarity = polarity;
+	}
+
+	tp->freq = freq;
+	tp->symbol_rate = symbol_rate;
+	tp->last_seen = time(NULL);
+	tp->last_check = tp->last_seen;
+
+	return tp;
+}
+
+time_t tpdb_region_get(struct tpdb *db, char *sat, int polarity, unsigned int freq) {
+
+	freq -= freq % TPDB_REGION_SIZE;
+
+	unsigned int i;
+	for (i = 0; i < db->region_count; i++) {
+		struct tpdb_region *r = &db->regions[i];
+		if (r->start == freq && r->polarity == polarity && !strcmp(r->sat, sat))
+			return r->last_swept;
+	}
+
+	return 0;
+}
+
+int tpdb_region_set(struct tpdb *db, char *sat, int polarity, unsigned int freq, time_t when) {
+
+	freq -= freq % TPDB_REGION_SIZE;
+
+	unsigned int i;
+	for (i = 0; i < db->region_count; i++) {
+		struct tpdb_region *r = &db->regions[i];
+		if (r->start == freq && r->polarity == polarity && !strcmp(r->sat, sat)) {
+			r->last_swept = when;
+			return 0;
+		}
+	}
+
+	struct tpdb_region *regions = realloc(db->regions, sizeof(struct tpdb_region) * (db->region_count + 1));
+	if (!regions) {
+		perror("Not enough memory");
+		return -1;
+	}
+	db->regions = regions;
+
+	struct tpdb_region *r = &db->regions[db->region_count++];
+	memset(r, 0, sizeof(struct tpdb_region));
+	strncpy(r->sat, sat, TPDB_SAT_LEN - 1);
+	r->polarity = polarity;
+	r->start = freq;
+	r->last_swept = when;
+
+	return 0;
+}
+
+unsigned int tpdb_rate_get(struct tpdb *db, char *sat, int hiband, unsigned int symbol_rate) {
+
+	unsigned int i;
+	for (i = 0; i < db->rate_count; i++) {
+		struct tpdb_rate *r = &db->rates[i];
+		if (r->symbol_rate == symbol_rate && r->hiband == hiband && !strcmp(r->sat, sat))
+			return r->hits;
+	}
+
+	return 0;
+}
+
+int tpdb_rate_hit(struct tpdb *db, char *sat, int hiband, unsigned int symbol_rate, unsigned int hits) {
+
+	unsigned int i;
+	for (i = 0; i < db->rate_count; i++) {
+		struct tpdb_rate *r = &db->rates[i];
+		if (r->symbol_rate == symbol_rate && r->hiband == hiband && !strcmp(r->sat, sat)) {
+			r->hits += hits;
+			return 0;
+		}
+	}
+
+	struct tpdb_rate *rates = realloc(db->rates, sizeof(struct tpdb_rate) * (db->rate_count + 1));
+	if (!rates) {
+		perror("Not enough memory");
+		return -1;
+	}
+	db->rates = rates;
+
+	struct tpdb_rate *r = &db->rates[db->rate_count++];
+	memset(r, 0, sizeof(struct tpdb_rate));
+	strncpy(r->sat, sat, TPDB_SAT_LEN - 1);
+	r->hiband = hiband;
+	r->symbol_rate = symbol_rate;
+	r->hits = hits;
+
+	return 0;
+}
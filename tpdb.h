@@ -0,0 +1,82 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __TPDB_H__
+#define __TPDB_H__
+
+#include <time.h>
+
+#define TPDB_SAT_LEN		16
+#define TPDB_REGION_SIZE	50000	// Size of a sweep region in kHz
+
+// A transponder that locked at least once
+struct tpdb_transponder {
+	char sat[TPDB_SAT_LEN];
+	unsigned int freq; // kHz
+	int polarity;
+	unsigned int symbol_rate; // Sym/s
+	time_t last_seen; // Last time we got a lock
+	time_t last_check; // Last time we tried to lock
+	unsigned int strength, snr; // Lock quality as reported by the frontend
+	unsigned int services;
+};
+
+// Last time a region of the spectrum was swept
+struct tpdb_region {
+	char sat[TPDB_SAT_LEN];
+	int polarity;
+	unsigned int start; // kHz, multiple of TPDB_REGION_SIZE
+	time_t last_swept;
+};
+
+// Number of transponders found with a symbol rate
+struct tpdb_rate {
+	char sat[TPDB_SAT_LEN];
+	int hiband;
+	unsigned int symbol_rate; // Sym/s
+	unsigned int hits;
+};
+
+struct tpdb {
+	char *filename;
+	struct tpdb_transponder *tps;
+	unsigned int tp_count;
+	struct tpdb_region *regions;
+	unsigned int region_count;
+	struct tpdb_rate *rates;
+	unsigned int rate_count;
+};
+
+int tpdb_open(struct tpdb *db, char *filename);
+int tpdb_save(struct tpdb *db);
+int tpdb_copy(struct tpdb *dst, struct tpdb *src);
+void tpdb_close(struct tpdb *db);
+
+struct tpdb_transponder *tpdb_find(struct tpdb *db, char *sat, unsigned int freq, int polarity, unsigned int tolerance);
+struct tpdb_transponder *tpdb_update(struct tpdb *db, char *sat, unsigned int freq, int polarity, unsigned int symbol_rate, unsigned int tolerance);
+
+time_t tpdb_region_get(struct tpdb *db, char *sat, int polarity, unsigned int freq);
+int tpdb_region_set(struct tpdb *db, char *sat, int polarity, unsigned int freq, time_t when);
+
+unsigned int tpdb_rate_get(struct tpdb *db, char *sat, int hiband, unsigned int symbol_rate);
+int tpdb_rate_hit(struct tpdb *db, char *sat, int hiband, unsigned int symbol_rate, unsigned int hits);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unicable.h"
+#include "diseqc.h"
+#include "utils.h"
+
+int unicable_init(struct unicable *u, enum unicable_type type, char *bands) {
+
+	memset(u, 0, sizeof(struct unicable));
+	u->type = type;
+
+	// Either a list of frequencies for bands 0, 1, 2, ... or ID:FREQ pairs, in Mhz
+	char *str, *token, *saveptr = NULL;
+	for (str = bands; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+		if (u->band_count >= UNICABLE_MAX_BANDS)
+			return -1;
+
+		struct unicable_band *band = &u->bands[u->band_count];
+		if (sscanf(token, "%u:%u", &band->id, &band->freq) != 2) {
+			band->id = u->band_count;
+			if (sscanf(token, "%u", &band->freq) != 1)
+				return -1;
+		}
+
+		unsigned int max_id = (type == unicable_type_en50494 ? 8 : UNICABLE_MAX_BANDS);
+		if (band->id >= max_id || !band->freq)
+			return -1;
+
+		band->freq *= 1000; // Switch to kHz
+		band->frontend_fd = -1;
+		u->band_count++;
+	}
+
+	if (!u->band_count)
+		return -1;
+
+	pthread_mutex_init(&u->lock, NULL);
+
+	return 0;
+}
+
+static struct unicable_band *unicable_get_band(struct unicable *u, int frontend_fd) {
+
+	// Tuners get the next free user band the first time they tune
+	unsigned int i;
+	struct unicable_band *free_band = NULL;
+	for (i = 0; i < u->band_count; i++) {
+		if (u->bands[i].frontend_fd == frontend_fd)
+			return &u->bands[i];
+		if (!free_band && u->bands[i].frontend_fd == -1)
+			free_band = &u->bands[i];
+	}
+
+	if (!free_band) {
+		printf("No Unicable user band left for frontend %d\n", frontend_fd);
+		return NULL;
+	}
+
+	free_band->frontend_fd = frontend_fd;
+	dvb_debug("Frontend %d uses Unicable user band %u at %u Mhz\n", frontend_fd, free_band->id, free_band->freq / 1000);
+
+	return free_band;
+}
+
+int unicable_tune(struct unicable *u, int frontend_fd, unsigned int ifreq, unsigned int hiband, int polarity, unsigned int *tune_freq) {
+
+	unsigned char cmd[5];
+	unsigned int len;
+
+	pthread_mutex_lock(&u->lock);
+
+	struct unicable_band *band = unicable_get_band(u, frontend_fd);
+	if (!band)
+		goto err;
+
+	// Horizontal is 1, like 18V on a classic LNB
+	unsigned int bank = (u->position << 2) | ((polarity ? 0 : 1) << 1) | (hiband ? 1 : 0);
+
+	if (u->type == unicable_type_en50494) {
+		// ODU_Channel_change : the SCR moves the transponder on the user band in 4 Mhz steps
+		unsigned int t = (ifreq + band->freq + 2000) / 4000 - 350;
+		if (t > 0x3ff)
+			goto range;
+		cmd[0] = 0xe0;
+		cmd[1] = 0x10;
+		cmd[2] = 0x5a;
+		cmd[3] = (band->id << 5) | (bank << 2) | (t >> 8);
+		cmd[4] = t & 0xff;
+		len = 5;
+		// The SCR oscillator is above the signal and inverts it
+		*tune_freq = (t + 350) * 4000 - ifreq;
+	} else {
+		// ODU_Channel_change_JESS : 1 Mhz steps, the transponder lands on the user band
+		unsigned int t = (ifreq + 500) / 1000 - 100;
+		if (t > 0x7ff)
+			goto range;
+		cmd[0] = 0x70;
+		cmd[1] = (band->id << 3) | (t >> 8);
+		cmd[2] = t & 0xff;
+		cmd[3] = bank;
+		len = 4;
+		*tune_freq = band->freq + ifreq - (t + 100) * 1000;
+	}
+
+	// Commands are only sent at 18V, the cable stays at 13V otherwise
+	struct diseqc_seq seq;
+	diseqc_seq_init(&seq);
+	diseqc_seq_tone(&seq, SEC_TONE_OFF);
+	diseqc_seq_voltage(&seq, SEC_VOLTAGE_18);
+	diseqc_seq_msg(&seq, cmd, len, 0);
+	diseqc_seq_voltage(&seq, SEC_VOLTAGE_13);
+	if (diseqc_seq_run(frontend_fd, &seq))
+		goto err;
+
+	pthread_mutex_unlock(&u->lock);
+
+	return 0;
+
+range:
+	printf("Intermediate frequency %u Mhz out of the Unicable range\n", ifreq / 1000);
+err:
+	pthread_mutex_unlock(&u->lock);
+	return -1;
+}
+
+unsigned int unicable_get_ifreq(struct unicable *u, unsigned int ifreq, unsigned int tune_freq, unsigned int freq) {
+
+	// Translate an offset seen by the tuner back to the LNB
+	int offset = (int) freq - (int) tune_freq;
+	if (u->type == unicable_type_en50494)
+		offset = -offset;
+
+	return ifreq + offset;
+}
+
+void unicable_cleanup(struct unicable *u) {
+
+	pthread_mutex_destroy(&u->lock);
+}
@@ -0,0 +1,55 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __UNICABLE_H__
+#define __UNICABLE_H__
+
+#include <pthread.h>
+
+#define UNICABLE_MAX_BANDS	32	// EN50607 has 32 user bands, EN50494 only 8
+
+enum unicable_type {
+	unicable_type_en50494,	// Unicable I, 8 user bands, 4 Mhz steps
+	unicable_type_en50607,	// Unicable II / JESS, 32 user bands, 1 Mhz steps
+};
+
+struct unicable_band {
+	unsigned int id; // User band number on the SCR
+	unsigned int freq; // Center of the user band in kHz
+	int frontend_fd; // Tuner using this band, -1 if free
+};
+
+struct unicable {
+	enum unicable_type type;
+	unsigned int position; // Satellite position A or B
+	struct unicable_band bands[UNICABLE_MAX_BANDS];
+	unsigned int band_count;
+
+	pthread_mutex_t lock; // Only one tuner may talk on the cable at a time
+};
+
+int unicable_init(struct unicable *u, enum unicable_type type, char *bands);
+int unicable_tune(struct unicable *u, int frontend_fd, unsigned int ifreq, unsigned int hiband, int polarity, unsigned int *tune_freq);
+unsigned int unicable_get_ifreq(struct unicable *u, unsigned int ifreq, unsigned int tune_freq, unsigned int freq);
+void unicable_cleanup(struct unicable *u);
+
+#endif
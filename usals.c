@@ -1,29 +1,29 @@
 
 #include <stdio.h>
-#include <getopt.h>
+#include <stdlib.h>
 #include <math.h>
 
-#define USALS_CLARKE_BELT_RADIUS	42164
-#define USALS_EARTH_RADIUS		6348
-#define PI				3.14159265
+#include "usals.h"
 
 
 double usals_deg_to_rad(double deg) {
-	return deg * PI / 180.0;
+	return deg * M_PI / 180.0;
 }
 
 double usals_rad_to_deg(double rad) {
-	return rad * 180.0 / PI;
+	return rad * 180.0 / M_PI;
 }
 
-double usals(double lon, double lat, double satpos) {
+void usals_site_init(struct usals_site *site, double lon, double lat) {
 
-	// Longitute difference with the given satpos
-	double dlon_rad	= usals_deg_to_rad(satpos - lon);
+	site->lon = lon;
+	site->lat = lat;
 
-	// Latitude
-	double lat_rad = usals_deg_to_rad(lat);
+	// Only depends on the site, no need to compute it for each satellite
+	site->re_cos_lat = USALS_EARTH_RADIUS * cos(usals_deg_to_rad(lat));
+}
 
+double usals_site_angle(struct usals_site *site, double satpos) {
 
 	// Formula :
 	// Rotor angle = ArcTan { Rc.Sin(DLong) / [Rc.Cos(DLong) − Re.Cos(Lat)] }
@@ -32,59 +32,135 @@ double usals(double lon, double lat, double satpos) {
 	// Re = Earth radius
 	// http://www.macfh.co.uk/JavaJive/AudioVisualTV/SatelliteTV/SatelliteAnalysisRotor.html
 
-	double dlon_rotor_rad = atan(  (USALS_CLARKE_BELT_RADIUS * sin(dlon_rad)) / ((USALS_CLARKE_BELT_RADIUS * cos(dlon_rad)) - (USALS_EARTH_RADIUS * cos (lat_rad))));
+	// Longitute difference with the given satpos
+	double dlon_rad	= usals_deg_to_rad(satpos - site->lon);
+
+	double dlon_rotor_rad = atan((USALS_CLARKE_BELT_RADIUS * sin(dlon_rad)) / ((USALS_CLARKE_BELT_RADIUS * cos(dlon_rad)) - site->re_cos_lat));
+
+	return usals_rad_to_deg(dlon_rotor_rad);
+}
+
+double usals(double lon, double lat, double satpos) {
+
+	struct usals_site site;
+	usals_site_init(&site, lon, lat);
+
+	return usals_site_angle(&site, satpos);
+}
 
-		return usals_rad_to_deg(dlon_rotor_rad);
+void usals_angles(struct usals_site *site, const double *restrict satpos, double *restrict angles, unsigned int count) {
 
+	// Same as above, kept branch free with the site constants hoisted so
+	// the compiler can vectorize it when the math library allows
+	const double lon = site->lon, re_cos_lat = site->re_cos_lat;
+	const double to_rad = M_PI / 180.0, to_deg = 180.0 / M_PI;
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		double dlon_rad = (satpos[i] - lon) * to_rad;
+		angles[i] = atan((USALS_CLARKE_BELT_RADIUS * sin(dlon_rad)) / ((USALS_CLARKE_BELT_RADIUS * cos(dlon_rad)) - re_cos_lat)) * to_deg;
+	}
 }
 
-int main(int argc, char *argv[]) {
-
-	double lon = 0.0, lat = 0.0, satpos = 0.0;
-
-	while (1) {
-		static struct option long_options[] = {
-			{ "latitute", 1, 0, 'y' },
-			{ "longitude", 1, 0, 'x' },
-			{ "satellite", 1, 0, 's' },
-		};
-
-		char *args = "x:y:s:";
-
-		int c = getopt_long(argc, argv, args, long_options, NULL);
-
-		if (c == -1)
-			break;
-
-		switch (c) {
-			case 'x':
-				if (sscanf(optarg, "%lf", &lon) != 1) {
-					printf("Invalid longitude\n");
-					return 1;
-				}
-				break;
-			case 'y':
-				if (sscanf(optarg, "%lf", &lat) != 1) {
-					printf("Invalid latitude\n");
-					return 1;
-				}
-				break;
-			case 's':
-				if (sscanf(optarg, "%lf", &satpos) != 1) {
-					printf("Invalid satellite position\n");
-					return 1;
-				}
-				break;
-			default:
-				printf("Invalid argument\n");
-				return 1;
-		}
+int usals_table_init(struct usals_table *table, struct usals_site *site, double step) {
+
+	if (step <= 0.0)
+		step = USALS_TABLE_STEP;
+
+	table->site = *site;
+	table->step = step;
+	table->angles = NULL;
+	table->count = 0;
+
+	// The horizon is where cos(DLong).Cos(Lat) = Re / Rc, only that arc is
+	// covered. Behind the site atan() jumps from +90 to -90 degrees.
+	double cos_arc = USALS_EARTH_RADIUS / (USALS_CLARKE_BELT_RADIUS * cos(usals_deg_to_rad(site->lat)));
+	if (cos_arc >= 1.0) {
+		printf("No satellite is visible from latitude %.1f\n", site->lat);
+		return -1;
+	}
+	table->arc = usals_rad_to_deg(acos(cos_arc));
+	table->count = (unsigned int) ceil(2.0 * table->arc / step) + 1;
+
+	double *pos = malloc(sizeof(double) * table->count);
+	table->angles = malloc(sizeof(double) * table->count);
+	if (!pos || !table->angles) {
+		perror("Not enough memory");
+		free(pos);
+		usals_table_cleanup(table);
+		return -1;
+	}
+
+	// The last step is shorter so that both ends are on the horizon
+	unsigned int i;
+	for (i = 0; i < table->count; i++) {
+		double dlon = -table->arc + i * step;
+		pos[i] = site->lon + (dlon > table->arc ? table->arc : dlon);
 	}
 
+	usals_angles(site, pos, table->angles, table->count);
+	free(pos);
+
+	// On the equator the formula divides by zero right on the horizon
+	if (table->angles[0] > 0.0)
+		table->angles[0] = -90.0;
+	if (table->angles[table->count - 1] < 0.0)
+		table->angles[table->count - 1] = 90.0;
+
+	return 0;
+}
+
+int usals_table_angle(struct usals_table *table, double satpos, double *angle) {
+
+	// Longitude difference with the site between -180 and 180
+	double dlon = fmod(satpos - table->site.lon, 360.0);
+	if (dlon >= 180.0)
+		dlon -= 360.0;
+	else if (dlon < -180.0)
+		dlon += 360.0;
+
+	if (dlon < -table->arc || dlon > table->arc)
+		return -1;
 
-	printf("Rotor angle is %f\n", usals(lon, lat, satpos));
+	// Linear interpolation between the two closest entries
+	unsigned int i = (unsigned int) ((dlon + table->arc) / table->step);
+	if (i > table->count - 2)
+		i = table->count - 2;
+	double from = -table->arc + i * table->step;
+	double to = (i + 1 == table->count - 1 ? table->arc : from + table->step);
+	double frac = (dlon - from) / (to - from);
 
+	*angle = table->angles[i] + (table->angles[i + 1] - table->angles[i]) * frac;
 
 	return 0;
+}
+
+void usals_table_cleanup(struct usals_table *table) {
+
+	free(table->angles);
+	table->angles = NULL;
+	table->count = 0;
+}
+
+unsigned int usals_goto_x(double angle) {
+
+	// GotoX argument : 0xE0 prefix for east, then the whole degrees on
+	// 12 bits and the fraction in sixteenths of a degree
+	unsigned char high = 0, low = 0;
+	if (angle > 0.0) {
+		// east
+		high = 0xE0;
+	} else {
+		angle = -angle;
+	}
+
+	high += (unsigned char) (angle / 16.0);
+	// Get the modulo 16
+	low += ((unsigned char) (((angle / 16.0) - (int) (angle / 16.0)) * 16)) << 4;
+
+	unsigned char decimal[10] = { 0x00, 0x2, 0x3, 0x5, 0x6, 0x8, 0xA, 0xB, 0xD, 0xE };
+	angle -= (int) angle;
+	low += decimal[(unsigned char) (angle * 10)];
 
+	return (high << 8) | low;
 }
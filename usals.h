@@ -0,0 +1,55 @@
+/*
+ *  feedhunter : Automated satellite feed hunter
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#ifndef __USALS_H__
+#define __USALS_H__
+
+#define USALS_CLARKE_BELT_RADIUS	42164
+#define USALS_EARTH_RADIUS		6348
+#define USALS_TABLE_STEP		0.1	// Default orbital position step of the angle tables in degrees
+
+struct usals_site {
+	double lon, lat; // Degrees, east and north are positive
+	double re_cos_lat; // Earth radius times the cosine of the latitude
+};
+
+// Rotor angle of the orbital positions visible from one site
+struct usals_table {
+	struct usals_site site;
+	double step; // Degrees
+	double arc; // Satellites further away in longitude are below the horizon, degrees
+	unsigned int count;
+	double *angles; // From arc west to arc east of the site
+};
+
+double usals_deg_to_rad(double deg);
+double usals_rad_to_deg(double rad);
+void usals_site_init(struct usals_site *site, double lon, double lat);
+double usals_site_angle(struct usals_site *site, double satpos);
+double usals(double lon, double lat, double satpos);
+void usals_angles(struct usals_site *site, const double *restrict satpos, double *restrict angles, unsigned int count);
+int usals_table_init(struct usals_table *table, struct usals_site *site, double step);
+int usals_table_angle(struct usals_table *table, double satpos, double *angle);
+void usals_table_cleanup(struct usals_table *table);
+unsigned int usals_goto_x(double angle);
+
+#endif
@@ -0,0 +1,84 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "usals.h"
+
+#define USALS_MAX_POSITIONS	256
+
+int main(int argc, char *argv[]) {
+
+	double lon = 0.0, lat = 0.0;
+	double satpos[USALS_MAX_POSITIONS] = { 0.0 };
+	unsigned int count = 1;
+
+	while (1) {
+		static struct option long_options[] = {
+			{ "latitute", 1, 0, 'y' },
+			{ "longitude", 1, 0, 'x' },
+			{ "satellite", 1, 0, 's' },
+			{ 0, 0, 0, 0 },
+		};
+
+		char *args = "x:y:s:";
+
+		int c = getopt_long(argc, argv, args, long_options, NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'x':
+				if (sscanf(optarg, "%lf", &lon) != 1) {
+					printf("Invalid longitude\n");
+					return 1;
+				}
+				break;
+			case 'y':
+				if (sscanf(optarg, "%lf", &lat) != 1) {
+					printf("Invalid latitude\n");
+					return 1;
+				}
+				break;
+			case 's': {
+				// One or more positions separated by commas
+				char *token, *saveptr = NULL;
+				for (count = 0, token = strtok_r(optarg, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr), count++) {
+					if (count >= USALS_MAX_POSITIONS || sscanf(token, "%lf", &satpos[count]) != 1) {
+						printf("Invalid satellite position\n");
+						return 1;
+					}
+				}
+				if (!count) {
+					printf("Invalid satellite position\n");
+					return 1;
+				}
+				break;
+			}
+			default:
+				printf("Invalid argument\n");
+				return 1;
+		}
+	}
+
+
+	if (count == 1) {
+		printf("Rotor angle is %f\n", usals(lon, lat, satpos[0]));
+		return 0;
+	}
+
+	struct usals_site site;
+	usals_site_init(&site, lon, lat);
+
+	double angles[USALS_MAX_POSITIONS];
+	usals_angles(&site, satpos, angles, count);
+
+	unsigned int i;
+	for (i = 0; i < count; i++)
+		printf("Satellite %.1f : rotor angle is %f\n", satpos[i], angles[i]);
+
+
+	return 0;
+
+}
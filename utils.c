@@ -47,4 +47,3 @@ int dvb_debug(const char *format, ...) {
 
 	return ret;
 }
-